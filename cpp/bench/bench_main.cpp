@@ -0,0 +1,299 @@
+// Benchmarks for the frame codec, register decoding and end-to-end reads
+// against the PTY battery emulator. Microbenchmarks also count heap
+// allocations per operation; none are allowed on the codec path.
+#include "battery_emulator.hpp"
+#include "frame_codec.hpp"
+#include "m18.hpp"
+#include "record_writer.hpp"
+#include "register_decode.hpp"
+#include "register_image.hpp"
+#include "register_values.hpp"
+#include "usage_histogram.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<size_t> g_allocations{0};
+volatile uint32_t g_sink = 0;
+
+struct Result {
+    const char* name;
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+// Wall time of a whole session step, repeated a few times
+struct Timing {
+    const char* name;
+    int runs;
+    double mean_ms;
+    double min_ms;
+    double max_ms;
+};
+
+uint32_t fold(uint32_t v) { return v; }
+uint32_t fold(float v) { return static_cast<uint32_t>(v * 100); }
+uint32_t fold(std::string_view v) { return static_cast<uint32_t>(v.size()) + static_cast<uint8_t>(v[0]); }
+uint32_t fold(const SerialNumber& v) { return v.type + v.serial; }
+uint32_t fold(const CellArray& v) { return v[0] + v[4]; }
+
+template <typename F>
+Timing time_runs(const char* name, int runs, F&& body) {
+    std::vector<double> ms;
+    for (int i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    double sum = 0;
+    for (double m : ms) {
+        sum += m;
+    }
+    return {name, runs, sum / runs, *std::min_element(ms.begin(), ms.end()),
+            *std::max_element(ms.begin(), ms.end())};
+}
+
+// Session steps against an in-process emulator. Output from M18 is discarded.
+std::vector<Timing> run_end_to_end(int runs) {
+    BatteryEmulator emulator;
+    emulator.start();
+    const std::string port = emulator.port();
+
+    std::ofstream null_out("/dev/null");
+    std::streambuf* saved = std::cout.rdbuf(null_out.rdbuf());
+
+    std::vector<Timing> timings;
+    timings.push_back(time_runs("cold start to first register", runs, [&]() {
+        M18 m18;
+        m18.connect(port);
+        m18.read_id({0}, false, "raw");
+    }));
+
+    M18 m18;
+    m18.connect(port);
+    timings.push_back(time_runs("read_id (all, force_refresh)", runs, [&]() {
+        m18.read_id({}, true);
+    }));
+    timings.push_back(time_runs("read_id (all, no refresh)", runs, [&]() {
+        m18.read_id({}, false);
+    }));
+    timings.push_back(time_runs("health (force_refresh)", runs, [&]() {
+        m18.health(true);
+    }));
+    m18.disconnect();
+
+    std::cout.rdbuf(saved);
+    emulator.stop();
+    return timings;
+}
+
+void write_json(const std::string& path, const std::vector<Result>& results, const std::vector<Timing>& timings) {
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if (out == nullptr) {
+        std::fprintf(stderr, "Cannot write %s\n", path.c_str());
+        return;
+    }
+    std::fprintf(out, "{\n  \"micro\": [");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        std::fprintf(out, "%s\n    {\"name\": \"%s\", \"ns_per_op\": %.3f, \"allocs_per_op\": %.3f}",
+                     i ? "," : "", r.name, r.ns_per_op, r.allocs_per_op);
+    }
+    std::fprintf(out, "\n  ],\n  \"end_to_end\": [");
+    for (size_t i = 0; i < timings.size(); ++i) {
+        const auto& t = timings[i];
+        std::fprintf(out, "%s\n    {\"name\": \"%s\", \"runs\": %d, \"mean_ms\": %.3f, "
+                     "\"min_ms\": %.3f, \"max_ms\": %.3f}",
+                     i ? "," : "", t.name, t.runs, t.mean_ms, t.min_ms, t.max_ms);
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+    std::fclose(out);
+}
+
+template <typename F>
+Result run(const char* name, size_t iterations, F&& body) {
+    // Warm up, then time the measured iterations
+    for (size_t i = 0; i < iterations / 10 + 1; ++i) {
+        body(i);
+    }
+    size_t allocs_before = g_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        body(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    size_t allocs = g_allocations.load() - allocs_before;
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    return {name, ns / iterations, static_cast<double>(allocs) / iterations};
+}
+
+// A 0x9000 response as the pack sends it: [0x81, 0x04, len, data..., csum]
+size_t make_response(uint8_t* wire, size_t length) {
+    wire[0] = 0x81;
+    wire[1] = 0x04;
+    wire[2] = static_cast<uint8_t>(length);
+    for (size_t i = 0; i < length; ++i) {
+        wire[3 + i] = static_cast<uint8_t>(i * 7);
+    }
+    size_t size = frame_codec::append_checksum(wire, 3 + length);
+    frame_codec::reverse_in_place(wire, size);
+    return size;
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char* argv[]) {
+    using namespace frame_codec;
+    constexpr size_t N = 2000000;
+
+    std::string json_file;
+    bool end_to_end = true;
+    int runs = 3;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) {
+            json_file = argv[++i];
+        } else if (arg == "--no-e2e") {
+            end_to_end = false;
+        } else if (arg == "--runs" && i + 1 < argc) {
+            runs = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "Usage: m18_bench [--json FILE] [--no-e2e] [--runs N]\n");
+            return 1;
+        }
+    }
+
+    uint8_t buffer[MAX_FRAME];
+    for (size_t i = 0; i < sizeof(buffer); ++i) {
+        buffer[i] = static_cast<uint8_t>(i);
+    }
+
+    uint8_t response_wire[MAX_FRAME];
+    const size_t response_size = make_response(response_wire, 0x3A);
+    RegisterImage image;
+    const RegisterImage full_image = BatteryEmulator::default_image();
+    DecodedRegisters values{};
+    decode_registers(full_image, values);
+    RecordWriter records("/dev/null", RecordFormat::Ndjson);
+    DischargeHistogram pack_discharge;
+    DischargeHistogram fleet_discharge;
+
+    std::vector<Result> results = {
+        run("reverse_bits (loop, 1 byte)", N, [&](size_t i) {
+            g_sink += reverse_bits_slow(static_cast<uint8_t>(i));
+        }),
+        run("reverse_bits (table, 1 byte)", N, [&](size_t i) {
+            g_sink += reverse_bits(static_cast<uint8_t>(i));
+        }),
+        run("checksum (63 bytes)", N, [&](size_t) {
+            g_sink += checksum(buffer, 63);
+        }),
+        run("encode read command", N, [&](size_t i) {
+            const uint8_t command[] = {0x01, 0x04, 0x03, 0x90, static_cast<uint8_t>(i), 0x3A};
+            uint8_t wire[MAX_FRAME];
+            g_sink += static_cast<uint32_t>(encode(command, sizeof(command), wire)) + wire[7];
+        }),
+        run("precomputed keepalive frame", N, [&](size_t i) {
+            static constexpr auto frames = make_short_frames(0x62);
+            g_sink += frames[i % frames.size()][3];
+        }),
+        run("decode 0x3A response", N, [&](size_t) {
+            uint8_t frame[MAX_FRAME];
+            for (size_t j = 0; j < response_size; ++j) {
+                frame[j] = response_wire[j];
+            }
+            reverse_in_place(frame, response_size);
+            g_sink += checksum_ok(frame, response_size);
+        }),
+        run("transaction (encode, decode, store)", N / 4, [&](size_t) {
+            const uint8_t command[] = {0x01, 0x04, 0x03, 0x90, 0x00, 0x3A};
+            uint8_t wire[MAX_FRAME];
+            g_sink += static_cast<uint32_t>(encode(command, sizeof(command), wire));
+            uint8_t frame[MAX_FRAME];
+            for (size_t j = 0; j < response_size; ++j) {
+                frame[j] = response_wire[j];
+            }
+            reverse_in_place(frame, response_size);
+            if (checksum_ok(frame, response_size)) {
+                image.store(0x9000, frame + 3, 0x3A);
+            }
+            g_sink += image.contains(0x9000, 0x3A);
+        }),
+        run("decode full DATA_ID image (184 rows)", N / 100, [&](size_t) {
+            for (const auto& row : DATA_ID) {
+                const uint8_t* data = full_image.data(row.addr, row.length);
+                g_sink += dispatch_reg_type(row.type, [&](auto type) {
+                    return fold(RegDecoder<decltype(type)::value>::decode(data, row.length));
+                });
+            }
+        }),
+        run("decode_registers (typed values)", N / 100, [&](size_t) {
+            decode_registers(full_image, values);
+            g_sink += static_cast<uint32_t>(values[12].index() + std::get<CellArray>(values[12])[0]);
+        }),
+        run("format_date (civil_from_days)", N, [&](size_t i) {
+            char text[DATE_CHARS];
+            g_sink += static_cast<uint32_t>(format_date(text, 1696118400 + static_cast<int64_t>(i) * 7919) - text);
+        }),
+        run("NDJSON record (184 rows, one write)", N / 100, [&](size_t i) {
+            records.write(1696118400 + static_cast<int64_t>(i), "/dev/ttyUSB0", values);
+        }),
+        run("discharge histogram (decode, merge)", N / 10, [&](size_t) {
+            decode_histogram(full_image, DISCHARGE_CURRENT, pack_discharge);
+            fleet_discharge += pack_discharge;
+            g_sink += static_cast<uint32_t>(fleet_discharge.percentile(0.9));
+        }),
+    };
+
+    bool allocated = false;
+    std::printf("%-38s %12s %12s\n", "benchmark", "ns/op", "allocs/op");
+    for (const auto& r : results) {
+        std::printf("%-38s %12.2f %12.3f\n", r.name, r.ns_per_op, r.allocs_per_op);
+        allocated = allocated || r.allocs_per_op > 0;
+    }
+
+    std::vector<Timing> timings;
+    if (end_to_end) {
+        timings = run_end_to_end(runs);
+        std::printf("\n%-38s %12s %12s %12s\n", "end to end (pty emulator)", "mean ms", "min ms", "max ms");
+        for (const auto& t : timings) {
+            std::printf("%-38s %12.1f %12.1f %12.1f\n", t.name, t.mean_ms, t.min_ms, t.max_ms);
+        }
+    }
+
+    if (!json_file.empty()) {
+        write_json(json_file, results, timings);
+    }
+
+    if (allocated) {
+        std::fprintf(stderr, "FAIL: codec path allocated memory\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#ifndef BATTERY_EMULATOR_HPP
+#define BATTERY_EMULATOR_HPP
+
+#include "register_image.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Faults applied to the emulator's replies. Rates are probabilities in [0, 1].
+struct EmulatorFaults {
+    using usec = std::chrono::microseconds;
+
+    usec reply_delay{0};       // Before the first byte of every reply
+    usec byte_delay{0};        // Between reply bytes (~2080us is 4800 baud 8N2)
+    double drop_rate = 0;      // Each reply byte is silently dropped
+    double corrupt_rate = 0;   // Each reply gets a bad checksum
+    double stall_rate = 0;     // Each reply is held back for stall
+    usec stall{2000000};
+    uint32_t seed = 1;         // Fault sequences are reproducible per seed
+};
+
+struct EmulatorStats {
+    size_t syncs = 0;
+    size_t frames = 0;         // Well-formed frames received
+    size_t reads = 0;
+    size_t errors = 0;         // 0x82 replies
+    size_t bad_frames = 0;     // Bad checksum or abandoned partial frame
+    size_t dropped_bytes = 0;
+    size_t corrupted = 0;
+    size_t stalls = 0;
+};
+
+// Battery side of the protocol on a pseudo-terminal. M18 and SerialPort
+// connect to port() exactly as they would to a USB adapter.
+//
+// Error replies are 0x82 followed by a code: 0x01 unreadable register,
+// 0x02 bad checksum, 0x03 unknown command.
+class BatteryEmulator {
+public:
+    explicit BatteryEmulator(const RegisterImage& image = default_image(), const EmulatorFaults& faults = {});
+    ~BatteryEmulator();
+
+    BatteryEmulator(const BatteryEmulator&) = delete;
+    BatteryEmulator& operator=(const BatteryEmulator&) = delete;
+
+    // Path of the pty slave to connect to
+    const std::string& port() const { return port_; }
+
+    // Serve until stop is set (checked at least every 50ms)
+    void run(const std::atomic<bool>& stop);
+
+    // run() on a background thread
+    void start();
+    void stop();
+
+    // Only consistent while the emulator is stopped
+    const EmulatorStats& stats() const { return stats_; }
+
+    // Every region readable, DATA_ID rows filled with plausible values
+    // for a 5Ah XC pack
+    static RegisterImage default_image();
+
+    // Image files have one "0xADDR: XX XX ..." line per DATA_MATRIX entry.
+    // Bytes not listed in a loaded file read as zero.
+    static bool load_image(const std::string& path, RegisterImage& image);
+    static bool save_image(const std::string& path, const RegisterImage& image);
+
+private:
+    static constexpr auto FRAME_TIMEOUT = std::chrono::milliseconds(100);
+
+    RegisterImage image_;
+    EmulatorFaults faults_;
+    EmulatorStats stats_;
+    std::mt19937 rng_;
+    int master_fd_;
+    int slave_fd_;  // Held open so the master never sees a hangup
+    std::string port_;
+
+    std::vector<uint8_t> frame_;  // Bit-reversed back to plain bytes
+    std::chrono::steady_clock::time_point last_byte_;
+
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+    const std::atomic<bool>* stop_flag_ = nullptr;  // Set while run() is active
+
+    void on_byte(uint8_t byte);
+    void handle_frame();
+    void reply(std::vector<uint8_t> frame);
+    void reply_error(uint8_t code);
+    bool chance(double rate);
+    void sleep_for(std::chrono::microseconds duration);
+};
+
+#endif // BATTERY_EMULATOR_HPP
@@ -0,0 +1,212 @@
+#ifndef COLUMN_STORE_HPP
+#define COLUMN_STORE_HPP
+
+#include "snapshot_store.hpp"
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Value types of exported columns. Dict columns hold uint32 codes into a
+// per-column dictionary of strings.
+enum class ColumnType : uint8_t { U8, U16, U32, I32, I64, F32, Dict };
+
+const char* column_type_name(ColumnType type);
+bool parse_column_type(const std::string& name, ColumnType& type);
+size_t column_width(ColumnType type);
+
+// Call f(T{}) with the C++ type a column's packed values have
+template <typename F>
+decltype(auto) dispatch_column_type(ColumnType type, F&& f) {
+    switch (type) {
+        case ColumnType::U8: return f(uint8_t{});
+        case ColumnType::U16: return f(uint16_t{});
+        case ColumnType::I32: return f(int32_t{});
+        case ColumnType::I64: return f(int64_t{});
+        case ColumnType::F32: return f(float{});
+        case ColumnType::U32:
+        case ColumnType::Dict: break;
+    }
+    return f(uint32_t{});
+}
+
+// Unsigned columns hold raw register values, which can take every value of
+// the type (a saturated 0xFFFF counter, an erased 0xFF register), so their
+// nulls are kept in a validity bitmap (NAME.valid) instead of in-band
+constexpr bool has_validity_bitmap(ColumnType type) {
+    return type == ColumnType::U8 || type == ColumnType::U16 || type == ColumnType::U32;
+}
+
+// Filler written for a null value (see ColumnValue). It only means null in
+// columns without a validity bitmap.
+template <typename T>
+constexpr T column_null() {
+    if constexpr (std::is_floating_point_v<T>) {
+        return std::numeric_limits<T>::quiet_NaN();
+    } else if constexpr (std::is_signed_v<T>) {
+        return std::numeric_limits<T>::min();
+    } else {
+        return std::numeric_limits<T>::max();
+    }
+}
+
+template <typename T>
+constexpr bool is_column_null(T value) {
+    if constexpr (std::is_floating_point_v<T>) {
+        return value != value;
+    } else {
+        return value == column_null<T>();
+    }
+}
+
+// Bit row of a validity bitmap: bit row % 8 of byte row / 8, set for a value
+inline bool validity_bit(const uint8_t* bits, size_t row) {
+    return (bits[row >> 3] >> (row & 7)) & 1;
+}
+
+// Whether row holds a value, by the column's bitmap (ColumnTable::validity)
+// if it has one and otherwise by its null filler
+template <typename T>
+bool column_valid(const T* values, const uint8_t* validity, size_t row) {
+    return validity != nullptr ? validity_bit(validity, row) : !is_column_null(values[row]);
+}
+
+struct ColumnSpec {
+    std::string name;
+    ColumnType type;
+    std::string label;  // DATA_ID label or a short description
+};
+
+// One field of a row. Missing values are written as the column's null
+// filler: all ones for unsigned and dict columns, INT32_MIN/INT64_MIN for
+// signed ones and NaN for F32. Unsigned columns also clear the row's bit in
+// their validity bitmap, which is what marks them null.
+struct ColumnValue {
+    bool valid = false;
+    int64_t integer = 0;  // U8 ... I64
+    float real = 0;       // F32
+    std::string text;     // Dict
+};
+
+using ColumnRow = std::vector<ColumnValue>;
+
+// Columns of a snapshot export, in file order:
+//   timestamp, site                 snapshot metadata
+//   idN (idN.type, idN.serial,      every DATA_ID row with a length, split
+//        idN.cell1 ... idN.cell5)   where the row holds several values
+//   type, serial, model, ...        derived BatteryHealth fields
+const std::vector<ColumnSpec>& snapshot_columns();
+
+// Decode a snapshot into row (sized to snapshot_columns())
+void snapshot_row(const Snapshot& snapshot, ColumnRow& row);
+
+// Receives rows of a fixed set of columns
+class ColumnSink {
+public:
+    virtual ~ColumnSink() = default;
+    virtual void write(const ColumnRow& row) = 0;
+    // Flush everything; false (with a message on std::cerr) on I/O errors
+    virtual bool finish() = 0;
+};
+
+// Writes a directory holding one file of packed little-endian values per
+// column (NAME.col), a validity bitmap per unsigned column (NAME.valid), a
+// dictionary per Dict column (NAME.dict, one escaped string per line) and
+// schema.txt:
+//
+//   # M18 columnar export
+//   version = 1
+//   rows = N
+//   column = NAME TYPE LABEL
+//
+// Column files carry no header, so a mapped file is a plain array.
+// schema.txt is written last (tmp + rename), so a directory without one is
+// an unfinished export.
+class ColumnFileWriter : public ColumnSink {
+public:
+    // Throws std::runtime_error if the directory or a file cannot be created
+    ColumnFileWriter(const std::string& directory, std::vector<ColumnSpec> columns);
+    ~ColumnFileWriter() override;
+
+    void write(const ColumnRow& row) override;
+    bool finish() override;
+    size_t rows() const { return rows_; }
+
+private:
+    struct Column;
+
+    std::string directory_;
+    std::vector<ColumnSpec> specs_;
+    std::vector<std::unique_ptr<Column>> columns_;
+    size_t rows_ = 0;
+    bool finished_ = false;
+};
+
+// Streams the same rows as CSV, with the column names as its header
+class CsvColumnWriter : public ColumnSink {
+public:
+    CsvColumnWriter(std::ostream& out, std::vector<ColumnSpec> columns);
+
+    void write(const ColumnRow& row) override;
+    bool finish() override;
+
+private:
+    std::ostream& out_;
+    std::vector<ColumnSpec> specs_;
+};
+
+// Decode every snapshot of the store once (file order) and write the row
+// to each sink; returns the row count. Does not call finish().
+size_t export_snapshots(const SnapshotStore& store, const std::vector<ColumnSink*>& sinks);
+
+// Read-only view of an export directory. Columns are mapped on first use,
+// so a scan touches only the files of the columns it asks for. Map every
+// column a scan needs before sharing the table between threads.
+class ColumnTable {
+public:
+    // Throws std::runtime_error if schema.txt is missing or invalid
+    explicit ColumnTable(const std::string& directory);
+    ~ColumnTable();
+
+    ColumnTable(const ColumnTable&) = delete;
+    ColumnTable& operator=(const ColumnTable&) = delete;
+
+    size_t rows() const { return rows_; }
+    const std::vector<ColumnSpec>& columns() const { return specs_; }
+    const ColumnSpec* find(const std::string& name) const;
+
+    // Packed values of a column; throws if it is absent or too short
+    const void* map(const std::string& name);
+    template <typename T>
+    const T* values(const std::string& name) {
+        return static_cast<const T*>(map(name));
+    }
+
+    // Validity bitmap of a column (see validity_bit), or nullptr if its
+    // nulls are in-band: signed, F32 and Dict columns
+    const uint8_t* validity(const std::string& name);
+
+    // Strings of a Dict column, indexed by code
+    const std::vector<std::string>& dictionary(const std::string& name);
+
+private:
+    struct Mapping {
+        void* data = nullptr;
+        size_t size = 0;
+    };
+
+    std::string directory_;
+    size_t rows_ = 0;
+    std::vector<ColumnSpec> specs_;
+    std::unordered_map<std::string, Mapping> maps_;  // By file name
+    std::unordered_map<std::string, std::vector<std::string>> dictionaries_;
+
+    // Map the first size bytes of a file of the export
+    const void* map_file(const std::string& file, size_t size);
+};
+
+#endif // COLUMN_STORE_HPP
@@ -1,18 +1,332 @@
 #ifndef DATA_TABLES_HPP
 #define DATA_TABLES_HPP
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
-#include <vector>
-#include <string>
-#include <map>
 
-// Data matrix for reading raw registers
-extern const std::vector<std::vector<uint16_t>> DATA_MATRIX;
+// Register value encodings
+enum class RegType : uint8_t {
+    Uint,    // unsigned big-endian integer
+    Date,    // UNIX time (seconds from 1 Jan 1970)
+    Ascii,   // ascii string
+    Sn,      // serial number (2 bytes battery type, 3 bytes serial)
+    AdcT,    // analog-to-digital converter temperature (mV of thermistor)
+    DecT,    // decimal temperature (byte_1 + byte_2/256)
+    CellV,   // cell voltages (5 x 2 bytes, mV)
+    Hhmmss   // duration in seconds
+};
 
-// Battery lookup table (type -> capacity, model name)
-extern const std::map<std::string, std::pair<float, std::string>> BATTERY_LOOKUP;
+// Name used by the Python implementation ("uint", "date", ...)
+constexpr const char* reg_type_name(RegType type) {
+    switch (type) {
+        case RegType::Uint: return "uint";
+        case RegType::Date: return "date";
+        case RegType::Ascii: return "ascii";
+        case RegType::Sn: return "sn";
+        case RegType::AdcT: return "adc_t";
+        case RegType::DecT: return "dec_t";
+        case RegType::CellV: return "cell_v";
+        case RegType::Hhmmss: return "hhmmss";
+    }
+    return "?";
+}
 
-// Data ID table with register information
-extern const std::vector<std::vector<std::string>> DATA_ID;
+struct DataMatrixEntry {
+    uint8_t addr_h;
+    uint8_t addr_l;
+    uint16_t length;
+
+    constexpr uint16_t addr() const { return static_cast<uint16_t>((addr_h << 8) | addr_l); }
+};
+
+struct DataIdEntry {
+    uint16_t addr;
+    uint16_t length;
+    RegType type;
+    const char* label;
+};
+
+struct BatteryModel {
+    uint16_t type;     // Battery type from register 0x0004
+    float capacity;    // Ah
+    const char* name;
+};
+
+// Contiguous register region the pack answers ranged reads in, with the
+// longest single read known to succeed there (from DATA_MATRIX)
+struct RegisterRegion {
+    uint16_t start;
+    uint16_t end;  // exclusive
+    uint16_t max_read;
+    bool refreshed;  // Updated by the pack after a force_refresh sweep
+};
+
+// Data matrix for reading raw registers (converted from Python data_matrix)
+inline constexpr std::array<DataMatrixEntry, 32> DATA_MATRIX = {{
+    {0x00, 0x00, 0x02}, {0x00, 0x02, 0x02}, {0x00, 0x04, 0x05}, {0x00, 0x0D, 0x04},
+    {0x00, 0x11, 0x04}, {0x00, 0x15, 0x04}, {0x00, 0x19, 0x04}, {0x00, 0x23, 0x14},
+    {0x00, 0x37, 0x04}, {0x00, 0x69, 0x02}, {0x00, 0x7B, 0x01}, {0x40, 0x00, 0x04},
+    {0x40, 0x0A, 0x0A}, {0x40, 0x14, 0x02}, {0x40, 0x16, 0x02}, {0x40, 0x19, 0x02},
+    {0x40, 0x1B, 0x02}, {0x40, 0x1D, 0x02}, {0x40, 0x1F, 0x02}, {0x60, 0x00, 0x02},
+    {0x60, 0x02, 0x02}, {0x60, 0x04, 0x04}, {0x60, 0x08, 0x04}, {0x60, 0x0C, 0x02},
+    {0x90, 0x00, 0x3A}, {0x90, 0x3A, 0x3A}, {0x90, 0x74, 0x3A}, {0x90, 0xAE, 0x3A},
+    {0x90, 0xE8, 0x3A}, {0x91, 0x22, 0x30}, {0x91, 0x52, 0x00}, {0xA0, 0x00, 0x06}
+}};
+
+// Battery type lookup table, sorted by type for find_battery()
+inline constexpr std::array<BatteryModel, 17> BATTERY_LOOKUP = {{
+    { 36,  1.5f, "1.5Ah CP (5s1p 18650)"},
+    { 37,  2.0f, "2Ah CP (5s1p 18650)"},
+    { 38,  3.0f, "3Ah XC (5s2p 18650)"},
+    { 39,  4.0f, "4Ah XC (5s2p 18650)"},
+    { 40,  5.0f, "5Ah XC (5s2p 18650) (<= Dec 2018)"},
+    { 46,  6.0f, "6Ah XC (5s2p 18650)"},
+    { 47,  9.0f, "9Ah HD (5s3p 18650)"},
+    {104,  3.0f, "3Ah HO (5s1p 21700)"},
+    {106,  6.0f, "6Ah HO (5s2p 21700)"},
+    {107,  8.0f, "8Ah HO (5s2p 21700)"},
+    {108, 12.0f, "12Ah HO (5s3p 21700)"},
+    {150,  5.5f, "5.5Ah HO (5s2p 21700) (EU only)"},
+    {165,  5.0f, "5Ah XC (5s2p 18650) (Aug 2019 - Jun 2021)"},
+    {306,  5.0f, "5Ah XC (5s2p 18650) (Feb 2021 - Jul 2023)"},
+    {383,  8.0f, "8Ah Forge (5s2p 21700 tabless)"},
+    {384, 12.0f, "12Ah Forge (5s3p 21700 tabless)"},
+    {424,  5.0f, "5Ah XC (5s2p 18650) (>= Sep 2023)"}
+}};
+
+// Data ID table (address, length, type, label), in address order
+inline constexpr std::array<DataIdEntry, 184> DATA_ID = {{
+    {0x0000,  2, RegType::Uint,   "Cell type"},
+    {0x0002,  2, RegType::Uint,   "Unknown (always 0)"},
+    {0x0004,  5, RegType::Sn,     "Capacity & Serial number (?)"},
+    {0x000D,  4, RegType::Uint,   "Unknown (4th code?)"},
+    {0x0011,  4, RegType::Date,   "Manufacture date"},
+    {0x0015,  4, RegType::Date,   "Date of first charge (Forge)"},
+    {0x0019,  4, RegType::Date,   "Date of last charge (Forge)"},
+    {0x0023, 20, RegType::Ascii,  "Note (ascii string)"},
+    {0x0037,  4, RegType::Date,   "Current date"},
+    {0x0069,  2, RegType::Uint,   "Unknown (always 2)"},
+    {0x007B,  1, RegType::Uint,   "Unknown (always 0)"},
+    {0x4000,  4, RegType::Uint,   "Unknown (Forge)"},
+    {0x400A, 10, RegType::CellV,  "Cell voltages (mV)"},
+    {0x4014,  2, RegType::AdcT,   "Temperature (C) (non-Forge)"},
+    {0x4016,  2, RegType::Uint,   "Unknown (Forge)"},
+    {0x4019,  2, RegType::Uint,   "Unknown (Forge)"},
+    {0x401B,  2, RegType::Uint,   "Unknown (Forge)"},
+    {0x401D,  2, RegType::Uint,   "Unknown (Forge)"},
+    {0x401F,  2, RegType::DecT,   "Temperature (C) (Forge)"},
+    {0x6000,  2, RegType::Uint,   "Unknown (Forge)"},
+    {0x6002,  2, RegType::Uint,   "Unknown (Forge)"},
+    {0x6004,  4, RegType::Uint,   "Unknown (Forge)"},
+    {0x6008,  4, RegType::Uint,   "Unknown (Forge)"},
+    {0x600C,  2, RegType::Uint,   "Unknown (Forge)"},
+    {0x9000,  4, RegType::Date,   "Date of first charge (rounded)"},
+    {0x9004,  4, RegType::Date,   "Date of last tool use (rounded)"},
+    {0x9008,  4, RegType::Date,   "Date of last charge (rounded)"},
+    {0x900C,  4, RegType::Date,   "Unknown date (often zero)"},
+    {0x9010,  2, RegType::Uint,   "Days since first charge"},
+    {0x9012,  4, RegType::Uint,   "Total discharge (amp-sec)"},
+    {0x9016,  4, RegType::Uint,   "Total discharge (watt-sec or joules)"},
+    {0x901A,  4, RegType::Uint,   "Total charge count"},
+    {0x901E,  2, RegType::Uint,   "Dumb charge count (J2>7.1V for >=0.48s)"},
+    {0x9020,  2, RegType::Uint,   "Redlink (UART) charge count"},
+    {0x9022,  2, RegType::Uint,   "Completed charge count (?)"},
+    {0x9024,  4, RegType::Hhmmss, "Total charging time (HH:MM:SS)"},
+    {0x9028,  4, RegType::Hhmmss, "Time on charger whilst full (HH:MM:SS)"},
+    {0x902C,  2, RegType::Uint,   "Unknown (another low-voltage charge counter?)"},
+    {0x902E,  2, RegType::Uint,   "Charge started with a cell < 2.5V"},
+    {0x9030,  2, RegType::Uint,   "Discharge to empty"},
+    {0x9032,  2, RegType::Uint,   "Num. overheat on tool (must be > 10A)"},
+    {0x9034,  2, RegType::Uint,   "Overcurrent?"},
+    {0x9036,  2, RegType::Uint,   "Low voltage events)"},
+    {0x9038,  2, RegType::Uint,   "Low-voltage bounce? (4 flashing LEDs)"},
+    {0x903A,  2, RegType::Uint,   "Discharge @ 10-20A (seconds)"},
+    {0x903C,  2, RegType::Uint,   "@ 20-30A (could be watts)"},
+    {0x903E,  2, RegType::Uint,   "@ 30-40A"},
+    {0x9040,  2, RegType::Uint,   "@ 40-50A"},
+    {0x9042,  2, RegType::Uint,   "@ 50-60A"},
+    {0x9044,  2, RegType::Uint,   "@ 60-70A"},
+    {0x9046,  2, RegType::Uint,   "@ 70-80A"},
+    {0x9048,  2, RegType::Uint,   "@ 80-90A"},
+    {0x904A,  2, RegType::Uint,   "@ 90-100A"},
+    {0x904C,  2, RegType::Uint,   "@ 100-110A"},
+    {0x904E,  2, RegType::Uint,   "@ 110-120A"},
+    {0x9050,  2, RegType::Uint,   "@ 120-130A"},
+    {0x9052,  2, RegType::Uint,   "@ 130-140A"},
+    {0x9054,  2, RegType::Uint,   "@ 140-150A"},
+    {0x9056,  2, RegType::Uint,   "@ 150-160A"},
+    {0x9058,  2, RegType::Uint,   "@ 160-170A"},
+    {0x905A,  2, RegType::Uint,   "@ 170-180A"},
+    {0x905C,  2, RegType::Uint,   "@ 180-190A"},
+    {0x905E,  2, RegType::Uint,   "@ 190-200A"},
+    {0x9060,  2, RegType::Uint,   "@ 200-210A"},
+    {0x9062,  2, RegType::Uint,   "Discharge @ 5-10A (seconds)"},
+    {0x9064,  2, RegType::Uint,   "@ 10-15A (could be watts)"},
+    {0x9066,  2, RegType::Uint,   "@ 15-20A (histo not well understood yet)"},
+    {0x9068,  2, RegType::Uint,   "@ 20-25A"},
+    {0x906A,  2, RegType::Uint,   "@ 25-30A"},
+    {0x906C,  2, RegType::Uint,   "@ 30-35A"},
+    {0x906E,  2, RegType::Uint,   "@ 35-40A"},
+    {0x9070,  2, RegType::Uint,   "@ 40-45A"},
+    {0x9072,  2, RegType::Uint,   "@ 45-50A"},
+    {0x9074,  2, RegType::Uint,   "@ 50-55A"},
+    {0x9076,  2, RegType::Uint,   "@ 55-60A"},
+    {0x9078,  2, RegType::Uint,   "@ 60-65A"},
+    {0x907A,  2, RegType::Uint,   "@ 65-70A"},
+    {0x907C,  2, RegType::Uint,   "@ 70-65A"},
+    {0x907E,  2, RegType::Uint,   "@ 75-80A"},
+    {0x9080,  2, RegType::Uint,   "@ 80-85A"},
+    {0x9082,  2, RegType::Uint,   "@ 85-90A"},
+    {0x9084,  2, RegType::Uint,   "@ 90-95A"},
+    {0x9086,  2, RegType::Uint,   "@ 95-100A"},
+    {0x9088,  2, RegType::Uint,   "@ 100-105A"},
+    {0x908A,  2, RegType::Uint,   "@ 105-110A"},
+    {0x908C,  2, RegType::Uint,   "@ 110-115A"},
+    {0x908E,  2, RegType::Uint,   "@ 115-120A"},
+    {0x9090,  2, RegType::Uint,   "@ 120-125A"},
+    {0x9092,  2, RegType::Uint,   "@ 125-130A"},
+    {0x9094,  2, RegType::Uint,   "@ 130-135A"},
+    {0x9096,  2, RegType::Uint,   "@ 135-140A"},
+    {0x9098,  2, RegType::Uint,   "@ 140-145A"},
+    {0x909A,  2, RegType::Uint,   "@ 145-150A"},
+    {0x909C,  2, RegType::Uint,   "@ 150-155A"},
+    {0x909E,  2, RegType::Uint,   "@ 155-160A"},
+    {0x90A0,  2, RegType::Uint,   "@ 160-165A"},
+    {0x90A2,  2, RegType::Uint,   "@ 165-170A"},
+    {0x90A4,  2, RegType::Uint,   "@ 170-175A"},
+    {0x90A6,  2, RegType::Uint,   "@ 175-180A"},
+    {0x90A8,  2, RegType::Uint,   "@ 180-185A"},
+    {0x90AA,  2, RegType::Uint,   "@ 185-190A"},
+    {0x90AC,  2, RegType::Uint,   "@ 190-195A"},
+    {0x90AE,  2, RegType::Uint,   "@ 195-200A"},
+    {0x90B0,  2, RegType::Uint,   "@ 200A+"},
+    {0x90B2,  2, RegType::Uint,   "Charge started < 17V"},
+    {0x90B4,  2, RegType::Uint,   "Charge started 17-18V"},
+    {0x90B6,  2, RegType::Uint,   "Charge started 18-19V"},
+    {0x90B8,  2, RegType::Uint,   "Charge started 19-20V"},
+    {0x90BA,  2, RegType::Uint,   "Charge started 20V+"},
+    {0x90BC,  2, RegType::Uint,   "Charge ended < 17V"},
+    {0x90BE,  2, RegType::Uint,   "Charge ended 17-18V"},
+    {0x90C0,  2, RegType::Uint,   "Charge ended 18-19V"},
+    {0x90C2,  2, RegType::Uint,   "Charge ended 19-20V"},
+    {0x90C4,  2, RegType::Uint,   "Charge ended 20V+"},
+    {0x90C6,  2, RegType::Uint,   "Charge start temp -30C to -20C"},
+    {0x90C8,  2, RegType::Uint,   "Charge start temp -20C to -10C"},
+    {0x90CA,  2, RegType::Uint,   "Charge start temp -10C to 0C"},
+    {0x90CC,  2, RegType::Uint,   "Charge start temp 0C to +10C"},
+    {0x90CE,  2, RegType::Uint,   "Charge start temp +10C to +20C"},
+    {0x90D0,  2, RegType::Uint,   "Charge start temp +20C to +30C"},
+    {0x90D2,  2, RegType::Uint,   "Charge start temp +30C to +40C"},
+    {0x90D4,  2, RegType::Uint,   "Charge start temp +40C to +50C"},
+    {0x90D6,  2, RegType::Uint,   "Charge start temp +50C to +60C"},
+    {0x90D8,  2, RegType::Uint,   "Charge start temp +60C to +70C"},
+    {0x90DA,  2, RegType::Uint,   "Charge start temp +70C to +80C"},
+    {0x90DC,  2, RegType::Uint,   "Charge start temp +80C and over"},
+    {0x90DE,  2, RegType::Uint,   "Charge end temp -30C to -20C"},
+    {0x90E0,  2, RegType::Uint,   "Charge end temp -20C to -10C"},
+    {0x90E2,  2, RegType::Uint,   "Charge end temp -10C to 0C"},
+    {0x90E4,  2, RegType::Uint,   "Charge end temp 0C to +10C"},
+    {0x90E6,  2, RegType::Uint,   "Charge end temp +10C to +20C"},
+    {0x90E8,  2, RegType::Uint,   "Charge end temp +30C to +30C"},
+    {0x90EA,  2, RegType::Uint,   "Charge end temp +30C to +40C"},
+    {0x90EC,  2, RegType::Uint,   "Charge end temp +40C to +50C"},
+    {0x90EE,  2, RegType::Uint,   "Charge end temp +50C to +60C"},
+    {0x90F0,  2, RegType::Uint,   "Charge end temp +60C to +70C"},
+    {0x90F2,  2, RegType::Uint,   "Charge end temp +70C to +80C"},
+    {0x90F4,  2, RegType::Uint,   "Charge end temp +80C and over"},
+    {0x90F6,  2, RegType::Uint,   "Dumb charge time (00:00-14:33)"},
+    {0x90F8,  2, RegType::Uint,   "Dumb charge time (14:34-29:07)"},
+    {0x90FA,  2, RegType::Uint,   "Dumb charge time (29:08-43:41)"},
+    {0x90FC,  2, RegType::Uint,   "Dumb charge time (43:42-58:15)"},
+    {0x90FE,  2, RegType::Uint,   "Dumb charge time (58:16-1:12:49)"},
+    {0x9100,  2, RegType::Uint,   "Dumb charge time (1:12:50-1:27:23)"},
+    {0x9102,  2, RegType::Uint,   "Dumb charge time (1:27:24-1:41:57)"},
+    {0x9104,  2, RegType::Uint,   "Dumb charge time (1:41:58-1:56:31)"},
+    {0x9106,  2, RegType::Uint,   "Dumb charge time (1:56:32-2:11:05)"},
+    {0x9108,  2, RegType::Uint,   "Dumb charge time (2:11:06-2:25:39)"},
+    {0x910A,  2, RegType::Uint,   "Dumb charge time (2:25:40-2:40:13)"},
+    {0x910C,  2, RegType::Uint,   "Dumb charge time (2:40:14-2:54:47)"},
+    {0x910E,  2, RegType::Uint,   "Dumb charge time (2:54:48-3:09:21)"},
+    {0x9110,  2, RegType::Uint,   "Dumb charge time (3:09:22-3:23:55)"},
+    {0x9112,  2, RegType::Uint,   "Redlink charge time (00:00-17:03)"},
+    {0x9114,  2, RegType::Uint,   "Redlink charge time (17:04-34:07)"},
+    {0x9116,  2, RegType::Uint,   "Redlink charge time (34:08-51:11)"},
+    {0x9118,  2, RegType::Uint,   "Redlink charge time (51:12-1:08:15)"},
+    {0x911A,  2, RegType::Uint,   "Redlink charge time (1:08:16-1:25:19)"},
+    {0x911C,  2, RegType::Uint,   "Redlink charge time (1:25:20-1:42:23)"},
+    {0x911E,  2, RegType::Uint,   "Redlink charge time (1:42:24-1:59:27)"},
+    {0x9120,  2, RegType::Uint,   "Redlink charge time (1:59:28-2:16:31)"},
+    {0x9122,  2, RegType::Uint,   "Redlink charge time (2:16:32-2:33:35)"},
+    {0x9124,  2, RegType::Uint,   "Redlink charge time (2:33:36-2:50:39)"},
+    {0x9126,  2, RegType::Uint,   "Redlink charge time (2:50:40-3:07:43)"},
+    {0x9128,  2, RegType::Uint,   "Redlink charge time (3:07:44-3:24:47)"},
+    {0x912A,  2, RegType::Uint,   "Redlink charge time (3:24:48-3:41:51)"},
+    {0x912C,  2, RegType::Uint,   "Redlink charge time (3:41:52-3:58:55)"},
+    {0x912E,  2, RegType::Uint,   "Completed charge (?)"},
+    {0x9130,  2, RegType::Uint,   "Unknown"},
+    {0x9132,  2, RegType::Uint,   "Unknown"},
+    {0x9134,  2, RegType::Uint,   "Unknown"},
+    {0x9136,  2, RegType::Uint,   "Unknown"},
+    {0x9138,  2, RegType::Uint,   "Unknown"},
+    {0x913A,  2, RegType::Uint,   "Unknown"},
+    {0x913C,  2, RegType::Uint,   "Unknown"},
+    {0x913E,  2, RegType::Uint,   "Unknown"},
+    {0x9140,  2, RegType::Uint,   "Unknown"},
+    {0x9142,  2, RegType::Uint,   "Unknown histogram (temperature?)"},
+    {0x9144,  2, RegType::Uint,   "Unknown histogram"},
+    {0x9146,  2, RegType::Uint,   "Unknown histogram"},
+    {0x9148,  2, RegType::Uint,   "Unknown histogram"},
+    {0x914A,  2, RegType::Uint,   "Unknown histogram"},
+    {0x914C,  2, RegType::Uint,   "Unknown histogram"},
+    {0x914E,  2, RegType::Uint,   "Unknown histogram"},
+    {0x9150,  2, RegType::Uint,   "Unknown histogram"}
+}};
+
+// Regions of DATA_MATRIX that can be read as one block. Merged reads never
+// exceed the longest read DATA_MATRIX uses in the region. Only the 0x9000
+// statistics block changes after a refresh sweep.
+inline constexpr std::array<RegisterRegion, 5> REGISTER_REGIONS = {{
+    {0x0000, 0x007C, 0x14, false},
+    {0x4000, 0x4021, 0x0A, false},
+    {0x6000, 0x600E, 0x04, false},
+    {0x9000, 0x9152, 0x3A, true},
+    {0xA000, 0xA006, 0x06, false}
+}};
+
+// Battery model for a type code, or nullptr if unknown
+constexpr const BatteryModel* find_battery(uint16_t type) {
+    size_t lo = 0;
+    size_t hi = BATTERY_LOOKUP.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (BATTERY_LOOKUP[mid].type < type) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < BATTERY_LOOKUP.size() && BATTERY_LOOKUP[lo].type == type) ? &BATTERY_LOOKUP[lo] : nullptr;
+}
+
+// Region containing addr, or nullptr
+constexpr const RegisterRegion* find_region(uint16_t addr) {
+    for (const auto& region : REGISTER_REGIONS) {
+        if (addr >= region.start && addr < region.end) {
+            return &region;
+        }
+    }
+    return nullptr;
+}
+
+// DATA_ID row starting at addr, or -1
+constexpr int find_data_id(uint16_t addr) {
+    for (size_t i = 0; i < DATA_ID.size(); ++i) {
+        if (DATA_ID[i].addr == addr) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
 
 #endif // DATA_TABLES_HPP
@@ -0,0 +1,88 @@
+#ifndef FLEET_HPP
+#define FLEET_HPP
+
+#include "m18.hpp"
+#include "record_writer.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Outcome of one battery session in a fleet scan
+struct FleetResult {
+    std::string port;
+    std::string status = "pending";  // "ok", "error" or "timeout"
+    std::string error;
+    double elapsed_seconds = 0;
+    BatteryHealth health;
+};
+
+struct FleetOptions {
+    std::chrono::seconds timeout{120};  // Budget for each port's session
+    TimingProfile timing;               // Applied to every session
+    bool reactor = false;               // One epoll thread instead of a thread per port
+    bool low_latency = true;            // Adapter low-latency settings, as M18::set_low_latency()
+    std::shared_ptr<RegisterCache> cache;  // Shared by every session; nullptr for none
+    bool retest = false;                // Known packs skip the refresh, as M18::set_retest()
+    // Every register of each pack, one record per port
+    std::shared_ptr<RecordWriter> records;
+};
+
+// Every USB serial adapter (ttyUSB*/ttyACM*)
+std::vector<std::string> find_fleet_ports();
+
+// Run an independent M18 session per port, each on its own thread. A port
+// that fails or overruns its budget is reported and never blocks the others:
+// the budget is a deadline inside each session, which then idles and
+// closes its port, so every thread has finished when this returns.
+std::vector<FleetResult> run_fleet(const std::vector<std::string>& ports, const FleetOptions& options);
+
+// Same scan driven by a single-threaded SessionReactor. Health is decoded
+// from each session's register image with decode_health().
+std::vector<FleetResult> run_fleet_reactor(const std::vector<std::string>& ports, const FleetOptions& options);
+
+// Shards of one register scan, shared by the sessions working on it. Each
+// session takes the next unfinished shard, so any number of adapters (of
+// packs of the same model) can cooperate, and state is saved to a
+// checkpoint file so an interrupted scan resumes where it stopped.
+class ScanQueue {
+public:
+    // checkpoint may be empty to keep progress in memory only
+    ScanQueue(std::vector<RegisterScanner> shards, std::string checkpoint);
+
+    // Scan shards with m18 until none are left, *stop is set or the pack
+    // fails; a shard that fails is handed back for another session.
+    // Returns false if the pack failed.
+    bool work(M18& m18, const std::string& name, const std::atomic<bool>* stop = nullptr);
+
+    bool done() const;
+    std::vector<ScanRegion> regions() const;  // Merged over all shards
+    uint64_t probes() const;
+    size_t shards_done() const;
+    size_t shard_count() const { return shards_.size(); }
+    bool save() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<RegisterScanner> shards_;
+    std::vector<bool> taken_;
+    std::string checkpoint_;
+    std::chrono::steady_clock::time_point saved_at_;
+
+    bool save_locked() const;
+};
+
+// Work through queue with one thread and M18 session per port
+void run_sharded_scan(const std::vector<std::string>& ports, ScanQueue& queue, const TimingProfile& timing,
+                      bool low_latency = true, const std::atomic<bool>* stop = nullptr);
+
+// Aggregated results as one JSON document
+void write_fleet_json(std::ostream& out, const std::vector<FleetResult>& results);
+
+// Quote and escape a string for JSON output
+std::string json_string(const std::string& value);
+
+#endif // FLEET_HPP
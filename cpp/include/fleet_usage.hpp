@@ -0,0 +1,62 @@
+#ifndef FLEET_USAGE_HPP
+#define FLEET_USAGE_HPP
+
+#include "column_store.hpp"
+#include "query_engine.hpp"
+#include "usage_histogram.hpp"
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Usage histograms of one pack, or merged over a group of packs. Each
+// histogram only counts packs whose export holds all of its counters.
+struct PackUsage {
+    size_t packs = 0;               // Packs with the 10 A discharge histogram
+    size_t high_current_packs = 0;  // ... and any time at UsageOptions::high_current or above
+    size_t saturated_packs = 0;     // Packs with a counter stuck at 0xFFFF, so their totals are lower bounds
+    DischargeHistogram discharge;
+    FineDischargeHistogram discharge_fine;
+    ChargeVoltageHistogram charge_start;
+    ChargeVoltageHistogram charge_end;
+
+    PackUsage& operator+=(const PackUsage& other);
+};
+
+struct UsageOptions {
+    std::vector<std::string> group_by = {"model"};  // Empty for one fleet-wide group
+    std::vector<Predicate> where;
+    std::vector<double> percentiles = {0.5, 0.9, 0.99};
+    int high_current = 100;   // A; a DISCHARGE_CURRENT bucket edge
+    bool latest_only = true;  // The counters are lifetime totals, so count each pack once
+    size_t threads = 0;       // 0: one per core
+};
+
+struct UsageGroup {
+    std::vector<std::string> key;  // Values of the group_by columns
+    PackUsage usage;
+};
+
+struct UsageResult {
+    std::vector<UsageGroup> groups;  // Largest share of discharge time at high current first
+    size_t rows = 0;                 // Snapshots aggregated
+    size_t threads = 0;
+    double elapsed_ms = 0;
+};
+
+// Merge the usage histograms of an export by group. Rows are chosen with
+// run_query(), given group ids in one pass, then split between threads
+// that each merge into their own PackUsage per group; the partial results
+// are added up at the end. Throws std::invalid_argument for unknown or
+// floating point group columns and for a high_current off a bucket edge.
+UsageResult aggregate_usage(ColumnTable& table, const UsageOptions& options);
+
+// One line per group: packs, discharge hours, current percentiles (time
+// weighted, as DISCHARGE_CURRENT ranges), the share of time and of packs
+// at high current and the packs with saturated counters
+void print_usage_summary(std::ostream& out, const UsageOptions& options, const UsageResult& result);
+
+// Every bucket of a group's merged histograms
+void print_usage_histograms(std::ostream& out, const UsageGroup& group);
+
+#endif // FLEET_USAGE_HPP
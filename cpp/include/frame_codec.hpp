@@ -0,0 +1,109 @@
+#ifndef FRAME_CODEC_HPP
+#define FRAME_CODEC_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Frames are sent LSB first: every byte on the wire is the bit-reversed
+// protocol byte. A frame is [cmd, acc, len, payload[len], csum_h, csum_l]
+// where the checksum is the 16-bit sum of all preceding bytes. Responses use
+// the same layout with a status byte (0x81 data, 0x82 error) in front.
+namespace frame_codec {
+
+constexpr size_t HEADER_SIZE = 3;
+constexpr size_t CHECKSUM_SIZE = 2;
+constexpr size_t MAX_PAYLOAD = 0xFF;
+constexpr size_t MAX_FRAME = HEADER_SIZE + MAX_PAYLOAD + CHECKSUM_SIZE;
+
+constexpr uint8_t reverse_bits_slow(uint8_t byte) {
+    uint8_t result = 0;
+    for (int i = 0; i < 8; ++i) {
+        result = static_cast<uint8_t>((result << 1) | (byte & 1));
+        byte >>= 1;
+    }
+    return result;
+}
+
+inline constexpr std::array<uint8_t, 256> BIT_REVERSE = [] {
+    std::array<uint8_t, 256> table{};
+    for (size_t i = 0; i < table.size(); ++i) {
+        table[i] = reverse_bits_slow(static_cast<uint8_t>(i));
+    }
+    return table;
+}();
+
+constexpr uint8_t reverse_bits(uint8_t byte) {
+    return BIT_REVERSE[byte];
+}
+
+constexpr void reverse_in_place(uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        data[i] = BIT_REVERSE[data[i]];
+    }
+}
+
+constexpr uint16_t checksum(const uint8_t* data, size_t length) {
+    uint16_t sum = 0;
+    for (size_t i = 0; i < length; ++i) {
+        sum = static_cast<uint16_t>(sum + data[i]);
+    }
+    return sum;
+}
+
+// Append the checksum of buf[0..length) in place; returns the new length.
+// buf must have room for CHECKSUM_SIZE more bytes.
+constexpr size_t append_checksum(uint8_t* buf, size_t length) {
+    uint16_t sum = checksum(buf, length);
+    buf[length] = static_cast<uint8_t>((sum >> 8) & 0xFF);
+    buf[length + 1] = static_cast<uint8_t>(sum & 0xFF);
+    return length + CHECKSUM_SIZE;
+}
+
+// Copy an LSB-first command into out, append its checksum and bit-reverse
+// it for the wire. Returns the number of bytes to send.
+constexpr size_t encode(const uint8_t* command, size_t length, uint8_t* out) {
+    for (size_t i = 0; i < length; ++i) {
+        out[i] = command[i];
+    }
+    size_t size = append_checksum(out, length);
+    reverse_in_place(out, size);
+    return size;
+}
+
+// True if a decoded (LSB-first) frame ends in a valid checksum
+constexpr bool checksum_ok(const uint8_t* frame, size_t size) {
+    if (size < CHECKSUM_SIZE + 1) {
+        return false;
+    }
+    uint16_t sum = checksum(frame, size - CHECKSUM_SIZE);
+    return frame[size - 2] == ((sum >> 8) & 0xFF) && frame[size - 1] == (sum & 0xFF);
+}
+
+// The acc values a session cycles through, in order
+inline constexpr std::array<uint8_t, 3> ACC_VALUES = {0x04, 0x0C, 0x1C};
+
+constexpr size_t acc_index(uint8_t acc) {
+    for (size_t i = 0; i < ACC_VALUES.size(); ++i) {
+        if (ACC_VALUES[i] == acc) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+// On-wire frame for an argument-less command [cmd, acc, 0]
+using ShortFrame = std::array<uint8_t, HEADER_SIZE + CHECKSUM_SIZE>;
+
+constexpr std::array<ShortFrame, ACC_VALUES.size()> make_short_frames(uint8_t cmd) {
+    std::array<ShortFrame, ACC_VALUES.size()> frames{};
+    for (size_t i = 0; i < ACC_VALUES.size(); ++i) {
+        const uint8_t command[HEADER_SIZE] = {cmd, ACC_VALUES[i], 0};
+        encode(command, HEADER_SIZE, frames[i].data());
+    }
+    return frames;
+}
+
+} // namespace frame_codec
+
+#endif // FRAME_CODEC_HPP
@@ -0,0 +1,63 @@
+#ifndef HEALTH_HPP
+#define HEALTH_HPP
+
+#include "register_image.hpp"
+#include "usage_histogram.hpp"
+#include <array>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Data structures for battery information
+struct CellVoltages {
+    std::vector<uint16_t> voltages;  // 5 cells
+};
+
+struct BatteryHealth {
+    std::string type;
+    std::string model;
+    std::string serial;
+    std::string manufacture_date;
+    int days_since_first_charge = 0;
+    int days_since_last_use = 0;
+    int days_since_last_charge = 0;
+    float pack_voltage = 0;
+    CellVoltages cell_voltages;
+    float cell_imbalance = 0;
+    float temperature = 0;        // Thermistor ADC (0x4014), 0 if absent
+    float forge_temperature = 0;  // Forge packs (0x401F), 0 if absent
+    int charge_count_redlink = 0;
+    int charge_count_dumb = 0;
+    int charge_count_total = 0;
+    std::string total_charge_time;
+    std::string idle_on_charger_time;
+    int low_voltage_charges = 0;
+    float total_discharge_ah = 0;
+    float discharge_cycles = 0;
+    int discharge_to_empty = 0;
+    int overheat_events = 0;
+    int overcurrent_events = 0;
+    int low_voltage_events = 0;
+    int low_voltage_bounce = 0;
+    std::string total_time_on_tool;  // Sum of the buckets (>10A)
+    std::optional<DischargeHistogram> current_buckets;  // Seconds per DISCHARGE_CURRENT range
+};
+
+// DATA_ID rows a health report is decoded from (the same list as m18.py)
+inline constexpr std::array<int, 41> HEALTH_IDS = {
+    4, 28, 25, 26, 12, 13, 18, 29, 39, 40, 41, 42, 43, 33, 32, 31, 35, 36, 38,
+    44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63,
+    8, 2
+};
+
+// Build a health report from a register image alone, so stored images can
+// be reprocessed without a battery. Fields whose registers are missing
+// from the image keep their defaults; an image without the 0x0004
+// type/serial register leaves type, model and serial empty.
+BatteryHealth decode_health(const RegisterImage& image);
+
+// Labelled report in the layout of m18.py's health()
+void print_health(std::ostream& out, const BatteryHealth& health);
+
+#endif // HEALTH_HPP
@@ -0,0 +1,104 @@
+#ifndef LINK_METRICS_HPP
+#define LINK_METRICS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Transactions M18 keeps separate statistics for
+enum class LinkCommand : uint8_t {
+    Cmd,        // register reads and raw commands
+    Configure,
+    Snapchat,
+    Keepalive,
+    Calibrate,
+    Reset,      // break + sync byte
+    Resync,     // sync byte only, after a failed transaction
+    Count
+};
+
+constexpr const char* link_command_name(LinkCommand command) {
+    switch (command) {
+        case LinkCommand::Cmd: return "cmd";
+        case LinkCommand::Configure: return "configure";
+        case LinkCommand::Snapchat: return "snapchat";
+        case LinkCommand::Keepalive: return "keepalive";
+        case LinkCommand::Calibrate: return "calibrate";
+        case LinkCommand::Reset: return "reset";
+        case LinkCommand::Resync: return "resync";
+        case LinkCommand::Count: break;
+    }
+    return "unknown";
+}
+
+// Log-linear latency histogram in microseconds, HDR style: every power of
+// two is split into 8 buckets, so any recorded value is known to within
+// 12.5%. Values from 1us to ~134s fit in a fixed 200-bucket array.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 3;
+    static constexpr uint64_t SUB_BUCKETS = 1u << SUB_BITS;
+    static constexpr uint64_t MAX_VALUE = (1ull << 27) - 1;
+    static constexpr size_t BUCKETS = SUB_BUCKETS + (27 - SUB_BITS) * SUB_BUCKETS;
+
+    void record(uint64_t micros);
+    void merge(const LatencyHistogram& other);
+    void clear();
+
+    uint64_t count() const { return count_; }
+    uint64_t sum() const { return sum_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0; }
+
+    // Upper bound of the bucket holding the p-th fraction (0..1) of values
+    uint64_t percentile(double p) const;
+
+    // Number of values below limit; exact when limit is a power of two
+    uint64_t count_below(uint64_t limit) const;
+
+    static size_t bucket_of(uint64_t micros);
+    static uint64_t bucket_end(size_t index);  // exclusive
+
+private:
+    std::array<uint64_t, BUCKETS> counts_{};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+};
+
+struct CommandMetrics {
+    LatencyHistogram latency;       // last byte sent to last byte received
+    uint64_t requests = 0;
+    uint64_t bytes_tx = 0;
+    uint64_t bytes_rx = 0;
+    uint64_t timeouts = 0;          // no response, or a short one
+    uint64_t error_responses = 0;   // 0x82 replies
+    uint64_t checksum_failures = 0;
+    uint64_t retries = 0;           // transactions sent again after a failure
+};
+
+// Protocol counters for one link, exportable as Prometheus text or JSON
+class LinkMetrics {
+public:
+    CommandMetrics& operator[](LinkCommand command) { return commands_[static_cast<size_t>(command)]; }
+    const CommandMetrics& operator[](LinkCommand command) const { return commands_[static_cast<size_t>(command)]; }
+
+    void merge(const LinkMetrics& other);
+    void clear();
+
+    // Prometheus text exposition format. port becomes a label when set.
+    void write_prometheus(std::ostream& out, const std::string& port = "") const;
+    void write_json(std::ostream& out) const;
+
+    // Write to path, as JSON if it ends in ".json" and Prometheus otherwise
+    bool save(const std::string& path, const std::string& port = "") const;
+
+private:
+    std::array<CommandMetrics, static_cast<size_t>(LinkCommand::Count)> commands_{};
+};
+
+#endif // LINK_METRICS_HPP
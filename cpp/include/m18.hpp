@@ -1,61 +1,43 @@
 #ifndef M18_HPP
 #define M18_HPP
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
 #include <memory>
 #include <chrono>
+#include "data_tables.hpp"
+#include "frame_codec.hpp"
+#include "health.hpp"
+#include "register_values.hpp"
+#include "link_metrics.hpp"
+#include "read_planner.hpp"
+#include "register_cache.hpp"
+#include "register_image.hpp"
+#include "register_scanner.hpp"
+#include "telemetry_stream.hpp"
+#include "timing_profile.hpp"
 
 // Forward declaration for serial port
 class SerialPort;
 
-// Data structures for battery information
-struct DataMatrixEntry {
-    uint8_t addr_h;
-    uint8_t addr_l;
-    uint16_t length;
+// Keepalive timing of a charger simulation
+struct SimulationStats {
+    uint64_t keepalives = 0;
+    uint64_t failed_keepalives = 0;   // No valid response
+    uint64_t missed_deadlines = 0;    // Periods skipped because a keepalive overran
+    LatencyHistogram lateness;        // Wakeup after each deadline, us
+    uint64_t max_period_error_us = 0; // Largest |interval - period| between keepalives
+    double elapsed_seconds = 0;
 };
 
-struct DataIdEntry {
-    uint16_t addr;
-    uint16_t length;
-    std::string type;  // "uint", "date", "ascii", "sn", "adc_t", "dec_t", "cell_v", "hhmmss"
-    std::string label;
-};
-
-struct CellVoltages {
-    std::vector<uint16_t> voltages;  // 5 cells
-};
-
-struct BatteryHealth {
-    std::string type;
-    std::string model;
-    std::string serial;
-    std::string manufacture_date;
-    int days_since_first_charge;
-    int days_since_last_use;
-    int days_since_last_charge;
-    float pack_voltage;
-    CellVoltages cell_voltages;
-    float cell_imbalance;
-    float temperature;
-    int charge_count_redlink;
-    int charge_count_dumb;
-    int charge_count_total;
-    std::string total_charge_time;
-    std::string idle_on_charger_time;
-    int low_voltage_charges;
-    float total_discharge_ah;
-    float discharge_cycles;
-    int discharge_to_empty;
-    int overheat_events;
-    int overcurrent_events;
-    int low_voltage_events;
-    int low_voltage_bounce;
-    std::string total_time_on_tool;
-    std::vector<std::pair<std::string, int>> current_buckets;  // amplitude range and seconds
+// Final reads of a read_registers() session, after any refresh sweep.
+// Rows the sweep failed to read are read again here, so they count once.
+struct ReadCounts {
+    size_t reads = 0;
+    size_t failed = 0;
 };
 
 class M18 {
@@ -80,19 +62,72 @@ public:
 
     // Low-level commands
     bool reset();
+    bool resync();
     std::vector<uint8_t> configure(uint8_t state);
     std::vector<uint8_t> get_snapchat();
     std::vector<uint8_t> keepalive();
     std::vector<uint8_t> calibrate();
+
+    // Link timing (gaps between frames, reset break/recovery)
+    void set_timing_profile(const TimingProfile& profile);
+    const TimingProfile& timing_profile() const;
+    TimingProfile characterize_link(int trials = 5);
+
+    // Adapter low-latency settings, applied on the next connect()
+    void set_low_latency(bool enable) { low_latency_ = enable; }
+
+    // Budget for the session: waits are cut short at deadline and every
+    // command after it throws, so a stuck session ends within one frame
+    void set_deadline(std::chrono::steady_clock::time_point deadline) { deadline_ = deadline; }
+    bool deadline_passed() const { return std::chrono::steady_clock::now() >= deadline_; }
+
+    // Detected adapter chip and settings, plus the round trip of short
+    // reads with the wire time removed
+    void adapter_report(int trials = 10);
+
+    // Registers that never change, cached per serial number, so a session
+    // on a known pack skips the reads that hold only cached registers.
+    // nullptr disables the cache; one cache may be shared between sessions.
+    void set_register_cache(std::shared_ptr<RegisterCache> cache) { cache_ = std::move(cache); }
+
+    // Re-test mode: a pack the cache knows skips the refresh sweep, so a
+    // session reads its serial and then only the registers that change.
+    // Unknown packs are refreshed and read in full, then cached.
+    void set_retest(bool enable) { retest_ = enable; }
+
+    // Per-command latency histograms and protocol counters
+    const LinkMetrics& metrics() const { return metrics_; }
+    void clear_metrics() { metrics_.clear(); }
     
-    // High-level diagnostics
-    BatteryHealth health(bool force_refresh = true);
+    // High-level diagnostics. health() reads only the HEALTH_IDS registers,
+    // in merged ranged reads, and decodes them with decode_health().
+    BatteryHealth health(bool force_refresh = true, ReadCounts* counts = nullptr);
+    // Typed values of the given DATA_ID rows (all if empty), indexed by
+    // DATA_ID position; rows not requested or not read are monostate
+    DecodedRegisters read_values(std::vector<int> ids = {}, bool force_refresh = true);
+    // One session: the registers cached for the pack's serial, a refresh
+    // (skipped for known packs in re-test mode), then the merged reads of
+    // ids the image does not hold yet. Lets a caller decode health and typed
+    // values from the same image.
+    RegisterImage read_registers(const std::vector<int>& ids, bool force_refresh, ReadCounts* counts = nullptr);
     void read_id(std::vector<int> id_array = {}, bool force_refresh = true, const std::string& output = "label");
+    size_t fetch(const std::vector<ReadSpan>& plan, RegisterImage& image);
+    void refresh(RegisterImage& image);
     std::vector<uint8_t> read_all();
+    RegisterImage snapshot();  // Every DATA_ID register after a refresh, as python's read_all
     void read_all_spreadsheet();
 
+    // Poll the live registers (cells 0x400A, temperatures 0x4014/0x401F)
+    // back to back, handing each sample to writer, until duration_seconds
+    // have passed (-1: no limit) or *stop is set. Returns samples taken.
+    uint64_t stream(TelemetryWriter& writer, int duration_seconds = -1, const std::atomic<bool>* stop = nullptr);
+
     // Interactive/test functions
-    void simulate(int duration_seconds = -1);
+    // Fake a charger: configure, then keepalives every period on absolute
+    // deadlines, until duration_seconds pass (-1: no limit) or *stop is set
+    SimulationStats simulate(int duration_seconds = -1,
+                             std::chrono::milliseconds period = std::chrono::milliseconds(500),
+                             const std::atomic<bool>* stop = nullptr);
     void high();
     void idle();
     void high_for(int duration_seconds);
@@ -100,6 +135,11 @@ public:
     // Debugging
     void brute(uint8_t addr_msb, uint8_t addr_lsb, uint16_t length = 0xFF, uint8_t command = 0x01);
     void full_brute(uint16_t start = 0, uint16_t stop = 0xFFFF, uint16_t length = 0xFF);
+
+    // Run scanner in one synced session. When the pack stops answering it
+    // is reset and the scan continues from the last resolved address;
+    // throws after repeated failures at the same address.
+    void scan(RegisterScanner& scanner, const RegisterScanner::Progress& progress = nullptr);
     void debug(uint8_t a, uint8_t b, uint8_t c, uint16_t length);
     void try_cmd(uint8_t cmd, uint8_t msb, uint8_t lsb, uint8_t length, uint16_t ret_len = 0);
     
@@ -112,22 +152,43 @@ public:
     
     // Port selection (public for CLI use)
     std::string select_port();
+    static std::vector<std::string> list_ports(bool usb_only = false);
 
 private:
     std::unique_ptr<SerialPort> port_;
     bool connected_;
     uint8_t acc_;
+    TimingProfile timing_;
+    LinkMetrics metrics_;
+    bool low_latency_ = true;
+    std::shared_ptr<RegisterCache> cache_;
+    bool retest_ = false;
+    LinkCommand command_ = LinkCommand::Cmd;  // Last command sent
+    std::chrono::steady_clock::time_point sent_at_;
+    std::chrono::steady_clock::time_point deadline_ = std::chrono::steady_clock::time_point::max();
     
-    // Private helper methods
+    // Private helper methods. The pointer-based versions work on caller
+    // provided buffers and do not allocate.
     std::vector<uint8_t> cmd(uint8_t a, uint8_t b, uint8_t c, uint16_t length, uint8_t command = 0x01);
+    size_t cmd_into(uint8_t a, uint8_t b, uint8_t c, uint16_t length, uint8_t command, uint8_t* response);
+    size_t short_command(const std::array<frame_codec::ShortFrame, 3>& frames, LinkCommand command,
+                         bool advance_acc, uint8_t* response, size_t size);
     void send(const std::vector<uint8_t>& command);
-    void send_command(std::vector<uint8_t> command);
+    void send_wire(const uint8_t* wire, size_t length, LinkCommand command = LinkCommand::Cmd);
+    void send_command(const uint8_t* command, size_t length, LinkCommand type = LinkCommand::Cmd);
+    void send_command(const std::vector<uint8_t>& command);
     std::vector<uint8_t> read_response(size_t size);
+    size_t receive(uint8_t* response, size_t size);  // response holds max(size, 2) bytes
+    void print_bytes(const char* prefix, const uint8_t* data, size_t length);
     
-    std::vector<uint8_t> add_checksum(std::vector<uint8_t> lsb_command);
     uint16_t checksum(const std::vector<uint8_t>& payload);
     uint8_t reverse_bits(uint8_t byte);
     void update_acc();
+    void pause(TimingProfile::usec duration);
+    bool probe_read(uint16_t addr, uint16_t length);
+    bool read_span(const ReadSpan& span, uint8_t* response, bool* rejected = nullptr);
+    bool restore_cached(RegisterImage& image);
+    void remember_cached(const RegisterImage& image);
     
     // Data parsing helpers
     std::string bytes_to_date_string(const std::vector<uint8_t>& data);
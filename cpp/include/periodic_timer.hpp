@@ -0,0 +1,31 @@
+#ifndef PERIODIC_TIMER_HPP
+#define PERIODIC_TIMER_HPP
+
+#include <chrono>
+#include <cstdint>
+
+// Fixed-rate schedule on absolute CLOCK_MONOTONIC deadlines. The time spent
+// between waits does not shift later deadlines, so the period never drifts.
+class PeriodicTimer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // First deadline is one period from now
+    explicit PeriodicTimer(std::chrono::nanoseconds period);
+
+    // Sleep until the next deadline and return how late the wakeup was.
+    // Deadlines that passed while the caller was busy are skipped (keeping
+    // the original phase) and counted as missed.
+    std::chrono::nanoseconds wait();
+
+    std::chrono::nanoseconds period() const { return period_; }
+    clock::time_point deadline() const { return deadline_; }
+    uint64_t missed() const { return missed_; }
+
+private:
+    std::chrono::nanoseconds period_;
+    clock::time_point deadline_;
+    uint64_t missed_ = 0;
+};
+
+#endif // PERIODIC_TIMER_HPP
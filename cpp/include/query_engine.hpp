@@ -0,0 +1,65 @@
+#ifndef QUERY_ENGINE_HPP
+#define QUERY_ENGINE_HPP
+
+#include "column_store.hpp"
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class CompareOp { Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual };
+
+// COLUMN OP VALUE. VALUE is a number, or for dict columns (site, model,
+// id7) a string compared with == or !=.
+struct Predicate {
+    std::string column;
+    CompareOp op;
+    std::string value;
+};
+
+// Parse "cell_imbalance > 50 and discharge_to_empty > 20". Predicates are
+// joined with "and" (or "&&"); strings may be double quoted. Throws
+// std::invalid_argument on syntax errors.
+std::vector<Predicate> parse_predicates(const std::string& expression);
+
+struct QueryOptions {
+    std::vector<Predicate> where;
+    std::vector<std::string> stats;               // Columns to aggregate
+    std::vector<double> percentiles = {0.5, 0.9, 0.99};
+    bool latest_only = false;  // Only the newest snapshot of each serial
+    size_t threads = 0;        // 0: one per core
+    size_t max_rows = 0;       // Matching row numbers to return
+};
+
+struct ColumnStats {
+    std::string column;
+    size_t count = 0;  // Matching rows where the column is not null
+    double sum = 0;
+    double min = 0;
+    double max = 0;
+    std::vector<double> percentiles;  // Same order as QueryOptions::percentiles
+};
+
+struct QueryResult {
+    size_t scanned = 0;
+    size_t matched = 0;
+    std::vector<ColumnStats> stats;
+    std::vector<size_t> rows;  // First max_rows matches, in row order
+    size_t threads = 0;
+    double elapsed_ms = 0;
+};
+
+// Filter and aggregate an export. Rows are split into fixed-size blocks
+// shared out between threads; each predicate narrows a per-block match
+// mask in one branch-free pass over its column (vectorized by the
+// compiler), and only the columns named in the query are mapped. Null
+// values never match a predicate and are left out of the statistics.
+// Throws std::invalid_argument for unknown columns or bad values.
+QueryResult run_query(ColumnTable& table, const QueryOptions& options);
+
+// Match count, a statistics table and the selected columns of the
+// returned rows
+void print_query_result(std::ostream& out, ColumnTable& table, const QueryOptions& options,
+                        const QueryResult& result, const std::vector<std::string>& select);
+
+#endif // QUERY_ENGINE_HPP
@@ -0,0 +1,126 @@
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+
+#include "read_planner.hpp"
+#include "register_cache.hpp"
+#include "register_image.hpp"
+#include "serial_port.hpp"
+#include "timing_profile.hpp"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One battery session driven as a non-blocking state machine: the same
+// session as M18::read_registers(). With force_refresh it is reset ->
+// configure -> DATA_MATRIX sweep -> idle -> reset -> reads of whatever the
+// sweep left missing (the 0x9000 block the pack has just updated) -> idle,
+// otherwise reset -> configure -> reads -> idle. Protocol gaps are timerfd
+// expirations and responses are collected as the port becomes readable,
+// so a single SessionReactor thread can multiplex many sessions.
+class BatterySession {
+public:
+    enum class State {
+        Start, BreakHold, BreakRecovery, AwaitSync, SyncSettle,
+        AwaitResponse, Gap, RefreshSettle, Done, Failed, TimedOut
+    };
+
+    BatterySession(const std::string& port, std::vector<ReadSpan> plan, const TimingProfile& timing,
+                   bool force_refresh = true, uint8_t configure_state = 0);
+    ~BatterySession();
+
+    // Budget for the session, as M18::set_deadline(); once it passes the
+    // session ends as TimedOut. Set before SessionReactor::add().
+    void set_deadline(std::chrono::steady_clock::time_point deadline) { deadline_ = deadline; }
+    // Adapter low-latency settings, as M18::set_low_latency()
+    void set_low_latency(bool enable) { low_latency_ = enable; }
+    // As M18::set_register_cache() and M18::set_retest(). In re-test mode a
+    // refreshed session first reads the serial, and a known pack skips the
+    // sweep. Every session remembers the pack's registers.
+    void set_register_cache(std::shared_ptr<RegisterCache> cache) { cache_ = std::move(cache); }
+    void set_retest(bool enable) { retest_ = enable; }
+
+    State state() const { return state_; }
+    bool finished() const { return state_ == State::Done || state_ == State::Failed || state_ == State::TimedOut; }
+    const std::string& port() const { return port_name_; }
+    const std::string& error() const { return error_; }
+    const RegisterImage& image() const { return image_; }
+    size_t failed_reads() const { return failed_reads_; }  // Of the final reads
+    size_t read_count() const { return reads_.size(); }
+    double elapsed_seconds() const;
+
+private:
+    friend class SessionReactor;
+
+    static constexpr int MAX_RESETS = 3;
+
+    enum class Phase { Serial, Sweep, Reads };
+
+    std::string port_name_;
+    std::unique_ptr<SerialPort> port_;
+    std::vector<ReadSpan> plan_;
+    TimingProfile timing_;
+    uint8_t configure_state_;
+    int timer_fd_;
+    State state_;
+    std::string error_;
+    RegisterImage image_;
+    Phase phase_;
+    std::vector<ReadSpan> reads_;  // Of the current phase
+    size_t next_span_;
+    size_t failed_reads_;
+    int resets_;
+    bool configured_;
+    bool low_latency_ = true;
+    std::shared_ptr<RegisterCache> cache_;
+    bool retest_ = false;
+    bool cached_ = false;  // Pack was known to cache_
+    std::chrono::steady_clock::time_point deadline_ = std::chrono::steady_clock::time_point::max();
+
+    // Response being collected
+    uint8_t response_[3 + 0xFF + 2];
+    size_t expected_;
+    size_t received_;
+    bool awaiting_configure_;
+
+    std::chrono::steady_clock::time_point started_;
+    std::chrono::steady_clock::time_point finished_;
+
+    void start();
+    void on_readable();
+    void on_timer();
+
+    void begin_reset();
+    void begin_known_or_sweep();
+    void begin_reads();
+    void send_next();
+    void complete_response();
+    void arm_timer(TimingProfile::usec delay);
+    void finish(State state, const std::string& error = "");
+};
+
+// Single-threaded epoll loop over any number of BatterySessions
+class SessionReactor {
+public:
+    SessionReactor();
+    ~SessionReactor();
+
+    // The session must outlive run()
+    void add(BatterySession& session);
+
+    // Run until every session has finished
+    void run();
+
+private:
+    struct Handle {
+        BatterySession* session;
+        bool timer;
+    };
+
+    int epoll_fd_;
+    std::vector<BatterySession*> sessions_;
+    std::vector<std::unique_ptr<Handle>> handles_;
+};
+
+#endif // REACTOR_HPP
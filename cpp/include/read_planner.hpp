@@ -0,0 +1,22 @@
+#ifndef READ_PLANNER_HPP
+#define READ_PLANNER_HPP
+
+#include <cstdint>
+#include <vector>
+
+// One ranged register read: cmd(addr_h, addr_l, length)
+struct ReadSpan {
+    uint16_t addr;
+    uint16_t length;
+};
+
+// Merge the registers of the given DATA_ID indices into the fewest ranged
+// reads. Only contiguous registers inside one REGISTER_REGIONS block are
+// merged, and no read is longer than the region's max_read. Registers
+// outside every region are read on their own.
+std::vector<ReadSpan> plan_reads(const std::vector<int>& ids);
+
+// Plan covering exactly the DATA_MATRIX rows
+std::vector<ReadSpan> data_matrix_reads();
+
+#endif // READ_PLANNER_HPP
@@ -0,0 +1,96 @@
+#ifndef RECORD_WRITER_HPP
+#define RECORD_WRITER_HPP
+
+#include "register_values.hpp"
+#include <charconv>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Proleptic Gregorian date of a day count from 1970-01-01 (H. Hinnant's
+// civil_from_days). Pure arithmetic: no time zone, locale or static buffer.
+struct CivilDate {
+    int64_t year;
+    unsigned month;  // 1-12
+    unsigned day;    // 1-31
+};
+
+constexpr CivilDate civil_from_days(int64_t days) {
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(days - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    const unsigned day = doy - (153 * mp + 2) / 5 + 1;
+    const unsigned month = mp < 10 ? mp + 3 : mp - 9;
+    return {static_cast<int64_t>(yoe) + era * 400 + (month <= 2), month, day};
+}
+
+// Thread-safe replacements for gmtime + strftime and stringstream
+// formatting. Both write into out and return the end of the text.
+constexpr size_t DATE_CHARS = 19;    // "YYYY-MM-DD HH:MM:SS"
+constexpr size_t HHMMSS_CHARS = 16;  // "1193046:28:15" for UINT32_MAX, with room
+char* format_date(char* out, int64_t epoch_seconds, bool with_time = true);
+char* format_hhmmss(char* out, uint32_t seconds);
+std::string date_string(int64_t epoch_seconds, bool with_time = true);
+std::string hhmmss_string(uint32_t seconds);
+
+// Growable text buffer that is reused between records. Numbers are
+// formatted with std::to_chars.
+class RecordBuffer {
+public:
+    void clear() { data_.clear(); }
+    const char* data() const { return data_.data(); }
+    size_t size() const { return data_.size(); }
+
+    void put(char c) { data_.push_back(c); }
+    void put(std::string_view text) { data_.insert(data_.end(), text.begin(), text.end()); }
+    template <typename T>
+    void put_number(T value) {
+        char text[32];
+        auto result = std::to_chars(text, text + sizeof(text), value);
+        data_.insert(data_.end(), text, result.ptr);
+    }
+    void put_date(int64_t epoch_seconds);
+    void put_hhmmss(uint32_t seconds);
+    void put_json_string(std::string_view text);  // Quoted, control bytes as \u00XX
+    void put_csv_field(std::string_view text);    // Quoted only when it has to be
+
+private:
+    std::vector<char> data_;
+};
+
+enum class RecordFormat { Ndjson, Csv };
+
+// Writes one decoded snapshot per line: NDJSON objects or CSV rows with
+// the same column names as --export (time, source, id0, id2.type, ...).
+// Each call formats into a per-thread buffer and issues a single write(2)
+// under a mutex, so records from concurrent workers never interleave.
+class RecordWriter {
+public:
+    // path "-" writes to stdout. Throws std::runtime_error if the file
+    // cannot be created. CSV output starts with the header line.
+    RecordWriter(const std::string& path, RecordFormat format);
+    ~RecordWriter();
+
+    RecordWriter(const RecordWriter&) = delete;
+    RecordWriter& operator=(const RecordWriter&) = delete;
+
+    // source is a port or site tag; rows not read are null/empty
+    void write(int64_t timestamp, std::string_view source, const DecodedRegisters& values);
+    bool ok() const;
+
+private:
+    int fd_;
+    bool owns_fd_;
+    RecordFormat format_;
+    mutable std::mutex mutex_;
+    bool failed_ = false;
+
+    void emit(const RecordBuffer& buffer);
+};
+
+#endif // RECORD_WRITER_HPP
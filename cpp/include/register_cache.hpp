@@ -0,0 +1,65 @@
+#ifndef REGISTER_CACHE_HPP
+#define REGISTER_CACHE_HPP
+
+#include "data_tables.hpp"
+#include "register_image.hpp"
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Registers that are fixed when a pack is built, remembered per serial
+// number so repeat visits only read the registers that change. One cache
+// can be shared by concurrent sessions: every call holds a mutex, so saves
+// of the file never race.
+class RegisterCache {
+public:
+    // DATA_ID rows: cell type (0x0000), type/serial (0x0004) and
+    // manufacture date (0x0011)
+    static constexpr std::array<int, 3> IDS = {0, 2, 4};
+    static constexpr int SERIAL_ID = 2;
+
+    static constexpr size_t BYTES = [] {
+        size_t bytes = 0;
+        for (int id : IDS) {
+            bytes += DATA_ID[id].length;
+        }
+        return bytes;
+    }();
+
+    // Loads path if it exists; a damaged file is ignored with a warning.
+    // An empty path keeps the cache in memory only.
+    explicit RegisterCache(std::string path = "");
+
+    RegisterCache(const RegisterCache&) = delete;
+    RegisterCache& operator=(const RegisterCache&) = delete;
+
+    // Copy the cached registers image does not hold yet into it; image must
+    // already hold the 0x0004 register read from the pack. False if the
+    // pack is unknown or its type/serial bytes differ from the cached ones.
+    bool restore(RegisterImage& image) const;
+
+    // Remember the cached registers held by image and save the file. False
+    // if any is missing or nothing changed.
+    bool remember(const RegisterImage& image);
+
+    size_t size() const;
+    const std::string& path() const { return path_; }
+
+    // One line per pack: serial followed by each register in hex
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    // $XDG_CACHE_HOME/m18/registers, falling back to ~/.cache
+    static std::string default_path();
+
+private:
+    std::string path_;
+    mutable std::mutex mutex_;
+    std::unordered_map<uint32_t, std::array<uint8_t, BYTES>> entries_;
+
+    bool save_locked(const std::string& path) const;
+};
+
+#endif // REGISTER_CACHE_HPP
@@ -0,0 +1,134 @@
+#ifndef REGISTER_DECODE_HPP
+#define REGISTER_DECODE_HPP
+
+#include "data_tables.hpp"
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+// Decoded forms of the DATA_ID register types. None of them allocate.
+struct SerialNumber {
+    uint16_t type;
+    uint32_t serial;
+};
+
+using CellArray = std::array<uint16_t, 5>;
+
+// Unsigned big-endian value of up to 4 bytes
+constexpr uint32_t read_be(const uint8_t* data, size_t length) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < length && i < 4; ++i) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+// Convert a thermistor ADC reading into a temperature estimate.
+// The constants used here are only estimated.
+inline float adc_to_celsius(uint16_t adc_value) {
+    constexpr float r1 = 10e3;
+    constexpr float r2 = 20e3;
+    constexpr float t1 = 50.0f;
+    constexpr float t2 = 35.0f;
+    constexpr uint16_t adc1 = 0x0180;
+    constexpr uint16_t adc2 = 0x022E;
+
+    float m = (t2 - t1) / (r2 - r1);
+    float b = t1 - m * r1;
+    float resistance = r1 + (adc_value - adc1) * (r2 - r1) / (adc2 - adc1);
+    float temperature = m * resistance + b;
+
+    return std::round(temperature * 100) / 100;
+}
+
+template <RegType T>
+struct RegDecoder;
+
+template <>
+struct RegDecoder<RegType::Uint> {
+    using value_type = uint32_t;
+    static value_type decode(const uint8_t* data, size_t length) { return read_be(data, length); }
+};
+
+template <>
+struct RegDecoder<RegType::Date> {
+    using value_type = uint32_t;  // seconds since the UNIX epoch
+    static value_type decode(const uint8_t* data, size_t length) { return read_be(data, length); }
+};
+
+template <>
+struct RegDecoder<RegType::Hhmmss> {
+    using value_type = uint32_t;  // seconds
+    static value_type decode(const uint8_t* data, size_t length) { return read_be(data, length); }
+};
+
+template <>
+struct RegDecoder<RegType::Ascii> {
+    using value_type = std::string_view;  // points into the register image
+    static value_type decode(const uint8_t* data, size_t length) {
+        return std::string_view(reinterpret_cast<const char*>(data), length);
+    }
+};
+
+template <>
+struct RegDecoder<RegType::Sn> {
+    using value_type = SerialNumber;
+    static value_type decode(const uint8_t* data, size_t) {
+        return {static_cast<uint16_t>(read_be(data, 2)), read_be(data + 2, 3)};
+    }
+};
+
+template <>
+struct RegDecoder<RegType::AdcT> {
+    using value_type = float;
+    static value_type decode(const uint8_t* data, size_t length) {
+        return adc_to_celsius(static_cast<uint16_t>(read_be(data, length)));
+    }
+};
+
+template <>
+struct RegDecoder<RegType::DecT> {
+    using value_type = float;
+    static value_type decode(const uint8_t* data, size_t) { return data[0] + data[1] / 256.0f; }
+};
+
+template <>
+struct RegDecoder<RegType::CellV> {
+    using value_type = CellArray;
+    static value_type decode(const uint8_t* data, size_t length) {
+        CellArray cells{};
+        for (size_t i = 0; i < cells.size() && 2 * i + 1 < length; ++i) {
+            cells[i] = static_cast<uint16_t>(read_be(data + 2 * i, 2));
+        }
+        return cells;
+    }
+};
+
+// Decode a DATA_ID row whose index is known at compile time
+template <size_t Id>
+typename RegDecoder<DATA_ID[Id].type>::value_type decode_id(const uint8_t* data) {
+    static_assert(Id < DATA_ID.size(), "DATA_ID index out of range");
+    return RegDecoder<DATA_ID[Id].type>::decode(data, DATA_ID[Id].length);
+}
+
+// Call f(std::integral_constant<RegType, T>{}) for a type only known at
+// runtime, so f can use RegDecoder<T> statically
+template <typename F>
+decltype(auto) dispatch_reg_type(RegType type, F&& f) {
+    switch (type) {
+        case RegType::Date: return f(std::integral_constant<RegType, RegType::Date>{});
+        case RegType::Ascii: return f(std::integral_constant<RegType, RegType::Ascii>{});
+        case RegType::Sn: return f(std::integral_constant<RegType, RegType::Sn>{});
+        case RegType::AdcT: return f(std::integral_constant<RegType, RegType::AdcT>{});
+        case RegType::DecT: return f(std::integral_constant<RegType, RegType::DecT>{});
+        case RegType::CellV: return f(std::integral_constant<RegType, RegType::CellV>{});
+        case RegType::Hhmmss: return f(std::integral_constant<RegType, RegType::Hhmmss>{});
+        case RegType::Uint: break;
+    }
+    return f(std::integral_constant<RegType, RegType::Uint>{});
+}
+
+#endif // REGISTER_DECODE_HPP
@@ -0,0 +1,56 @@
+#ifndef REGISTER_IMAGE_HPP
+#define REGISTER_IMAGE_HPP
+
+#include "data_tables.hpp"
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+
+// In-memory copy of the pack's registers, covering every REGISTER_REGIONS
+// block. Bytes are only served once they have been stored by a read.
+class RegisterImage {
+public:
+    static constexpr size_t SIZE = [] {
+        size_t size = 0;
+        for (const auto& region : REGISTER_REGIONS) {
+            size += region.end - region.start;
+        }
+        return size;
+    }();
+
+    // Store bytes read from addr. Bytes outside the known regions are ignored.
+    void store(uint16_t addr, const uint8_t* data, size_t length);
+
+    // Pointer to length bytes at addr, or nullptr unless all of them are present
+    const uint8_t* data(uint16_t addr, size_t length) const;
+    bool contains(uint16_t addr, size_t length) const;
+
+    void invalidate(uint16_t addr, size_t length);
+    void clear();
+    size_t valid_count() const { return valid_.count(); }
+
+    // Raw form for storage: SIZE bytes plus a SIZE-bit validity mask
+    static constexpr size_t VALID_BYTES = (SIZE + 7) / 8;
+    const uint8_t* raw_bytes() const { return bytes_.data(); }
+    void pack_valid(uint8_t* bits) const;
+    void assign_raw(const uint8_t* bytes, const uint8_t* bits, size_t size);
+
+    // Offset of addr in the image, or -1 if outside every region
+    static constexpr long offset_of(uint16_t addr) {
+        long offset = 0;
+        for (const auto& region : REGISTER_REGIONS) {
+            if (addr >= region.start && addr < region.end) {
+                return offset + (addr - region.start);
+            }
+            offset += region.end - region.start;
+        }
+        return -1;
+    }
+
+private:
+    std::array<uint8_t, SIZE> bytes_{};
+    std::bitset<SIZE> valid_;
+};
+
+#endif // REGISTER_IMAGE_HPP
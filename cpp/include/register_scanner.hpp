@@ -0,0 +1,96 @@
+#ifndef REGISTER_SCANNER_HPP
+#define REGISTER_SCANNER_HPP
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// A readable block found by a scan: reads of up to max_read bytes that
+// start and end inside [start, end) are answered
+struct ScanRegion {
+    uint32_t start;
+    uint32_t end;  // exclusive
+    uint16_t max_read;
+};
+
+enum class ProbeResult {
+    Valid,       // 0x81 response
+    Rejected,    // 0x82, the pack refused the address/length
+    NoResponse   // the link failed; the answer is unknown
+};
+
+struct ScanOptions {
+    uint16_t max_length = 0xFF;   // Longest read tried at each address
+    uint16_t page_size = 0x100;   // Skip pages whose samples are all rejected;
+    uint16_t page_samples = 16;   // page_size 0 probes every address
+    bool use_known_regions = true;  // Verify REGISTER_REGIONS blocks with one read
+};
+
+// Maps the readable register space between start and stop without the
+// exhaustive address x length sweep of M18::brute(). Readable addresses
+// are followed one maximal read at a time, with the longest accepted
+// length binary-searched. Every known pack keeps its registers in blocks
+// starting on page boundaries, so a page whose evenly spaced samples are
+// all rejected is skipped.
+//
+// Progress only advances once a page, address or region is fully
+// resolved, so a scan that throws or is stopped can be run again (or
+// restored from a checkpoint) to continue.
+class RegisterScanner {
+public:
+    using Probe = std::function<ProbeResult(uint16_t addr, uint16_t length)>;
+    // Called after each resolved step; returning false stops the scan
+    using Progress = std::function<bool(const RegisterScanner&)>;
+
+    RegisterScanner(uint32_t start, uint32_t stop, const ScanOptions& options = {});
+
+    // Scan until done or progress returns false; true once done. Throws
+    // std::runtime_error on NoResponse.
+    bool run(const Probe& probe, const Progress& progress = nullptr);
+
+    // Continue a scan from a checkpoint
+    void restore(uint32_t next, uint64_t probes, std::vector<ScanRegion> regions);
+
+    bool done() const { return next_ >= stop_; }
+    uint32_t start() const { return start_; }
+    uint32_t stop() const { return stop_; }
+    uint32_t next() const { return next_; }
+    uint64_t probes() const { return probes_; }
+    const ScanOptions& options() const { return options_; }
+    const std::vector<ScanRegion>& regions() const { return regions_; }
+
+    // One "0xSTART-0xEND  N bytes  max read 0xLL" line per region
+    static void print_map(std::ostream& out, const std::vector<ScanRegion>& regions);
+
+private:
+    uint32_t start_;
+    uint32_t stop_;
+    uint32_t next_;
+    uint64_t probes_ = 0;
+    ScanOptions options_;
+    std::vector<ScanRegion> regions_;
+
+    bool check(const Probe& probe, uint16_t addr, uint16_t length);
+    void step(const Probe& probe);
+    bool skip_page(const Probe& probe);
+    uint32_t follow_region(const Probe& probe, uint32_t addr);
+    void add_region(uint32_t start, uint32_t end, uint16_t max_read);
+};
+
+// Split [start, stop) into count scanners on page boundaries, so several
+// adapters can map one address space in parallel
+std::vector<RegisterScanner> shard_scan(uint32_t start, uint32_t stop, size_t count, const ScanOptions& options = {});
+
+// Regions of every shard in address order. Blocks that straddle a shard
+// boundary are found from both sides and joined here.
+std::vector<ScanRegion> merge_scan_regions(const std::vector<RegisterScanner>& shards);
+
+// Checkpoint files hold the scan options, then one "shard = START STOP
+// NEXT PROBES" line per shard followed by its "region = START END MAX"
+// lines. They are replaced atomically.
+bool save_scan_checkpoint(const std::string& path, const std::vector<RegisterScanner>& shards);
+bool load_scan_checkpoint(const std::string& path, std::vector<RegisterScanner>& shards);
+
+#endif // REGISTER_SCANNER_HPP
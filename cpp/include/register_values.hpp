@@ -0,0 +1,62 @@
+#ifndef REGISTER_VALUES_HPP
+#define REGISTER_VALUES_HPP
+
+#include "register_decode.hpp"
+#include "register_image.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <variant>
+
+// Typed values of decoded DATA_ID rows, for programs that want structured
+// data rather than read_id's text. Every alternative has a fixed size, so
+// decoding a whole image never allocates.
+struct DateValue {
+    uint32_t epoch;  // Seconds since the UNIX epoch (UTC)
+};
+
+struct DurationValue {
+    uint32_t seconds;
+};
+
+struct TemperatureValue {
+    float celsius;
+};
+
+inline constexpr size_t MAX_ASCII_LENGTH = [] {
+    size_t length = 0;
+    for (const auto& entry : DATA_ID) {
+        if (entry.type == RegType::Ascii && entry.length > length) {
+            length = entry.length;
+        }
+    }
+    return length;
+}();
+
+struct AsciiValue {
+    std::array<char, MAX_ASCII_LENGTH> chars;
+    uint8_t length;
+    std::string_view view() const { return std::string_view(chars.data(), length); }
+};
+
+// monostate: the register was not read (or not requested)
+using RegisterValue = std::variant<std::monostate, uint32_t, DateValue, DurationValue, AsciiValue,
+                                   SerialNumber, CellArray, TemperatureValue>;
+
+// Indexed by DATA_ID position
+using DecodedRegisters = std::array<RegisterValue, DATA_ID.size()>;
+
+// Value of DATA_ID[id] from image, or monostate if its bytes are missing
+RegisterValue decode_register(size_t id, const RegisterImage& image);
+void decode_registers(const RegisterImage& image, DecodedRegisters& values);
+
+// Text layer, kept apart from decoding: the read_id value column
+// ("------" for monostate). Labelled output puts a serial number on one
+// line and cells as "1: 3901, 2: ..."; raw output puts each on its own line.
+void write_register_value(std::ostream& out, size_t id, const RegisterValue& value, bool labelled);
+std::string format_register_value(size_t id, const RegisterValue& value, bool labelled);
+
+#endif // REGISTER_VALUES_HPP
@@ -1,6 +1,9 @@
 #ifndef SERIAL_PORT_HPP
 #define SERIAL_PORT_HPP
 
+#include "usb_adapter.hpp"
+#include <array>
+#include <chrono>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -8,6 +11,8 @@
 
 class SerialPort {
 public:
+    using Clock = std::chrono::steady_clock;
+
     SerialPort(const std::string& port, int baudrate = 4800, double timeout_seconds = 0.8);
     ~SerialPort();
 
@@ -17,7 +22,23 @@ public:
 
     // Write and read operations
     bool write(const std::vector<uint8_t>& data);
+    bool write(const uint8_t* data, size_t length);
     std::vector<uint8_t> read(size_t num_bytes);
+
+    // Read exactly num_bytes, returning as soon as they have arrived or the
+    // deadline passes. Returns the number of bytes actually copied to dst.
+    size_t read_exact(uint8_t* dst, size_t num_bytes, Clock::time_point deadline);
+    std::vector<uint8_t> read_exact(size_t num_bytes, Clock::time_point deadline);
+
+    // Bytes already received and waiting in the receive buffer
+    size_t available() const;
+
+    // Non-blocking use from an event loop: register fd() for readability,
+    // then pump() moves whatever the driver holds into the receive buffer
+    // without waiting and take() drains it. Returns the byte counts moved.
+    int fd() const;
+    size_t pump();
+    size_t take(uint8_t* dst, size_t max_bytes);
     
     // Control signals
     void set_dtr(bool state);
@@ -32,13 +53,35 @@ public:
     int baudrate() const;
     std::string port_name() const;
 
+    // Low-latency adapter settings (FTDI latency_timer = 1ms and
+    // ASYNC_LOW_LATENCY) are applied by open() and restored by close().
+    // Both setters only take effect on the next open().
+    void set_low_latency(bool enable);
+    void set_sysfs_root(const std::string& root);
+    const AdapterInfo& adapter() const;
+
 private:
     std::string port_name_;
     int baudrate_;
     double timeout_seconds_;
     int fd_;  // File descriptor for the serial port
-    
+
+    bool low_latency_;
+    std::string sysfs_root_;
+    AdapterInfo adapter_;
+    int saved_serial_flags_;  // -1 if ASYNC_LOW_LATENCY was left alone
+
+    // Receive ring buffer, filled by poll()-driven reads
+    static constexpr size_t RX_BUFFER_SIZE = 4096;
+    std::array<uint8_t, RX_BUFFER_SIZE> rx_buffer_;
+    size_t rx_head_;   // Index of the oldest buffered byte
+    size_t rx_count_;  // Number of buffered bytes
+
     bool configure_port();
+    void apply_low_latency();
+    void restore_low_latency();
+    bool fill_rx_buffer(Clock::time_point deadline);
+    size_t take_rx_buffer(uint8_t* dst, size_t max_bytes);
 };
 
 #endif // SERIAL_PORT_HPP
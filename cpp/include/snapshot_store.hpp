@@ -0,0 +1,102 @@
+#ifndef SNAPSHOT_STORE_HPP
+#define SNAPSHOT_STORE_HPP
+
+#include "register_image.hpp"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// One stored register image
+struct Snapshot {
+    uint64_t offset = 0;       // Position of the record in snapshots.dat
+    int64_t timestamp = 0;     // Seconds since the UNIX epoch
+    uint16_t type = 0;         // Battery type and serial from 0x0004
+    uint32_t serial = 0;
+    std::string site;          // Free-form site/label tag, may be empty
+    RegisterImage image;
+};
+
+// History of register images in a directory:
+//
+//   snapshots.dat  append-only records, never rewritten. Each record links
+//                  to the previous snapshot of the same serial number.
+//   snapshots.idx  memory-mapped open-addressing hash table from serial
+//                  number to its newest record and snapshot count.
+//
+// The index is derived data: records appended after the index was last
+// updated (e.g. after a crash) are indexed when the store is opened, and a
+// missing or damaged index is rebuilt from the data file. A damaged record
+// is skipped, never removed; only a final record that runs past the end of
+// the file (a write cut short) is truncated, and only by a writable store.
+// A store has a single writer.
+class SnapshotStore {
+public:
+    static constexpr uint64_t NO_OFFSET = UINT64_MAX;
+
+    // Opens or creates the store; throws std::runtime_error on I/O errors.
+    // A read-only store must exist and leaves both files untouched: records
+    // missing from the index are indexed in a private copy.
+    explicit SnapshotStore(const std::string& directory, bool read_only = false);
+    ~SnapshotStore();
+
+    SnapshotStore(const SnapshotStore&) = delete;
+    SnapshotStore& operator=(const SnapshotStore&) = delete;
+
+    // Append an image; type and serial are decoded from its 0x0004 register,
+    // which must be present. timestamp 0 means now. Returns the record offset.
+    uint64_t append(const RegisterImage& image, const std::string& site = "", int64_t timestamp = 0);
+
+    // Record offsets for a serial number, newest first
+    std::vector<uint64_t> offsets(uint32_t serial) const;
+    size_t count(uint32_t serial) const;
+
+    Snapshot read(uint64_t offset) const;
+    // Readable snapshots of a serial number, newest first
+    std::vector<Snapshot> history(uint32_t serial) const;
+
+    // Visit every readable record in file order
+    void scan(const std::function<void(const Snapshot&)>& visit) const;
+
+    // Discard the index and rebuild it from snapshots.dat
+    void rebuild_index();
+
+    size_t snapshot_count() const;
+    size_t pack_count() const;
+    // Unreadable records skipped while indexing on open
+    size_t damaged_records() const { return damaged_; }
+    const std::string& directory() const { return directory_; }
+
+private:
+    struct IndexHeader;
+    struct IndexSlot;
+
+    std::string directory_;
+    bool read_only_;
+    int data_fd_;
+    int index_fd_;
+    uint64_t data_size_;
+    void* index_map_;
+    size_t index_map_size_;
+    size_t damaged_;
+
+    IndexHeader* header() const;
+    IndexSlot* slots() const;
+    IndexSlot* find_slot(uint32_t serial) const;
+
+    void open_index(bool rebuild);
+    void map_index(uint64_t capacity, bool create);
+    void unmap_index();
+    void grow_index();
+    void index_record(uint64_t offset, uint32_t serial, uint64_t end);
+    void catch_up();
+
+    // Header of the record at offset, or false if it is truncated or corrupt
+    bool read_record(uint64_t offset, Snapshot* snapshot, uint64_t* prev, uint64_t* next) const;
+    // Offset of the first readable record at or after from, or NO_OFFSET
+    uint64_t find_record(uint64_t from) const;
+    // Whether the record at offset is the start of a write cut short at EOF
+    bool torn_tail(uint64_t offset) const;
+};
+
+#endif // SNAPSHOT_STORE_HPP
@@ -0,0 +1,69 @@
+#ifndef TELEMETRY_STREAM_HPP
+#define TELEMETRY_STREAM_HPP
+
+#include "spsc_ring.hpp"
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <thread>
+
+// Live registers polled by M18::stream(), kept raw so the poll loop does no
+// decoding. Bits in valid mark which reads succeeded.
+struct TelemetrySample {
+    static constexpr uint8_t CELLS_VALID = 0x01;       // 0x400A, 10 bytes
+    static constexpr uint8_t TEMP_VALID = 0x02;        // 0x4014, 2 bytes
+    static constexpr uint8_t FORGE_TEMP_VALID = 0x04;  // 0x401F, 2 bytes
+
+    uint64_t sequence = 0;
+    int64_t timestamp_ns = 0;  // UNIX epoch, taken when the sample started
+    uint8_t valid = 0;
+    uint8_t cells[10] = {};
+    uint8_t temperature[2] = {};
+    uint8_t forge_temperature[2] = {};
+};
+
+enum class StreamFormat { Csv, Binary };
+
+// Writes samples on its own thread. The poll loop hands them over through
+// a lock-free ring, so a slow disk never delays the next read; if the ring
+// fills up, samples are counted as dropped instead.
+//
+// Binary streams start with the 8 byte header "M18T", version (u16) and
+// record size (u16), followed by fixed 32 byte little-endian records:
+// sequence (u64), timestamp_ns (i64), cell mV (5 x u16), temperature ADC
+// (u16), Forge temperature (u16, 1/256 C), valid (u8), padding (u8).
+class TelemetryWriter {
+public:
+    static constexpr size_t RING_SIZE = 4096;
+    static constexpr uint16_t BINARY_VERSION = 1;
+    static constexpr uint16_t BINARY_RECORD_SIZE = 32;
+
+    TelemetryWriter(std::ostream& out, StreamFormat format);
+    ~TelemetryWriter();
+
+    TelemetryWriter(const TelemetryWriter&) = delete;
+    TelemetryWriter& operator=(const TelemetryWriter&) = delete;
+
+    // Poll loop side; never blocks. False if the sample was dropped.
+    bool push(const TelemetrySample& sample);
+
+    // Write everything still queued and stop the writer thread
+    void finish();
+
+    uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    std::ostream& out_;
+    StreamFormat format_;
+    SpscRing<TelemetrySample, RING_SIZE> ring_;
+    std::atomic<bool> finishing_{false};
+    std::atomic<uint64_t> written_{0};
+    uint64_t dropped_ = 0;
+    std::thread thread_;
+
+    void run();
+    void write(const TelemetrySample& sample);
+};
+
+#endif // TELEMETRY_STREAM_HPP
@@ -0,0 +1,31 @@
+#ifndef TIMING_PROFILE_HPP
+#define TIMING_PROFILE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+// Inter-frame gaps and timeouts used by M18. The defaults match the constants
+// from the Python implementation; M18::characterize_link() measures the
+// shortest safe values for a given adapter and battery.
+struct TimingProfile {
+    using usec = std::chrono::microseconds;
+
+    usec break_hold{300000};        // Break + DTR asserted during reset()
+    usec break_recovery{300000};    // Line high after break, before the sync byte
+    usec sync_settle{10000};        // After the sync byte is echoed
+    usec turnaround{50000};         // After each response, before the next frame
+    usec turnaround_per_byte{0};    // Extra turnaround per response byte
+    usec refresh_settle{100000};    // Idle time after a force_refresh sweep
+    usec response_timeout{800000};  // Maximum wait for each part of a response
+    std::string adapter;            // Free-form description of the adapter/pack
+
+    // Gap to leave after a response of response_len bytes
+    usec frame_gap(size_t response_len) const;
+
+    // Profile files are "key = value" lines with values in microseconds
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+};
+
+#endif // TIMING_PROFILE_HPP
@@ -0,0 +1,105 @@
+#ifndef USAGE_HISTOGRAM_HPP
+#define USAGE_HISTOGRAM_HPP
+
+#include "data_tables.hpp"
+#include "register_decode.hpp"
+#include "register_image.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A run of consecutive 2 byte counters in the 0x9000 block. Bucket i
+// covers [low + i * width, low + (i + 1) * width) of unit; the first and
+// last buckets may be open ended.
+struct HistogramLayout {
+    const char* name;
+    uint16_t addr;  // First counter
+    size_t buckets;
+    int low;
+    int width;
+    const char* unit;
+    bool open_below;
+    bool open_above;
+
+    constexpr int first_id() const { return find_data_id(addr); }
+    constexpr int lower_edge(size_t bucket) const { return low + static_cast<int>(bucket) * width; }
+    // "10-20A", or "< 17V" / "> 200A" for open buckets
+    std::string label(size_t bucket) const;
+};
+
+// Seconds of discharge per current range. The 10 A set is the one m18.py
+// reports; the 5 A set is not well understood yet.
+inline constexpr HistogramLayout DISCHARGE_CURRENT = {"discharge", 0x903A, 20, 10, 10, "A", false, true};
+inline constexpr HistogramLayout DISCHARGE_CURRENT_FINE = {"discharge_fine", 0x9062, 40, 5, 5, "A", false, true};
+// Charges by pack voltage when the charge started and ended
+inline constexpr HistogramLayout CHARGE_START_VOLTAGE = {"charge_start", 0x90B2, 5, 16, 1, "V", true, true};
+inline constexpr HistogramLayout CHARGE_END_VOLTAGE = {"charge_end", 0x90BC, 5, 16, 1, "V", true, true};
+
+// Fixed-size bucket counts. Merging is element-wise addition, so partial
+// sums from any number of threads combine in any order; 64 bit counts
+// hold the sum of the 16 bit counters of any fleet.
+template <size_t N>
+struct BucketCounts {
+    std::array<uint64_t, N> counts{};
+
+    static constexpr size_t size() { return N; }
+    uint64_t operator[](size_t bucket) const { return counts[bucket]; }
+    uint64_t& operator[](size_t bucket) { return counts[bucket]; }
+
+    BucketCounts& operator+=(const BucketCounts& other) {
+        for (size_t i = 0; i < N; ++i) {
+            counts[i] += other.counts[i];
+        }
+        return *this;
+    }
+
+    // Sum of buckets first..N-1
+    uint64_t total(size_t first = 0) const {
+        uint64_t sum = 0;
+        for (size_t i = first; i < N; ++i) {
+            sum += counts[i];
+        }
+        return sum;
+    }
+
+    // Bucket holding the p-th fraction (0..1) of the total, by nearest
+    // rank as LatencyHistogram::percentile; N if the counts are all zero
+    size_t percentile(double p) const {
+        const uint64_t n = total();
+        if (n == 0) {
+            return N;
+        }
+        const double wanted = p * static_cast<double>(n) + 0.5;
+        const uint64_t rank = wanted < 1 ? 1 : static_cast<uint64_t>(wanted);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < N; ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return i;
+            }
+        }
+        return N - 1;
+    }
+};
+
+using DischargeHistogram = BucketCounts<DISCHARGE_CURRENT.buckets>;
+using FineDischargeHistogram = BucketCounts<DISCHARGE_CURRENT_FINE.buckets>;
+using ChargeVoltageHistogram = BucketCounts<CHARGE_START_VOLTAGE.buckets>;
+
+// Copy a layout's counters out of image; false (counts untouched) if any
+// of them is missing
+template <size_t N>
+bool decode_histogram(const RegisterImage& image, const HistogramLayout& layout, BucketCounts<N>& counts) {
+    static_assert(N > 0);
+    const uint8_t* data = image.data(layout.addr, 2 * N);
+    if (data == nullptr || layout.buckets != N) {
+        return false;
+    }
+    for (size_t i = 0; i < N; ++i) {
+        counts[i] = read_be(data + 2 * i, 2);
+    }
+    return true;
+}
+
+#endif // USAGE_HISTOGRAM_HPP
@@ -0,0 +1,29 @@
+#ifndef USB_ADAPTER_HPP
+#define USB_ADAPTER_HPP
+
+#include <string>
+
+// USB-serial bridge chips with known latency behaviour
+enum class AdapterChip { Unknown, Ftdi, Cp210x, Ch340, Pl2303 };
+
+const char* adapter_chip_name(AdapterChip chip);
+
+struct AdapterInfo {
+    AdapterChip chip = AdapterChip::Unknown;
+    std::string tty;                   // e.g. "ttyUSB0"
+    std::string driver;                // kernel driver, e.g. "ftdi_sio"
+    std::string latency_timer_path;    // FTDI only; empty if not present
+    int latency_timer_ms = -1;         // Effective value, -1 if unknown
+    int original_latency_timer_ms = -1;
+    bool low_latency = false;          // ASYNC_LOW_LATENCY is set
+};
+
+// Identify the adapter behind port from sysfs. sysfs_root is normally "/sys"
+// and can point at a copy of the tree for testing.
+AdapterInfo detect_adapter(const std::string& port, const std::string& sysfs_root = "/sys");
+
+// latency_timer in milliseconds, or -1 if it cannot be read
+int read_latency_timer(const std::string& path);
+bool write_latency_timer(const std::string& path, int milliseconds);
+
+#endif // USB_ADAPTER_HPP
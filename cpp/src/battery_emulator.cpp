@@ -0,0 +1,360 @@
+#include "battery_emulator.hpp"
+#include "frame_codec.hpp"
+#include "m18.hpp"
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint8_t READ_CMD = 0x01;
+constexpr uint8_t READ_REPLY = 0x81;
+constexpr uint8_t ERROR_REPLY = 0x82;
+
+constexpr uint8_t ERR_UNREADABLE = 0x01;
+constexpr uint8_t ERR_CHECKSUM = 0x02;
+constexpr uint8_t ERR_UNKNOWN = 0x03;
+
+constexpr uint32_t DEFAULT_DATE = 1696118400;  // 2023-10-01
+
+void put_be(uint8_t* out, size_t length, uint32_t value) {
+    for (size_t i = length; i-- > 0;) {
+        out[i] = static_cast<uint8_t>(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+} // namespace
+
+BatteryEmulator::BatteryEmulator(const RegisterImage& image, const EmulatorFaults& faults)
+    : image_(image), faults_(faults), rng_(faults.seed), master_fd_(-1), slave_fd_(-1) {
+    master_fd_ = ::posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master_fd_ < 0 || ::grantpt(master_fd_) != 0 || ::unlockpt(master_fd_) != 0) {
+        throw std::runtime_error("Failed to create pty: " + std::string(strerror(errno)));
+    }
+    port_ = ::ptsname(master_fd_);
+
+    slave_fd_ = ::open(port_.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (slave_fd_ < 0) {
+        ::close(master_fd_);
+        throw std::runtime_error("Failed to open pty slave: " + std::string(strerror(errno)));
+    }
+
+    struct termios tty;
+    if (::tcgetattr(master_fd_, &tty) == 0) {
+        ::cfmakeraw(&tty);
+        ::tcsetattr(master_fd_, TCSANOW, &tty);
+    }
+}
+
+BatteryEmulator::~BatteryEmulator() {
+    stop();
+    ::close(slave_fd_);
+    ::close(master_fd_);
+}
+
+void BatteryEmulator::start() {
+    if (thread_.joinable()) {
+        return;
+    }
+    stop_ = false;
+    thread_ = std::thread([this]() { run(stop_); });
+}
+
+void BatteryEmulator::stop() {
+    stop_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void BatteryEmulator::run(const std::atomic<bool>& stop) {
+    stop_flag_ = &stop;
+    uint8_t buffer[256];
+
+    while (!stop) {
+        struct pollfd pfd = {master_fd_, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, 50);
+        if (ready < 0 && errno != EINTR) {
+            throw std::runtime_error("poll failed: " + std::string(strerror(errno)));
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (!frame_.empty() && now - last_byte_ > FRAME_TIMEOUT) {
+            ++stats_.bad_frames;
+            frame_.clear();
+        }
+        if (ready <= 0 || !(pfd.revents & POLLIN)) {
+            continue;
+        }
+
+        ssize_t n = ::read(master_fd_, buffer, sizeof(buffer));
+        if (n <= 0) {
+            continue;
+        }
+        last_byte_ = now;
+        for (ssize_t i = 0; i < n; ++i) {
+            on_byte(frame_codec::reverse_bits(buffer[i]));
+        }
+    }
+    stop_flag_ = nullptr;
+}
+
+void BatteryEmulator::on_byte(uint8_t byte) {
+    if (frame_.empty()) {
+        if (byte == M18::SYNC_BYTE) {
+            // Sync after a break: echoed raw, without a frame around it
+            ++stats_.syncs;
+            const uint8_t sync = frame_codec::reverse_bits(M18::SYNC_BYTE);
+            sleep_for(faults_.reply_delay);
+            if (::write(master_fd_, &sync, 1) != 1) {
+                throw std::runtime_error("pty write failed: " + std::string(strerror(errno)));
+            }
+            return;
+        }
+        if (byte == 0x00) {
+            return;  // Line held low during a break
+        }
+    }
+
+    frame_.push_back(byte);
+    if (frame_.size() >= frame_codec::HEADER_SIZE &&
+        frame_.size() == frame_codec::HEADER_SIZE + frame_[2] + frame_codec::CHECKSUM_SIZE) {
+        handle_frame();
+        frame_.clear();
+    }
+}
+
+void BatteryEmulator::handle_frame() {
+    if (!frame_codec::checksum_ok(frame_.data(), frame_.size())) {
+        ++stats_.bad_frames;
+        reply_error(ERR_CHECKSUM);
+        return;
+    }
+    ++stats_.frames;
+
+    const uint8_t cmd = frame_[0];
+    const uint8_t acc = frame_[1];
+    const uint8_t len = frame_[2];
+
+    switch (cmd) {
+        case READ_CMD: {
+            if (len != 3) {
+                reply_error(ERR_UNKNOWN);
+                return;
+            }
+            uint16_t addr = static_cast<uint16_t>((frame_[3] << 8) | frame_[4]);
+            uint8_t length = frame_[5];
+            const RegisterRegion* region = find_region(addr);
+            const uint8_t* data = image_.data(addr, length);
+            if (region == nullptr || data == nullptr || length > region->max_read) {
+                reply_error(ERR_UNREADABLE);
+                return;
+            }
+            ++stats_.reads;
+            std::vector<uint8_t> out = {READ_REPLY, acc, length};
+            out.insert(out.end(), data, data + length);
+            reply(std::move(out));
+            return;
+        }
+        case M18::CONF_CMD:
+            reply({static_cast<uint8_t>(cmd | 0x80), acc, 0});
+            return;
+        case M18::SNAP_CMD:
+        case M18::CAL_CMD:
+            reply({static_cast<uint8_t>(cmd | 0x80), acc, 3, 0, 0, 0});
+            return;
+        case M18::KEEPALIVE_CMD:
+            reply({static_cast<uint8_t>(cmd | 0x80), acc, 4, 0, 0, 0, 0});
+            return;
+        default:
+            reply_error(ERR_UNKNOWN);
+            return;
+    }
+}
+
+void BatteryEmulator::reply_error(uint8_t code) {
+    ++stats_.errors;
+    std::vector<uint8_t> out = {ERROR_REPLY, code};
+    frame_codec::reverse_in_place(out.data(), out.size());
+    sleep_for(faults_.reply_delay);
+    if (::write(master_fd_, out.data(), out.size()) != static_cast<ssize_t>(out.size())) {
+        throw std::runtime_error("pty write failed: " + std::string(strerror(errno)));
+    }
+}
+
+void BatteryEmulator::reply(std::vector<uint8_t> frame) {
+    size_t length = frame.size();
+    frame.resize(length + frame_codec::CHECKSUM_SIZE);
+    frame_codec::append_checksum(frame.data(), length);
+    if (chance(faults_.corrupt_rate)) {
+        ++stats_.corrupted;
+        frame.back() ^= 0x01;
+    }
+    frame_codec::reverse_in_place(frame.data(), frame.size());
+
+    if (chance(faults_.stall_rate)) {
+        ++stats_.stalls;
+        sleep_for(faults_.stall);
+    }
+    sleep_for(faults_.reply_delay);
+
+    // Without per-byte faults the reply goes out in one write
+    if (faults_.byte_delay.count() == 0 && faults_.drop_rate <= 0) {
+        if (::write(master_fd_, frame.data(), frame.size()) != static_cast<ssize_t>(frame.size())) {
+            throw std::runtime_error("pty write failed: " + std::string(strerror(errno)));
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < frame.size(); ++i) {
+        if (i > 0) {
+            sleep_for(faults_.byte_delay);
+        }
+        if (chance(faults_.drop_rate)) {
+            ++stats_.dropped_bytes;
+            continue;
+        }
+        if (::write(master_fd_, &frame[i], 1) != 1) {
+            throw std::runtime_error("pty write failed: " + std::string(strerror(errno)));
+        }
+    }
+}
+
+bool BatteryEmulator::chance(double rate) {
+    if (rate <= 0) {
+        return false;
+    }
+    return std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < rate;
+}
+
+void BatteryEmulator::sleep_for(std::chrono::microseconds duration) {
+    // Long stalls stay responsive to stop()
+    constexpr std::chrono::microseconds slice(50000);
+    while (duration.count() > 0 && !(stop_flag_ && *stop_flag_)) {
+        auto step = std::min(duration, slice);
+        std::this_thread::sleep_for(step);
+        duration -= step;
+    }
+}
+
+RegisterImage BatteryEmulator::default_image() {
+    RegisterImage image;
+    uint8_t zeros[0x200] = {};
+    for (const auto& region : REGISTER_REGIONS) {
+        image.store(region.start, zeros, region.end - region.start);
+    }
+
+    static constexpr uint16_t CELLS_MV[] = {3901, 3903, 3898, 3900, 3902};
+    uint8_t value[0x20];
+    for (const auto& row : DATA_ID) {
+        std::memset(value, 0, sizeof(value));
+        switch (row.type) {
+            case RegType::Uint: put_be(value, row.length, 12); break;
+            case RegType::Date: put_be(value, row.length, DEFAULT_DATE); break;
+            case RegType::Hhmmss: put_be(value, row.length, 12 * 3600); break;
+            case RegType::Ascii: {
+                static constexpr char NOTE[] = "M18 EMULATOR";
+                std::memset(value, ' ', row.length);
+                std::memcpy(value, NOTE, std::min<size_t>(row.length, sizeof(NOTE) - 1));
+                break;
+            }
+            case RegType::Sn:
+                put_be(value, 2, 424);
+                put_be(value + 2, 3, 123456);
+                break;
+            case RegType::AdcT: put_be(value, row.length, 0x0200); break;
+            case RegType::DecT: value[0] = 25; break;
+            case RegType::CellV:
+                for (size_t i = 0; i < 5 && 2 * i + 1 < row.length; ++i) {
+                    put_be(value + 2 * i, 2, CELLS_MV[i]);
+                }
+                break;
+        }
+        image.store(row.addr, value, row.length);
+    }
+    return image;
+}
+
+bool BatteryEmulator::load_image(const std::string& path, RegisterImage& image) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open register image: " << path << std::endl;
+        return false;
+    }
+
+    RegisterImage loaded;
+    uint8_t zeros[0x200] = {};
+    for (const auto& region : REGISTER_REGIONS) {
+        loaded.store(region.start, zeros, region.end - region.start);
+    }
+
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        line = line.substr(0, line.find('#'));
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            if (line.find_first_not_of(" \t\r") != std::string::npos) {
+                std::cerr << path << ":" << line_no << ": expected 0xADDR: bytes" << std::endl;
+                return false;
+            }
+            continue;
+        }
+
+        char* end = nullptr;
+        unsigned long addr = std::strtoul(line.c_str(), &end, 16);
+        std::istringstream bytes(line.substr(colon + 1));
+        std::vector<uint8_t> data;
+        std::string token;
+        while (bytes >> token) {
+            unsigned long byte = std::strtoul(token.c_str(), &end, 16);
+            if (*end != '\0' || byte > 0xFF) {
+                std::cerr << path << ":" << line_no << ": bad byte '" << token << "'" << std::endl;
+                return false;
+            }
+            data.push_back(static_cast<uint8_t>(byte));
+        }
+        if (addr > 0xFFFF || !loaded.contains(static_cast<uint16_t>(addr), data.size())) {
+            std::cerr << path << ":" << line_no << ": outside the register map" << std::endl;
+            return false;
+        }
+        loaded.store(static_cast<uint16_t>(addr), data.data(), data.size());
+    }
+
+    image = loaded;
+    return true;
+}
+
+bool BatteryEmulator::save_image(const std::string& path, const RegisterImage& image) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot write register image: " << path << std::endl;
+        return false;
+    }
+
+    out << "# M18 register image, one line per DATA_MATRIX entry\n";
+    out << std::hex << std::uppercase << std::setfill('0');
+    for (const auto& entry : DATA_MATRIX) {
+        const uint8_t* data = image.data(entry.addr(), entry.length);
+        if (data == nullptr) {
+            continue;
+        }
+        out << "0x" << std::setw(4) << entry.addr() << ":";
+        for (size_t i = 0; i < entry.length; ++i) {
+            out << " " << std::setw(2) << static_cast<int>(data[i]);
+        }
+        out << "\n";
+    }
+    return static_cast<bool>(out);
+}
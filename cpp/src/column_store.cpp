@@ -0,0 +1,623 @@
+#include "column_store.hpp"
+#include "health.hpp"
+#include "register_decode.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr int SCHEMA_VERSION = 1;
+
+std::runtime_error io_error(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " " + path + ": " + strerror(errno));
+}
+
+// Dictionary strings and CSV text keep printable ASCII; anything else
+// (the 0x0023 note is often NUL padded) becomes \xNN
+std::string escape(const std::string& text) {
+    std::string out;
+    for (unsigned char c : text) {
+        if (c == '\\') {
+            out += "\\\\";
+        } else if (c >= 0x20 && c < 0x7F) {
+            out += static_cast<char>(c);
+        } else {
+            char hex[5];
+            std::snprintf(hex, sizeof(hex), "\\x%02X", c);
+            out += hex;
+        }
+    }
+    return out;
+}
+
+std::string unescape(const std::string& text) {
+    std::string out;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] != '\\' || i + 1 >= text.size()) {
+            out += text[i];
+        } else if (text[i + 1] == 'x' && i + 3 < text.size()) {
+            out += static_cast<char>(std::stoi(text.substr(i + 2, 2), nullptr, 16));
+            i += 3;
+        } else {
+            out += text[++i];
+        }
+    }
+    return out;
+}
+
+ColumnType uint_column(uint16_t length) {
+    return length == 1 ? ColumnType::U8 : length == 2 ? ColumnType::U16 : ColumnType::U32;
+}
+
+// BatteryHealth fields exported after the DATA_ID columns. A value is only
+// valid when the image holds the registers it is decoded from.
+struct DerivedColumn {
+    const char* name;
+    ColumnType type;
+    const char* label;
+    int sources[2];  // DATA_ID rows, -1 for none
+    double (*get)(const BatteryHealth&);
+};
+
+const DerivedColumn DERIVED_COLUMNS[] = {
+    {"days_since_first_charge", ColumnType::I32, "Days since first charge", {28, -1},
+     [](const BatteryHealth& h) { return double(h.days_since_first_charge); }},
+    {"days_since_last_use", ColumnType::I32, "Days since last tool use (pack clock)", {25, 8},
+     [](const BatteryHealth& h) { return double(h.days_since_last_use); }},
+    {"days_since_last_charge", ColumnType::I32, "Days since last charge (pack clock)", {26, 8},
+     [](const BatteryHealth& h) { return double(h.days_since_last_charge); }},
+    {"pack_voltage", ColumnType::F32, "Pack voltage (V)", {12, -1},
+     [](const BatteryHealth& h) { return double(h.pack_voltage); }},
+    {"cell_imbalance", ColumnType::F32, "Cell imbalance (mV)", {12, -1},
+     [](const BatteryHealth& h) { return double(h.cell_imbalance); }},
+    {"temperature", ColumnType::F32, "Temperature (C) (non-Forge)", {13, -1},
+     [](const BatteryHealth& h) { return double(h.temperature); }},
+    {"forge_temperature", ColumnType::F32, "Temperature (C) (Forge)", {18, -1},
+     [](const BatteryHealth& h) { return double(h.forge_temperature); }},
+    {"charge_count_redlink", ColumnType::I32, "Redlink charge count", {33, -1},
+     [](const BatteryHealth& h) { return double(h.charge_count_redlink); }},
+    {"charge_count_dumb", ColumnType::I32, "Dumb charge count", {32, -1},
+     [](const BatteryHealth& h) { return double(h.charge_count_dumb); }},
+    {"charge_count_total", ColumnType::I32, "Total charge count", {31, -1},
+     [](const BatteryHealth& h) { return double(h.charge_count_total); }},
+    {"low_voltage_charges", ColumnType::I32, "Charges started with a cell < 2.5V", {38, -1},
+     [](const BatteryHealth& h) { return double(h.low_voltage_charges); }},
+    {"total_discharge_ah", ColumnType::F32, "Total discharge (Ah)", {29, -1},
+     [](const BatteryHealth& h) { return double(h.total_discharge_ah); }},
+    {"discharge_cycles", ColumnType::F32, "Total discharge cycles (0 for unknown types)", {29, 2},
+     [](const BatteryHealth& h) { return double(h.discharge_cycles); }},
+    {"discharge_to_empty", ColumnType::I32, "Times discharged to empty", {39, -1},
+     [](const BatteryHealth& h) { return double(h.discharge_to_empty); }},
+    {"overheat_events", ColumnType::I32, "Times overheated", {40, -1},
+     [](const BatteryHealth& h) { return double(h.overheat_events); }},
+    {"overcurrent_events", ColumnType::I32, "Overcurrent events", {41, -1},
+     [](const BatteryHealth& h) { return double(h.overcurrent_events); }},
+    {"low_voltage_events", ColumnType::I32, "Low-voltage events", {42, -1},
+     [](const BatteryHealth& h) { return double(h.low_voltage_events); }},
+    {"low_voltage_bounce", ColumnType::I32, "Low-voltage bounce/stutter", {43, -1},
+     [](const BatteryHealth& h) { return double(h.low_voltage_bounce); }},
+    {"time_on_tool", ColumnType::U32, "Total time on tool >10A (seconds)", {44, 63},
+     [](const BatteryHealth& h) { return h.current_buckets ? double(h.current_buckets->total()) : 0.0; }},
+};
+
+bool has_id(const RegisterImage& image, int id) {
+    return id < 0 || image.contains(DATA_ID[id].addr, DATA_ID[id].length);
+}
+
+void put_le(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+} // namespace
+
+const char* column_type_name(ColumnType type) {
+    switch (type) {
+        case ColumnType::U8: return "u8";
+        case ColumnType::U16: return "u16";
+        case ColumnType::U32: return "u32";
+        case ColumnType::I32: return "i32";
+        case ColumnType::I64: return "i64";
+        case ColumnType::F32: return "f32";
+        case ColumnType::Dict: return "dict";
+    }
+    return "?";
+}
+
+bool parse_column_type(const std::string& name, ColumnType& type) {
+    for (ColumnType t : {ColumnType::U8, ColumnType::U16, ColumnType::U32, ColumnType::I32, ColumnType::I64,
+                         ColumnType::F32, ColumnType::Dict}) {
+        if (name == column_type_name(t)) {
+            type = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t column_width(ColumnType type) {
+    switch (type) {
+        case ColumnType::U8: return 1;
+        case ColumnType::U16: return 2;
+        case ColumnType::I64: return 8;
+        default: return 4;
+    }
+}
+
+const std::vector<ColumnSpec>& snapshot_columns() {
+    static const std::vector<ColumnSpec> columns = [] {
+        std::vector<ColumnSpec> specs = {
+            {"timestamp", ColumnType::I64, "Snapshot time (UNIX seconds)"},
+            {"site", ColumnType::Dict, "Site tag"},
+        };
+        for (size_t id = 0; id < DATA_ID.size(); ++id) {
+            const DataIdEntry& entry = DATA_ID[id];
+            const std::string name = "id" + std::to_string(id);
+            switch (entry.type) {
+                case RegType::Uint:
+                    if (entry.length > 0) {
+                        specs.push_back({name, uint_column(entry.length), entry.label});
+                    }
+                    break;
+                case RegType::Date:
+                case RegType::Hhmmss:
+                    specs.push_back({name, ColumnType::U32, entry.label});
+                    break;
+                case RegType::Ascii:
+                    specs.push_back({name, ColumnType::Dict, entry.label});
+                    break;
+                case RegType::Sn:
+                    specs.push_back({name + ".type", ColumnType::U16, "Battery type"});
+                    specs.push_back({name + ".serial", ColumnType::U32, "Electronic serial"});
+                    break;
+                case RegType::AdcT:
+                case RegType::DecT:
+                    specs.push_back({name, ColumnType::F32, entry.label});
+                    break;
+                case RegType::CellV:
+                    for (int cell = 1; cell <= 5; ++cell) {
+                        specs.push_back({name + ".cell" + std::to_string(cell), ColumnType::U16,
+                                         "Cell " + std::to_string(cell) + " voltage (mV)"});
+                    }
+                    break;
+            }
+        }
+        specs.push_back({"type", ColumnType::U16, "Battery type"});
+        specs.push_back({"serial", ColumnType::U32, "Electronic serial"});
+        specs.push_back({"model", ColumnType::Dict, "Battery model"});
+        for (const auto& derived : DERIVED_COLUMNS) {
+            specs.push_back({derived.name, derived.type, derived.label});
+        }
+        return specs;
+    }();
+    return columns;
+}
+
+void snapshot_row(const Snapshot& snapshot, ColumnRow& row) {
+    // Must produce values in snapshot_columns() order
+    row.assign(snapshot_columns().size(), ColumnValue{});
+    size_t i = 0;
+    auto integer = [&](bool valid, int64_t value) {
+        row[i].valid = valid;
+        row[i++].integer = valid ? value : 0;
+    };
+    auto real = [&](bool valid, float value) {
+        row[i].valid = valid;
+        row[i++].real = valid ? value : 0;
+    };
+    auto text = [&](bool valid, std::string value) {
+        row[i].valid = valid;
+        row[i++].text = std::move(value);
+    };
+
+    const RegisterImage& image = snapshot.image;
+    integer(true, snapshot.timestamp);
+    text(!snapshot.site.empty(), snapshot.site);
+
+    for (size_t id = 0; id < DATA_ID.size(); ++id) {
+        const DataIdEntry& entry = DATA_ID[id];
+        const uint8_t* data = image.data(entry.addr, entry.length);
+        const bool valid = data != nullptr;
+        switch (entry.type) {
+            case RegType::Uint:
+                if (entry.length > 0) {
+                    integer(valid, valid ? read_be(data, entry.length) : 0);
+                }
+                break;
+            case RegType::Date:
+            case RegType::Hhmmss:
+                integer(valid, valid ? read_be(data, entry.length) : 0);
+                break;
+            case RegType::Ascii: {
+                std::string value;
+                if (valid) {
+                    auto view = RegDecoder<RegType::Ascii>::decode(data, entry.length);
+                    value.assign(view.begin(), view.end());
+                }
+                text(valid, std::move(value));
+                break;
+            }
+            case RegType::Sn: {
+                SerialNumber sn = valid ? RegDecoder<RegType::Sn>::decode(data, entry.length) : SerialNumber{};
+                integer(valid, sn.type);
+                integer(valid, sn.serial);
+                break;
+            }
+            case RegType::AdcT:
+                real(valid, valid ? RegDecoder<RegType::AdcT>::decode(data, entry.length) : 0);
+                break;
+            case RegType::DecT:
+                real(valid, valid ? RegDecoder<RegType::DecT>::decode(data, entry.length) : 0);
+                break;
+            case RegType::CellV: {
+                CellArray cells = valid ? RegDecoder<RegType::CellV>::decode(data, entry.length) : CellArray{};
+                for (uint16_t mv : cells) {
+                    integer(valid, mv);
+                }
+                break;
+            }
+        }
+    }
+
+    const bool identified = has_id(image, 2);
+    const BatteryHealth health = decode_health(image);
+    integer(identified, snapshot.type);
+    integer(identified, snapshot.serial);
+    text(!health.model.empty(), health.model);
+    for (const auto& derived : DERIVED_COLUMNS) {
+        bool valid = has_id(image, derived.sources[0]) && has_id(image, derived.sources[1]);
+        if (derived.type == ColumnType::F32) {
+            real(valid, static_cast<float>(derived.get(health)));
+        } else {
+            integer(valid, static_cast<int64_t>(derived.get(health)));
+        }
+    }
+}
+
+struct ColumnFileWriter::Column {
+    std::string path;
+    std::ofstream out;
+    std::ofstream valid;      // Unsigned columns only
+    uint8_t valid_bits = 0;   // Bits of the rows since the last whole byte
+    std::unordered_map<std::string, uint32_t> codes;
+    std::vector<std::string> dictionary;
+};
+
+ColumnFileWriter::ColumnFileWriter(const std::string& directory, std::vector<ColumnSpec> columns)
+    : directory_(directory), specs_(std::move(columns)) {
+    if (::mkdir(directory_.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw io_error("Cannot create export directory", directory_);
+    }
+    // An old schema would describe columns this export is about to replace
+    std::remove((directory_ + "/schema.txt").c_str());
+    for (const auto& spec : specs_) {
+        auto column = std::make_unique<Column>();
+        column->path = directory_ + "/" + spec.name + ".col";
+        column->out.open(column->path, std::ios::binary | std::ios::trunc);
+        if (!column->out) {
+            throw io_error("Cannot create", column->path);
+        }
+        if (has_validity_bitmap(spec.type)) {
+            const std::string valid_path = directory_ + "/" + spec.name + ".valid";
+            column->valid.open(valid_path, std::ios::binary | std::ios::trunc);
+            if (!column->valid) {
+                throw io_error("Cannot create", valid_path);
+            }
+        }
+        columns_.push_back(std::move(column));
+    }
+}
+
+ColumnFileWriter::~ColumnFileWriter() = default;
+
+void ColumnFileWriter::write(const ColumnRow& row) {
+    if (row.size() != specs_.size()) {
+        throw std::invalid_argument("Row does not match the export columns");
+    }
+    uint8_t bytes[8];
+    for (size_t i = 0; i < specs_.size(); ++i) {
+        const ColumnValue& value = row[i];
+        const ColumnType type = specs_[i].type;
+        Column& column = *columns_[i];
+        uint64_t bits;
+        if (type == ColumnType::F32) {
+            float real = value.valid ? value.real : std::numeric_limits<float>::quiet_NaN();
+            uint32_t raw;
+            std::memcpy(&raw, &real, sizeof(raw));
+            bits = raw;
+        } else if (type == ColumnType::Dict) {
+            bits = UINT32_MAX;
+            if (value.valid) {
+                auto [it, added] = column.codes.emplace(value.text, static_cast<uint32_t>(column.dictionary.size()));
+                if (added) {
+                    column.dictionary.push_back(value.text);
+                }
+                bits = it->second;
+            }
+        } else if (value.valid) {
+            bits = static_cast<uint64_t>(value.integer);
+        } else {
+            bits = type == ColumnType::I32 ? static_cast<uint32_t>(INT32_MIN)
+                 : type == ColumnType::I64 ? static_cast<uint64_t>(INT64_MIN)
+                                           : UINT64_MAX;
+        }
+        const size_t width = column_width(type);
+        put_le(bytes, bits, width);
+        column.out.write(reinterpret_cast<const char*>(bytes), static_cast<std::streamsize>(width));
+
+        if (has_validity_bitmap(type)) {
+            column.valid_bits |= static_cast<uint8_t>(value.valid) << (rows_ % 8);
+            if (rows_ % 8 == 7) {
+                column.valid.put(static_cast<char>(column.valid_bits));
+                column.valid_bits = 0;
+            }
+        }
+    }
+    ++rows_;
+}
+
+bool ColumnFileWriter::finish() {
+    if (finished_) {
+        return true;
+    }
+    finished_ = true;
+    bool ok = true;
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        Column& column = *columns_[i];
+        column.out.close();
+        if (!column.out) {
+            std::cerr << "Cannot write " << column.path << std::endl;
+            ok = false;
+        }
+        if (has_validity_bitmap(specs_[i].type)) {
+            if (rows_ % 8 != 0) {
+                column.valid.put(static_cast<char>(column.valid_bits));
+            }
+            column.valid.close();
+            if (!column.valid) {
+                std::cerr << "Cannot write " << directory_ << "/" << specs_[i].name << ".valid" << std::endl;
+                ok = false;
+            }
+        }
+        if (specs_[i].type == ColumnType::Dict) {
+            const std::string path = directory_ + "/" + specs_[i].name + ".dict";
+            std::ofstream dict(path, std::ios::trunc);
+            for (const auto& text : column.dictionary) {
+                dict << escape(text) << "\n";
+            }
+            dict.close();
+            if (!dict) {
+                std::cerr << "Cannot write " << path << std::endl;
+                ok = false;
+            }
+        }
+    }
+    if (!ok) {
+        return false;
+    }
+
+    const std::string path = directory_ + "/schema.txt";
+    const std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::trunc);
+    out << "# M18 columnar export\n"
+        << "version = " << SCHEMA_VERSION << "\n"
+        << "rows = " << rows_ << "\n";
+    for (const auto& spec : specs_) {
+        out << "column = " << spec.name << " " << column_type_name(spec.type) << " " << spec.label << "\n";
+    }
+    out.close();
+    if (!out || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "Cannot write export schema: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+CsvColumnWriter::CsvColumnWriter(std::ostream& out, std::vector<ColumnSpec> columns)
+    : out_(out), specs_(std::move(columns)) {
+    for (size_t i = 0; i < specs_.size(); ++i) {
+        out_ << (i ? "," : "") << specs_[i].name;
+    }
+    out_ << "\n";
+}
+
+void CsvColumnWriter::write(const ColumnRow& row) {
+    if (row.size() != specs_.size()) {
+        throw std::invalid_argument("Row does not match the export columns");
+    }
+    for (size_t i = 0; i < specs_.size(); ++i) {
+        if (i) {
+            out_ << ',';
+        }
+        const ColumnValue& value = row[i];
+        if (!value.valid) {
+            continue;
+        }
+        switch (specs_[i].type) {
+            case ColumnType::F32:
+                out_ << value.real;
+                break;
+            case ColumnType::Dict: {
+                std::string text = escape(value.text);
+                if (text.find_first_of(",\" ") == std::string::npos) {
+                    out_ << text;
+                    break;
+                }
+                out_ << '"';
+                for (char c : text) {
+                    out_ << c;
+                    if (c == '"') {
+                        out_ << '"';
+                    }
+                }
+                out_ << '"';
+                break;
+            }
+            default:
+                out_ << value.integer;
+                break;
+        }
+    }
+    out_ << "\n";
+}
+
+bool CsvColumnWriter::finish() {
+    out_.flush();
+    if (!out_) {
+        std::cerr << "Cannot write CSV export" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+size_t export_snapshots(const SnapshotStore& store, const std::vector<ColumnSink*>& sinks) {
+    size_t rows = 0;
+    ColumnRow row;
+    store.scan([&](const Snapshot& snapshot) {
+        snapshot_row(snapshot, row);
+        for (ColumnSink* sink : sinks) {
+            sink->write(row);
+        }
+        ++rows;
+    });
+    return rows;
+}
+
+ColumnTable::ColumnTable(const std::string& directory) : directory_(directory) {
+    const std::string path = directory_ + "/schema.txt";
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot open export schema " + path);
+    }
+
+    int version = 0;
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t eq = line.find('=');
+        std::istringstream key_in(line.substr(0, eq));
+        std::string key;
+        key_in >> key;
+        std::istringstream value(eq == std::string::npos ? "" : line.substr(eq + 1));
+
+        bool ok = eq != std::string::npos;
+        if (ok && key == "version") {
+            ok = static_cast<bool>(value >> version);
+        } else if (ok && key == "rows") {
+            ok = static_cast<bool>(value >> rows_);
+        } else if (ok && key == "column") {
+            ColumnSpec spec;
+            std::string type;
+            ok = static_cast<bool>(value >> spec.name >> type) && parse_column_type(type, spec.type);
+            std::getline(value >> std::ws, spec.label);
+            specs_.push_back(std::move(spec));
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            throw std::runtime_error(path + ":" + std::to_string(line_no) + ": invalid " + key);
+        }
+    }
+    if (version != SCHEMA_VERSION) {
+        throw std::runtime_error(path + ": unsupported export version " + std::to_string(version));
+    }
+}
+
+ColumnTable::~ColumnTable() {
+    for (auto& [name, mapping] : maps_) {
+        if (mapping.size > 0) {
+            ::munmap(mapping.data, mapping.size);
+        }
+    }
+}
+
+const ColumnSpec* ColumnTable::find(const std::string& name) const {
+    for (const auto& spec : specs_) {
+        if (spec.name == name) {
+            return &spec;
+        }
+    }
+    return nullptr;
+}
+
+const void* ColumnTable::map(const std::string& name) {
+    const ColumnSpec* spec = find(name);
+    if (spec == nullptr) {
+        throw std::runtime_error("No column " + name + " in " + directory_);
+    }
+    return map_file(name + ".col", rows_ * column_width(spec->type));
+}
+
+const uint8_t* ColumnTable::validity(const std::string& name) {
+    const ColumnSpec* spec = find(name);
+    if (spec == nullptr) {
+        throw std::runtime_error("No column " + name + " in " + directory_);
+    }
+    if (!has_validity_bitmap(spec->type)) {
+        return nullptr;
+    }
+    return static_cast<const uint8_t*>(map_file(name + ".valid", (rows_ + 7) / 8));
+}
+
+const void* ColumnTable::map_file(const std::string& file, size_t size) {
+    auto it = maps_.find(file);
+    if (it != maps_.end()) {
+        return it->second.data;
+    }
+
+    Mapping mapping;
+    if (size > 0) {
+        const std::string path = directory_ + "/" + file;
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw io_error("Cannot open", path);
+        }
+        struct stat st{};
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < size) {
+            ::close(fd);
+            throw std::runtime_error("Column file " + path + " is shorter than " + std::to_string(rows_) + " rows");
+        }
+        void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            throw io_error("Cannot map", path);
+        }
+        mapping.data = data;
+        mapping.size = size;
+    }
+    return maps_.emplace(file, mapping).first->second.data;
+}
+
+const std::vector<std::string>& ColumnTable::dictionary(const std::string& name) {
+    auto it = dictionaries_.find(name);
+    if (it != dictionaries_.end()) {
+        return it->second;
+    }
+    const ColumnSpec* spec = find(name);
+    if (spec == nullptr || spec->type != ColumnType::Dict) {
+        throw std::runtime_error("No dictionary column " + name + " in " + directory_);
+    }
+    std::vector<std::string> strings;
+    std::ifstream in(directory_ + "/" + name + ".dict");
+    std::string line;
+    while (std::getline(in, line)) {
+        strings.push_back(unescape(line));
+    }
+    return dictionaries_.emplace(name, std::move(strings)).first->second;
+}
@@ -0,0 +1,103 @@
+#include "battery_emulator.hpp"
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+
+std::atomic<bool> stop_requested{false};
+
+void on_signal(int) {
+    stop_requested = true;
+}
+
+void print_help() {
+    std::cout << R"(M18 Battery Emulator
+
+Serves the battery side of the M18 protocol on a pseudo-terminal.
+Point m18 --port at the printed path.
+
+Usage: m18-emulator [OPTIONS]
+
+OPTIONS:
+  --image FILE             Load the register image from FILE
+  --save-image FILE        Write the register image to FILE and exit
+  --reply-delay US         Delay before every reply (microseconds)
+  --byte-delay US          Delay between reply bytes (2080 ~ 4800 baud)
+  --drop RATE              Probability of dropping each reply byte
+  --corrupt RATE           Probability of a bad reply checksum
+  --stall RATE             Probability of holding a reply back
+  --stall-ms MS            Length of a stall (default: 2000)
+  --seed N                 Seed for the fault sequence (default: 1)
+  --help                   Show this help message
+)" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string image_file;
+    std::string save_file;
+    EmulatorFaults faults;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--help" || arg == "-h") {
+            print_help();
+            return 0;
+        } else if (arg == "--image" && has_value) {
+            image_file = argv[++i];
+        } else if (arg == "--save-image" && has_value) {
+            save_file = argv[++i];
+        } else if (arg == "--reply-delay" && has_value) {
+            faults.reply_delay = EmulatorFaults::usec(std::atol(argv[++i]));
+        } else if (arg == "--byte-delay" && has_value) {
+            faults.byte_delay = EmulatorFaults::usec(std::atol(argv[++i]));
+        } else if (arg == "--drop" && has_value) {
+            faults.drop_rate = std::atof(argv[++i]);
+        } else if (arg == "--corrupt" && has_value) {
+            faults.corrupt_rate = std::atof(argv[++i]);
+        } else if (arg == "--stall" && has_value) {
+            faults.stall_rate = std::atof(argv[++i]);
+        } else if (arg == "--stall-ms" && has_value) {
+            faults.stall = std::chrono::milliseconds(std::atol(argv[++i]));
+        } else if (arg == "--seed" && has_value) {
+            faults.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    RegisterImage image = BatteryEmulator::default_image();
+    if (!image_file.empty() && !BatteryEmulator::load_image(image_file, image)) {
+        return 1;
+    }
+    if (!save_file.empty()) {
+        return BatteryEmulator::save_image(save_file, image) ? 0 : 1;
+    }
+
+    try {
+        BatteryEmulator emulator(image, faults);
+        std::signal(SIGINT, on_signal);
+        std::signal(SIGTERM, on_signal);
+
+        std::cout << emulator.port() << std::endl;
+        std::cerr << "Emulating battery on " << emulator.port() << " (Ctrl+C to stop)" << std::endl;
+        emulator.run(stop_requested);
+
+        const EmulatorStats& stats = emulator.stats();
+        std::cerr << "syncs=" << stats.syncs << " frames=" << stats.frames << " reads=" << stats.reads
+                  << " errors=" << stats.errors << " bad_frames=" << stats.bad_frames
+                  << " dropped_bytes=" << stats.dropped_bytes << " corrupted=" << stats.corrupted
+                  << " stalls=" << stats.stalls << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,314 @@
+#include "fleet.hpp"
+#include "reactor.hpp"
+#include "register_decode.hpp"
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+std::vector<int> all_ids() {
+    std::vector<int> ids(DATA_ID.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        ids[i] = static_cast<int>(i);
+    }
+    return ids;
+}
+
+void write_record(RecordWriter& records, const std::string& port, const RegisterImage& image) {
+    DecodedRegisters values;
+    decode_registers(image, values);
+    records.write(std::time(nullptr), port, values);
+}
+
+void run_session(const std::string& port, const FleetOptions& options,
+                 std::chrono::steady_clock::time_point deadline, FleetResult& result) {
+    auto start = std::chrono::steady_clock::now();
+    try {
+        M18 m18;
+        m18.set_timing_profile(options.timing);
+        m18.set_low_latency(options.low_latency);
+        m18.set_register_cache(options.cache);
+        m18.set_retest(options.retest);
+        m18.set_deadline(deadline);
+        if (!m18.connect(port)) {
+            throw std::runtime_error("failed to connect");
+        }
+        ReadCounts counts;
+        if (options.records) {
+            RegisterImage image = m18.read_registers(all_ids(), true, &counts);
+            result.health = decode_health(image);
+            write_record(*options.records, port, image);
+        } else {
+            result.health = m18.health(true, &counts);
+        }
+        m18.disconnect();
+        result.status = "ok";
+        if (counts.failed > 0) {
+            result.error = std::to_string(counts.failed) + " of " + std::to_string(counts.reads) + " reads failed";
+        }
+    } catch (const std::exception& e) {
+        // The M18 has been destroyed here, so the port is idle and closed
+        if (std::chrono::steady_clock::now() >= deadline) {
+            result.status = "timeout";
+            result.error = "session exceeded " + std::to_string(options.timeout.count()) + "s";
+        } else {
+            result.status = "error";
+            result.error = e.what();
+        }
+    }
+    result.elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+std::vector<std::string> find_fleet_ports() {
+    return M18::list_ports(true);
+}
+
+std::vector<FleetResult> run_fleet(const std::vector<std::string>& ports, const FleetOptions& options) {
+    // Every session runs concurrently, so one deadline covers them all.
+    // Each session enforces it itself, so every worker can be joined.
+    const auto deadline = std::chrono::steady_clock::now() + options.timeout;
+    std::vector<FleetResult> results(ports.size());
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < ports.size(); ++i) {
+        results[i].port = ports[i];
+        workers.emplace_back([&options, &ports, &results, deadline, i]() {
+            run_session(ports[i], options, deadline, results[i]);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return results;
+}
+
+std::vector<FleetResult> run_fleet_reactor(const std::vector<std::string>& ports, const FleetOptions& options) {
+    const std::vector<ReadSpan> plan = plan_reads(all_ids());
+    const auto deadline = std::chrono::steady_clock::now() + options.timeout;
+
+    std::vector<std::unique_ptr<BatterySession>> sessions;
+    SessionReactor reactor;
+    for (const auto& port : ports) {
+        sessions.push_back(std::make_unique<BatterySession>(port, plan, options.timing));
+        sessions.back()->set_deadline(deadline);
+        sessions.back()->set_low_latency(options.low_latency);
+        sessions.back()->set_register_cache(options.cache);
+        sessions.back()->set_retest(options.retest);
+        reactor.add(*sessions.back());
+    }
+    reactor.run();
+
+    std::vector<FleetResult> results;
+    for (const auto& session : sessions) {
+        FleetResult result;
+        result.port = session->port();
+        result.elapsed_seconds = session->elapsed_seconds();
+        if (session->state() == BatterySession::State::TimedOut) {
+            result.status = "timeout";
+            result.error = "session exceeded " + std::to_string(options.timeout.count()) + "s";
+        } else if (session->state() == BatterySession::State::Failed) {
+            result.status = "error";
+            result.error = session->error();
+        } else {
+            result.status = "ok";
+            if (session->failed_reads() > 0) {
+                result.error = std::to_string(session->failed_reads()) + " of " +
+                               std::to_string(session->read_count()) + " reads failed";
+            }
+            result.health = decode_health(session->image());
+            if (options.records) {
+                write_record(*options.records, result.port, session->image());
+            }
+        }
+        results.push_back(result);
+    }
+    return results;
+}
+
+ScanQueue::ScanQueue(std::vector<RegisterScanner> shards, std::string checkpoint)
+    : shards_(std::move(shards)), taken_(shards_.size(), false), checkpoint_(std::move(checkpoint)) {}
+
+bool ScanQueue::work(M18& m18, const std::string& name, const std::atomic<bool>* stop) {
+    // Checkpoint at most once a second; a resumed scan repeats at most that
+    // much work
+    constexpr auto SAVE_INTERVAL = std::chrono::seconds(1);
+
+    while (stop == nullptr || !stop->load()) {
+        size_t index = shards_.size();
+        RegisterScanner scanner(0, 1);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = 0; i < shards_.size(); ++i) {
+                if (!taken_[i] && !shards_[i].done()) {
+                    index = i;
+                    break;
+                }
+            }
+            if (index == shards_.size()) {
+                return true;
+            }
+            taken_[index] = true;
+            scanner = shards_[index];
+        }
+
+        uint32_t reported = scanner.next();
+        auto progress = [&](const RegisterScanner& s) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            shards_[index] = s;
+            if (s.next() / 0x1000 != reported / 0x1000 || s.done()) {
+                reported = s.next();
+                std::cerr << name << ": 0x" << std::hex << std::setw(4) << std::setfill('0')
+                          << std::min(s.next(), s.stop()) << std::dec << std::setfill(' ') << ", "
+                          << s.regions().size() << " regions, " << s.probes() << " reads" << std::endl;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (s.done() || now - saved_at_ >= SAVE_INTERVAL) {
+                save_locked();
+                saved_at_ = now;
+            }
+            return stop == nullptr || !stop->load();
+        };
+
+        try {
+            m18.scan(scanner, progress);
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::cerr << name << ": scan failed: " << e.what() << std::endl;
+            taken_[index] = false;
+            save_locked();
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        shards_[index] = scanner;
+        taken_[index] = false;
+        save_locked();
+    }
+    return true;
+}
+
+bool ScanQueue::done() const {
+    return shards_done() == shards_.size();
+}
+
+std::vector<ScanRegion> ScanQueue::regions() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return merge_scan_regions(shards_);
+}
+
+uint64_t ScanQueue::probes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t probes = 0;
+    for (const auto& shard : shards_) {
+        probes += shard.probes();
+    }
+    return probes;
+}
+
+size_t ScanQueue::shards_done() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t done = 0;
+    for (const auto& shard : shards_) {
+        done += shard.done();
+    }
+    return done;
+}
+
+bool ScanQueue::save() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return save_locked();
+}
+
+bool ScanQueue::save_locked() const {
+    return checkpoint_.empty() || save_scan_checkpoint(checkpoint_, shards_);
+}
+
+void run_sharded_scan(const std::vector<std::string>& ports, ScanQueue& queue, const TimingProfile& timing,
+                      bool low_latency, const std::atomic<bool>* stop) {
+    std::vector<std::thread> workers;
+    for (const auto& port : ports) {
+        workers.emplace_back([&queue, &timing, low_latency, stop, port]() {
+            try {
+                M18 m18;
+                m18.set_timing_profile(timing);
+                m18.set_low_latency(low_latency);
+                if (!m18.connect(port)) {
+                    throw std::runtime_error("failed to connect");
+                }
+                queue.work(m18, port, stop);
+                m18.disconnect();
+            } catch (const std::exception& e) {
+                std::cerr << port << ": " << e.what() << std::endl;
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+std::string json_string(const std::string& value) {
+    std::ostringstream out;
+    out << '"';
+    for (char c : value) {
+        switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+                } else {
+                    out << c;
+                }
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+void write_fleet_json(std::ostream& out, const std::vector<FleetResult>& results) {
+    size_t ok = 0;
+    for (const auto& r : results) {
+        ok += (r.status == "ok");
+    }
+
+    out << "{\n  \"ports\": " << results.size() << ",\n  \"ok\": " << ok
+        << ",\n  \"failed\": " << (results.size() - ok) << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        const auto& h = r.health;
+        out << (i ? "," : "") << "\n    {\"port\": " << json_string(r.port)
+            << ", \"status\": " << json_string(r.status)
+            << ", \"error\": " << json_string(r.error)
+            << ", \"elapsed_s\": " << std::fixed << std::setprecision(3) << r.elapsed_seconds
+            << std::defaultfloat << std::setprecision(6);
+        if (r.status == "ok") {
+            out << ", \"health\": {"
+                << "\"type\": " << json_string(h.type)
+                << ", \"model\": " << json_string(h.model)
+                << ", \"serial\": " << json_string(h.serial)
+                << ", \"manufacture_date\": " << json_string(h.manufacture_date)
+                << ", \"pack_voltage\": " << h.pack_voltage
+                << ", \"cell_imbalance_mv\": " << h.cell_imbalance
+                << ", \"temperature_c\": " << h.temperature
+                << ", \"forge_temperature_c\": " << h.forge_temperature
+                << ", \"charge_count_total\": " << h.charge_count_total
+                << ", \"total_discharge_ah\": " << h.total_discharge_ah
+                << ", \"discharge_cycles\": " << h.discharge_cycles
+                << ", \"discharge_to_empty\": " << h.discharge_to_empty
+                << ", \"overheat_events\": " << h.overheat_events
+                << ", \"overcurrent_events\": " << h.overcurrent_events
+                << "}";
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}" << std::endl;
+}
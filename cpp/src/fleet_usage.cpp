@@ -0,0 +1,361 @@
+#include "fleet_usage.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+// Export columns of a layout's counters (idN ... idN+buckets-1)
+template <size_t N>
+struct LayoutColumns {
+    std::array<const uint16_t*, N> counters{};
+    std::array<const uint8_t*, N> valid{};
+    bool present = false;
+};
+
+template <size_t N>
+LayoutColumns<N> map_layout(ColumnTable& table, const HistogramLayout& layout) {
+    LayoutColumns<N> columns;
+    for (size_t i = 0; i < N; ++i) {
+        const std::string name = "id" + std::to_string(layout.first_id() + i);
+        const ColumnSpec* spec = table.find(name);
+        if (spec == nullptr || spec->type != ColumnType::U16) {
+            return {};
+        }
+        columns.counters[i] = table.values<uint16_t>(name);
+        columns.valid[i] = table.validity(name);
+    }
+    columns.present = true;
+    return columns;
+}
+
+// A 16 bit counter stops here rather than wrapping; the value is real but
+// only a lower bound
+constexpr uint16_t SATURATED = UINT16_MAX;
+
+// A pack's counters; false if the layout is not exported or the row has
+// a null counter. Sets saturated if any counter is SATURATED.
+template <size_t N>
+bool read_row(const LayoutColumns<N>& columns, size_t row, BucketCounts<N>& counts, bool& saturated) {
+    if (!columns.present) {
+        return false;
+    }
+    bool stuck = false;
+    for (size_t i = 0; i < N; ++i) {
+        if (!validity_bit(columns.valid[i], row)) {
+            return false;
+        }
+        counts[i] = columns.counters[i][row];
+        stuck |= counts[i] == SATURATED;
+    }
+    saturated |= stuck;
+    return true;
+}
+
+struct GroupColumn {
+    const ColumnSpec* spec;
+    const void* data;
+    const uint8_t* valid;                     // Columns with a validity bitmap
+    const std::vector<std::string>* strings;  // Dict columns only
+};
+
+GroupColumn map_group_column(ColumnTable& table, const std::string& name) {
+    const ColumnSpec* spec = table.find(name);
+    if (spec == nullptr) {
+        throw std::invalid_argument("Unknown column: " + name);
+    }
+    if (spec->type == ColumnType::F32) {
+        throw std::invalid_argument("Cannot group by floating point column " + name);
+    }
+    GroupColumn column{spec, table.map(name), table.validity(name), nullptr};
+    if (spec->type == ColumnType::Dict) {
+        column.strings = &table.dictionary(name);
+    }
+    return column;
+}
+
+// Raw packed value, for telling groups apart. A null unsigned value is
+// moved above the 32 bit range so it differs from an all-ones one.
+uint64_t group_value(const GroupColumn& column, size_t row) {
+    if (column.valid != nullptr && !validity_bit(column.valid, row)) {
+        return uint64_t{1} << 32;
+    }
+    return dispatch_column_type(column.spec->type, [&](auto zero) {
+        using T = decltype(zero);
+        return static_cast<uint64_t>(static_cast<const T*>(column.data)[row]);
+    });
+}
+
+// The value as query --select prints it ("-" for null)
+std::string group_text(const GroupColumn& column, size_t row) {
+    if (column.strings != nullptr) {
+        const uint32_t code = static_cast<const uint32_t*>(column.data)[row];
+        return code < column.strings->size() ? (*column.strings)[code] : "-";
+    }
+    return dispatch_column_type(column.spec->type, [&](auto zero) -> std::string {
+        using T = decltype(zero);
+        const T* values = static_cast<const T*>(column.data);
+        if (!column_valid(values, column.valid, row)) {
+            return "-";
+        }
+        std::ostringstream text;
+        text << +values[row];
+        return text.str();
+    });
+}
+
+size_t high_current_bucket(int amps) {
+    const HistogramLayout& layout = DISCHARGE_CURRENT;
+    for (size_t i = 0; i < layout.buckets; ++i) {
+        if (layout.lower_edge(i) == amps) {
+            return i;
+        }
+    }
+    throw std::invalid_argument("High current must be a multiple of " + std::to_string(layout.width) + " A from " +
+                                std::to_string(layout.lower_edge(0)) + " to " +
+                                std::to_string(layout.lower_edge(layout.buckets - 1)));
+}
+
+double high_current_share(const PackUsage& usage, size_t bucket) {
+    const uint64_t total = usage.discharge.total();
+    return total > 0 ? static_cast<double>(usage.discharge.total(bucket)) / total : 0;
+}
+
+std::string percentage(double fraction) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1) << 100 * fraction << "%";
+    return text.str();
+}
+
+// H:MM:SS; fleet totals overflow the 32 bit seconds of hhmmss_string()
+std::string duration_text(uint64_t seconds) {
+    std::ostringstream text;
+    text << seconds / 3600 << ":" << std::setfill('0') << std::setw(2) << seconds / 60 % 60 << ":"
+         << std::setw(2) << seconds % 60;
+    return text.str();
+}
+
+template <size_t N>
+void print_histogram(std::ostream& out, const HistogramLayout& layout, const BucketCounts<N>& counts,
+                     const char* title, bool seconds) {
+    const uint64_t total = counts.total();
+    out << "  " << title << (seconds ? " (time)" : " (charges)") << ":\n";
+    for (size_t i = 0; i < N; ++i) {
+        const double fraction = total > 0 ? static_cast<double>(counts[i]) / total : 0;
+        out << "    " << std::setw(8) << layout.label(i) << ": " << std::setw(14)
+            << (seconds ? duration_text(counts[i]) : std::to_string(counts[i])) << " " << std::setw(6)
+            << percentage(fraction) << " " << std::string(static_cast<size_t>(std::lround(50 * fraction)), 'X')
+            << "\n";
+    }
+}
+
+} // namespace
+
+PackUsage& PackUsage::operator+=(const PackUsage& other) {
+    packs += other.packs;
+    high_current_packs += other.high_current_packs;
+    saturated_packs += other.saturated_packs;
+    discharge += other.discharge;
+    discharge_fine += other.discharge_fine;
+    charge_start += other.charge_start;
+    charge_end += other.charge_end;
+    return *this;
+}
+
+UsageResult aggregate_usage(ColumnTable& table, const UsageOptions& options) {
+    const auto start = std::chrono::steady_clock::now();
+    const size_t high_bucket = high_current_bucket(options.high_current);
+
+    QueryOptions query;
+    query.where = options.where;
+    query.latest_only = options.latest_only;
+    query.threads = options.threads;
+    query.max_rows = table.rows();
+    const std::vector<size_t> rows = run_query(table, query).rows;
+
+    // Map everything up front; the table is not shared safely while mapping
+    const auto discharge = map_layout<DischargeHistogram::size()>(table, DISCHARGE_CURRENT);
+    const auto discharge_fine = map_layout<FineDischargeHistogram::size()>(table, DISCHARGE_CURRENT_FINE);
+    const auto charge_start = map_layout<ChargeVoltageHistogram::size()>(table, CHARGE_START_VOLTAGE);
+    const auto charge_end = map_layout<ChargeVoltageHistogram::size()>(table, CHARGE_END_VOLTAGE);
+    std::vector<GroupColumn> group_columns;
+    for (const auto& name : options.group_by) {
+        group_columns.push_back(map_group_column(table, name));
+    }
+
+    // Group of every row, keyed by the raw values of the group columns
+    UsageResult result;
+    std::vector<uint32_t> group_of(rows.size());
+    std::unordered_map<std::string, uint32_t> groups;
+    std::string key(8 * group_columns.size(), '\0');
+    for (size_t r = 0; r < rows.size(); ++r) {
+        for (size_t c = 0; c < group_columns.size(); ++c) {
+            const uint64_t value = group_value(group_columns[c], rows[r]);
+            std::memcpy(&key[8 * c], &value, sizeof(value));
+        }
+        auto it = groups.find(key);
+        if (it == groups.end()) {
+            it = groups.emplace(key, static_cast<uint32_t>(result.groups.size())).first;
+            UsageGroup group;
+            for (const auto& column : group_columns) {
+                group.key.push_back(group_text(column, rows[r]));
+            }
+            result.groups.push_back(std::move(group));
+        }
+        group_of[r] = it->second;
+    }
+
+    const size_t chunk = 4096;
+    const size_t chunks = (rows.size() + chunk - 1) / chunk;
+    size_t threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max<size_t>(1, std::min(threads, chunks));
+
+    std::vector<std::vector<PackUsage>> partials(threads, std::vector<PackUsage>(result.groups.size()));
+    auto work = [&](size_t index) {
+        std::vector<PackUsage>& partial = partials[index];
+        const size_t first = rows.size() * index / threads;
+        const size_t last = rows.size() * (index + 1) / threads;
+        DischargeHistogram pack_discharge;
+        FineDischargeHistogram pack_fine;
+        ChargeVoltageHistogram pack_charge;
+        for (size_t r = first; r < last; ++r) {
+            const size_t row = rows[r];
+            PackUsage& usage = partial[group_of[r]];
+            bool saturated = false;
+            if (read_row(discharge, row, pack_discharge, saturated)) {
+                ++usage.packs;
+                usage.high_current_packs += pack_discharge.total(high_bucket) > 0;
+                usage.discharge += pack_discharge;
+            }
+            if (read_row(discharge_fine, row, pack_fine, saturated)) {
+                usage.discharge_fine += pack_fine;
+            }
+            if (read_row(charge_start, row, pack_charge, saturated)) {
+                usage.charge_start += pack_charge;
+            }
+            if (read_row(charge_end, row, pack_charge, saturated)) {
+                usage.charge_end += pack_charge;
+            }
+            usage.saturated_packs += saturated;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t) {
+        workers.emplace_back(work, t);
+    }
+    if (!rows.empty()) {
+        work(0);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (const auto& partial : partials) {
+        for (size_t g = 0; g < partial.size(); ++g) {
+            result.groups[g].usage += partial[g];
+        }
+    }
+    std::stable_sort(result.groups.begin(), result.groups.end(), [&](const UsageGroup& a, const UsageGroup& b) {
+        const double share_a = high_current_share(a.usage, high_bucket);
+        const double share_b = high_current_share(b.usage, high_bucket);
+        return share_a != share_b ? share_a > share_b : a.usage.packs > b.usage.packs;
+    });
+
+    result.rows = rows.size();
+    result.threads = rows.empty() ? 0 : threads;
+    result.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void print_usage_summary(std::ostream& out, const UsageOptions& options, const UsageResult& result) {
+    const size_t high_bucket = high_current_bucket(options.high_current);
+    out << result.groups.size() << (result.groups.size() == 1 ? " group, " : " groups, ") << result.rows
+        << (options.latest_only ? " packs" : " snapshots") << " (" << std::fixed << std::setprecision(2)
+        << result.elapsed_ms << " ms, " << result.threads << (result.threads == 1 ? " thread)" : " threads)")
+        << std::defaultfloat << std::setprecision(6) << std::endl;
+    if (result.groups.empty()) {
+        return;
+    }
+
+    std::vector<std::string> header = options.group_by;
+    if (header.empty()) {
+        header.push_back("fleet");
+    }
+    header.insert(header.end(), {"packs", "tool h"});
+    for (double p : options.percentiles) {
+        header.push_back("p" + std::to_string(static_cast<int>(std::lround(p * 100))));
+    }
+    const std::string high = ">=" + std::to_string(options.high_current) + "A";
+    header.insert(header.end(), {high + " time", high + " packs", "saturated"});
+
+    std::vector<std::vector<std::string>> cells;
+    for (const auto& group : result.groups) {
+        const PackUsage& usage = group.usage;
+        std::vector<std::string> row = group.key;
+        if (row.empty()) {
+            row.push_back("all");
+        }
+        std::ostringstream hours;
+        hours << std::fixed << std::setprecision(1) << usage.discharge.total() / 3600.0;
+        row.insert(row.end(), {std::to_string(usage.packs), hours.str()});
+        for (double p : options.percentiles) {
+            const size_t bucket = usage.discharge.percentile(p);
+            row.push_back(bucket < usage.discharge.size() ? DISCHARGE_CURRENT.label(bucket) : "-");
+        }
+        row.push_back(percentage(high_current_share(usage, high_bucket)));
+        row.push_back(percentage(usage.packs > 0 ? static_cast<double>(usage.high_current_packs) / usage.packs : 0));
+        row.push_back(std::to_string(usage.saturated_packs));
+        cells.push_back(std::move(row));
+    }
+
+    // Group keys left aligned, figures right aligned
+    const size_t key_columns = header.size() - 5 - options.percentiles.size();
+    std::vector<size_t> widths(header.size());
+    for (size_t c = 0; c < header.size(); ++c) {
+        widths[c] = header[c].size();
+        for (const auto& row : cells) {
+            widths[c] = std::max(widths[c], row[c].size());
+        }
+    }
+    auto print_row = [&](const std::vector<std::string>& row) {
+        for (size_t c = 0; c < row.size(); ++c) {
+            if (c < key_columns) {
+                out << std::left << std::setw(static_cast<int>(widths[c] + 2)) << row[c] << std::right;
+            } else {
+                out << std::setw(static_cast<int>(widths[c] + (c == key_columns ? 0 : 2))) << row[c];
+            }
+        }
+        out << "\n";
+    };
+    out << "\n";
+    print_row(header);
+    for (const auto& row : cells) {
+        print_row(row);
+    }
+    out << std::flush;
+}
+
+void print_usage_histograms(std::ostream& out, const UsageGroup& group) {
+    std::string name;
+    for (const auto& part : group.key) {
+        name += (name.empty() ? "" : ", ") + part;
+    }
+    out << "\n" << (name.empty() ? "all" : name) << " (" << group.usage.packs << " packs";
+    if (group.usage.saturated_packs > 0) {
+        out << ", " << group.usage.saturated_packs << " with saturated counters";
+    }
+    out << ")\n";
+    print_histogram(out, DISCHARGE_CURRENT, group.usage.discharge, "Discharge", true);
+    print_histogram(out, DISCHARGE_CURRENT_FINE, group.usage.discharge_fine, "Discharge, 5 A ranges", true);
+    print_histogram(out, CHARGE_START_VOLTAGE, group.usage.charge_start, "Charge started", false);
+    print_histogram(out, CHARGE_END_VOLTAGE, group.usage.charge_end, "Charge ended", false);
+    out << std::flush;
+}
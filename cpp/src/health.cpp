@@ -0,0 +1,173 @@
+#include "health.hpp"
+#include "record_writer.hpp"
+#include "register_decode.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+namespace {
+
+// Decode DATA_ID[Id] into value if the image holds all of its bytes
+template <size_t Id, typename T>
+bool decode_into(const RegisterImage& image, T& value) {
+    const uint8_t* data = image.data(DATA_ID[Id].addr, DATA_ID[Id].length);
+    if (data == nullptr) {
+        return false;
+    }
+    value = static_cast<T>(decode_id<Id>(data));
+    return true;
+}
+
+// Whole days from then to now, rounded down like python's timedelta.days
+int days_between(uint32_t then, uint32_t now) {
+    int64_t diff = static_cast<int64_t>(now) - static_cast<int64_t>(then);
+    return static_cast<int>(diff >= 0 ? diff / 86400 : -((-diff + 86399) / 86400));
+}
+
+} // namespace
+
+BatteryHealth decode_health(const RegisterImage& image) {
+    BatteryHealth health;
+    float capacity = 0;
+
+    if (const uint8_t* data = image.data(DATA_ID[2].addr, DATA_ID[2].length)) {
+        SerialNumber sn = decode_id<2>(data);
+        health.type = std::to_string(sn.type);
+        health.serial = std::to_string(sn.serial);
+        if (const BatteryModel* model = find_battery(sn.type)) {
+            health.model = model->name;
+            capacity = model->capacity;
+        }
+    }
+
+    uint32_t date = 0;
+    if (decode_into<4>(image, date)) {
+        health.manufacture_date = date_string(date, false);
+    }
+    decode_into<28>(image, health.days_since_first_charge);
+
+    // Elapsed days are relative to the pack's own clock, not the host's
+    uint32_t now = 0;
+    if (decode_into<8>(image, now)) {
+        if (decode_into<25>(image, date)) {
+            health.days_since_last_use = days_between(date, now);
+        }
+        if (decode_into<26>(image, date)) {
+            health.days_since_last_charge = days_between(date, now);
+        }
+    }
+
+    if (const uint8_t* data = image.data(DATA_ID[12].addr, DATA_ID[12].length)) {
+        CellArray cells = decode_id<12>(data);
+        health.cell_voltages.voltages.assign(cells.begin(), cells.end());
+        uint32_t total = 0;
+        for (uint16_t mv : cells) {
+            total += mv;
+        }
+        health.pack_voltage = total / 1000.0f;
+        auto [low, high] = std::minmax_element(cells.begin(), cells.end());
+        health.cell_imbalance = static_cast<float>(*high - *low);
+    }
+
+    // Only one of the two sensors reads non-zero on a given pack
+    if (const uint8_t* data = image.data(DATA_ID[13].addr, DATA_ID[13].length)) {
+        if (read_be(data, DATA_ID[13].length) != 0) {
+            health.temperature = decode_id<13>(data);
+        }
+    }
+    if (const uint8_t* data = image.data(DATA_ID[18].addr, DATA_ID[18].length)) {
+        if (read_be(data, DATA_ID[18].length) != 0) {
+            health.forge_temperature = decode_id<18>(data);
+        }
+    }
+
+    decode_into<33>(image, health.charge_count_redlink);
+    decode_into<32>(image, health.charge_count_dumb);
+    decode_into<31>(image, health.charge_count_total);
+    uint32_t seconds = 0;
+    if (decode_into<35>(image, seconds)) {
+        health.total_charge_time = hhmmss_string(seconds);
+    }
+    if (decode_into<36>(image, seconds)) {
+        health.idle_on_charger_time = hhmmss_string(seconds);
+    }
+    decode_into<38>(image, health.low_voltage_charges);
+
+    uint32_t amp_seconds = 0;
+    if (decode_into<29>(image, amp_seconds)) {
+        health.total_discharge_ah = amp_seconds / 3600.0f;
+        if (capacity > 0) {
+            health.discharge_cycles = health.total_discharge_ah / capacity;
+        }
+    }
+    decode_into<39>(image, health.discharge_to_empty);
+    decode_into<40>(image, health.overheat_events);
+    decode_into<41>(image, health.overcurrent_events);
+    decode_into<42>(image, health.low_voltage_events);
+    decode_into<43>(image, health.low_voltage_bounce);
+
+    DischargeHistogram buckets;
+    if (decode_histogram(image, DISCHARGE_CURRENT, buckets)) {
+        health.current_buckets = buckets;
+        health.total_time_on_tool = hhmmss_string(static_cast<uint32_t>(buckets.total()));
+    }
+    return health;
+}
+
+void print_health(std::ostream& out, const BatteryHealth& health) {
+    out << "Type: " << health.type << " [" << (health.model.empty() ? "Unknown" : health.model) << "]\n"
+        << "E-serial: " << health.serial << " (does NOT match case serial)\n"
+        << "Manufacture date: " << health.manufacture_date << "\n"
+        << "Days since 1st charge: " << health.days_since_first_charge << "\n"
+        << "Days since last tool use: " << health.days_since_last_use << "\n"
+        << "Days since last charge: " << health.days_since_last_charge << "\n"
+        << "Pack voltage: " << std::fixed << std::setprecision(3) << health.pack_voltage << "\n"
+        << std::defaultfloat << std::setprecision(6) << "Cell Voltages (mV): [";
+    for (size_t i = 0; i < health.cell_voltages.voltages.size(); ++i) {
+        out << (i ? ", " : "") << health.cell_voltages.voltages[i];
+    }
+    out << "]\n"
+        << "Cell Imbalance (mV): " << health.cell_imbalance << "\n";
+    if (health.temperature != 0) {
+        out << "Temperature (deg C): " << health.temperature << "\n";
+    }
+    if (health.forge_temperature != 0) {
+        out << "Temperature (deg C): " << std::fixed << std::setprecision(2) << health.forge_temperature
+            << std::defaultfloat << std::setprecision(6) << "\n";
+    }
+
+    out << "\nCHARGING STATS:\n"
+        << "Charge count [Redlink, dumb, (total)]: " << health.charge_count_redlink << ", "
+        << health.charge_count_dumb << ", (" << health.charge_count_total << ")\n"
+        << "Total charge time: " << health.total_charge_time << "\n"
+        << "Time idling on charger: " << health.idle_on_charger_time << "\n"
+        << "Low-voltage charges (any cell <2.5V): " << health.low_voltage_charges << "\n";
+
+    out << "\nTOOL USE STATS:\n"
+        << "Total discharge (Ah): " << std::fixed << std::setprecision(2) << health.total_discharge_ah << "\n"
+        << "Total discharge cycles: ";
+    if (health.model.empty()) {
+        out << "Unknown battery type, unable to calculate\n";
+    } else {
+        out << health.discharge_cycles << "\n";
+    }
+    out << std::defaultfloat << std::setprecision(6)
+        << "Times discharged to empty: " << health.discharge_to_empty << "\n"
+        << "Times overheated: " << health.overheat_events << "\n"
+        << "Overcurrent events: " << health.overcurrent_events << "\n"
+        << "Low-voltage events: " << health.low_voltage_events << "\n"
+        << "Low-voltage bounce/stutter: " << health.low_voltage_bounce << "\n"
+        << "Total time on tool (>10A): " << health.total_time_on_tool << "\n";
+
+    if (health.current_buckets) {
+        const DischargeHistogram& buckets = *health.current_buckets;
+        const uint64_t tool_time = buckets.total();
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            int pct = tool_time > 0 ? static_cast<int>(std::lround(100.0 * buckets[i] / tool_time)) : 0;
+            out << "Time @ " << std::setw(8) << DISCHARGE_CURRENT.label(i) << ": "
+                << hhmmss_string(static_cast<uint32_t>(buckets[i])) << " " << std::setw(2) << pct << "% "
+                << std::string(static_cast<size_t>(pct), 'X') << "\n";
+        }
+    }
+    out << std::flush;
+}
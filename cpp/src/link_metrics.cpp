@@ -0,0 +1,198 @@
+#include "link_metrics.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+// Prometheus bucket boundaries: every power of two from 64us to ~16.8s.
+// They coincide with histogram bucket edges, so cumulative counts are exact.
+constexpr int FIRST_LE_SHIFT = 6;
+constexpr int LAST_LE_SHIFT = 24;
+
+std::string label_value(const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+} // namespace
+
+size_t LatencyHistogram::bucket_of(uint64_t micros) {
+    micros = std::min(micros, MAX_VALUE);
+    if (micros < SUB_BUCKETS) {
+        return static_cast<size_t>(micros);
+    }
+    int msb = 63 - __builtin_clzll(micros);
+    int shift = msb - SUB_BITS;
+    size_t sub = static_cast<size_t>((micros >> shift) - SUB_BUCKETS);
+    return SUB_BUCKETS + static_cast<size_t>(shift) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucket_end(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index + 1;
+    }
+    size_t shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+    uint64_t sub = (index - SUB_BUCKETS) % SUB_BUCKETS;
+    return (SUB_BUCKETS + sub + 1) << shift;
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+    ++counts_[bucket_of(micros)];
+    ++count_;
+    sum_ += micros;
+    min_ = std::min(min_, micros);
+    max_ = std::max(max_, micros);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+}
+
+void LatencyHistogram::clear() {
+    *this = LatencyHistogram();
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::max(1.0, p * count_ + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::min(bucket_end(i) - 1, max_);
+        }
+    }
+    return max_;
+}
+
+uint64_t LatencyHistogram::count_below(uint64_t limit) const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKETS && bucket_end(i) <= limit; ++i) {
+        total += counts_[i];
+    }
+    return total;
+}
+
+void LinkMetrics::merge(const LinkMetrics& other) {
+    for (size_t i = 0; i < commands_.size(); ++i) {
+        CommandMetrics& a = commands_[i];
+        const CommandMetrics& b = other.commands_[i];
+        a.latency.merge(b.latency);
+        a.requests += b.requests;
+        a.bytes_tx += b.bytes_tx;
+        a.bytes_rx += b.bytes_rx;
+        a.timeouts += b.timeouts;
+        a.error_responses += b.error_responses;
+        a.checksum_failures += b.checksum_failures;
+        a.retries += b.retries;
+    }
+}
+
+void LinkMetrics::clear() {
+    commands_ = {};
+}
+
+void LinkMetrics::write_prometheus(std::ostream& out, const std::string& port) const {
+    const std::string port_label = port.empty() ? "" : "port=\"" + label_value(port) + "\",";
+
+    struct Counter {
+        const char* name;
+        const char* help;
+        uint64_t CommandMetrics::*member;
+    };
+    static const Counter COUNTERS[] = {
+        {"m18_requests_total", "Commands sent", &CommandMetrics::requests},
+        {"m18_tx_bytes_total", "Bytes written to the pack", &CommandMetrics::bytes_tx},
+        {"m18_rx_bytes_total", "Bytes received from the pack", &CommandMetrics::bytes_rx},
+        {"m18_timeouts_total", "Responses missing or short", &CommandMetrics::timeouts},
+        {"m18_error_responses_total", "0x82 error responses", &CommandMetrics::error_responses},
+        {"m18_checksum_failures_total", "Responses with a bad checksum", &CommandMetrics::checksum_failures},
+        {"m18_retries_total", "Transactions retried after a failure", &CommandMetrics::retries},
+    };
+
+    for (const auto& counter : COUNTERS) {
+        out << "# HELP " << counter.name << " " << counter.help << "\n";
+        out << "# TYPE " << counter.name << " counter\n";
+        for (size_t i = 0; i < commands_.size(); ++i) {
+            out << counter.name << "{" << port_label << "command=\""
+                << link_command_name(static_cast<LinkCommand>(i)) << "\"} "
+                << commands_[i].*counter.member << "\n";
+        }
+    }
+
+    const auto precision = out.precision();
+    out << "# HELP m18_latency_seconds Last byte sent to last byte received\n";
+    out << "# TYPE m18_latency_seconds histogram\n";
+    for (size_t i = 0; i < commands_.size(); ++i) {
+        const LatencyHistogram& h = commands_[i].latency;
+        const std::string labels = port_label + "command=\"" +
+                                   link_command_name(static_cast<LinkCommand>(i)) + "\"";
+        for (int shift = FIRST_LE_SHIFT; shift <= LAST_LE_SHIFT; ++shift) {
+            uint64_t limit = 1ull << shift;
+            out << "m18_latency_seconds_bucket{" << labels << ",le=\"" << std::fixed << std::setprecision(6)
+                << limit / 1e6 << std::defaultfloat << "\"} " << h.count_below(limit) << "\n";
+        }
+        out << "m18_latency_seconds_bucket{" << labels << ",le=\"+Inf\"} " << h.count() << "\n";
+        out << "m18_latency_seconds_sum{" << labels << "} " << std::fixed << std::setprecision(6)
+            << h.sum() / 1e6 << std::defaultfloat << "\n";
+        out << "m18_latency_seconds_count{" << labels << "} " << h.count() << "\n";
+    }
+    out.precision(precision);
+}
+
+void LinkMetrics::write_json(std::ostream& out) const {
+    const auto precision = out.precision();
+    out << "{";
+    for (size_t i = 0; i < commands_.size(); ++i) {
+        const CommandMetrics& m = commands_[i];
+        const LatencyHistogram& h = m.latency;
+        out << (i ? "," : "") << "\n  \"" << link_command_name(static_cast<LinkCommand>(i)) << "\": {"
+            << "\"requests\": " << m.requests
+            << ", \"bytes_tx\": " << m.bytes_tx
+            << ", \"bytes_rx\": " << m.bytes_rx
+            << ", \"timeouts\": " << m.timeouts
+            << ", \"error_responses\": " << m.error_responses
+            << ", \"checksum_failures\": " << m.checksum_failures
+            << ", \"retries\": " << m.retries
+            << ", \"latency_us\": {\"count\": " << h.count()
+            << ", \"min\": " << h.min()
+            << ", \"mean\": " << std::fixed << std::setprecision(1) << h.mean() << std::defaultfloat
+            << ", \"p50\": " << h.percentile(0.50)
+            << ", \"p90\": " << h.percentile(0.90)
+            << ", \"p99\": " << h.percentile(0.99)
+            << ", \"max\": " << h.max() << "}}";
+    }
+    out << "\n}" << std::endl;
+    out.precision(precision);
+}
+
+bool LinkMetrics::save(const std::string& path, const std::string& port) const {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot write metrics: " << path << std::endl;
+        return false;
+    }
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (json) {
+        write_json(out);
+    } else {
+        write_prometheus(out, port);
+    }
+    return static_cast<bool>(out);
+}
@@ -1,5 +1,8 @@
 #include "m18.hpp"
 #include "serial_port.hpp"
+#include "periodic_timer.hpp"
+#include "record_writer.hpp"
+#include "register_decode.hpp"
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -7,8 +10,27 @@
 #include <chrono>
 #include <thread>
 #include <algorithm>
+#include <numeric>
 #include <cmath>
+#include <cstring>
 #include <dirent.h>
+#include <unistd.h>
+
+namespace {
+
+// Argument-less commands, precomputed on the wire for each acc value
+constexpr auto SNAP_FRAMES = frame_codec::make_short_frames(M18::SNAP_CMD);
+constexpr auto KEEPALIVE_FRAMES = frame_codec::make_short_frames(M18::KEEPALIVE_CMD);
+constexpr auto CAL_FRAMES = frame_codec::make_short_frames(M18::CAL_CMD);
+
+// Attempts per register read before it is reported as failed. The first
+// failure is followed by a resync, the second by a full reset().
+constexpr int READ_ATTEMPTS = 3;
+
+// The line must stay quiet this long before a resync sends its sync byte
+constexpr auto RESYNC_QUIET = std::chrono::milliseconds(20);
+
+} // namespace
 
 M18::M18(const std::string& port)
     : connected_(false), acc_(4) {
@@ -26,6 +48,7 @@ M18::~M18() {
 bool M18::connect(const std::string& port) {
     try {
         port_ = std::make_unique<SerialPort>(port, 4800, 0.8);
+        port_->set_low_latency(low_latency_);
         port_->open();
         connected_ = true;
         idle();
@@ -48,7 +71,7 @@ bool M18::is_connected() const {
     return connected_ && port_ && port_->is_open();
 }
 
-std::string M18::select_port() {
+std::vector<std::string> M18::list_ports(bool usb_only) {
     DIR* dev = opendir("/dev");
     if (!dev) {
         throw std::runtime_error("Cannot open /dev directory");
@@ -61,12 +84,18 @@ std::string M18::select_port() {
         std::string name = entry->d_name;
         if (name.find("ttyUSB") != std::string::npos || 
             name.find("ttyACM") != std::string::npos ||
-            name.find("ttyS") != std::string::npos) {
+            (!usb_only && name.find("ttyS") != std::string::npos)) {
             ports.push_back("/dev/" + name);
         }
     }
     closedir(dev);
 
+    std::sort(ports.begin(), ports.end());
+    return ports;
+}
+
+std::string M18::select_port() {
+    std::vector<std::string> ports = list_ports();
     if (ports.empty()) {
         throw std::runtime_error("No serial ports found");
     }
@@ -94,98 +123,118 @@ std::string M18::select_port() {
 }
 
 uint8_t M18::reverse_bits(uint8_t byte) {
-    uint8_t result = 0;
-    for (int i = 0; i < 8; ++i) {
-        result = (result << 1) | (byte & 1);
-        byte >>= 1;
-    }
-    return result;
+    return frame_codec::reverse_bits(byte);
 }
 
 uint16_t M18::checksum(const std::vector<uint8_t>& payload) {
-    uint16_t sum = 0;
-    for (uint8_t byte : payload) {
-        sum += byte;
-    }
-    return sum;
+    return frame_codec::checksum(payload.data(), payload.size());
 }
 
-std::vector<uint8_t> M18::add_checksum(std::vector<uint8_t> lsb_command) {
-    uint16_t csum = checksum(lsb_command);
-    lsb_command.push_back((csum >> 8) & 0xFF);
-    lsb_command.push_back(csum & 0xFF);
-    return lsb_command;
+void M18::update_acc() {
+    acc_ = frame_codec::ACC_VALUES[(frame_codec::acc_index(acc_) + 1) % frame_codec::ACC_VALUES.size()];
 }
 
-void M18::update_acc() {
-    static const std::vector<uint8_t> acc_values = {0x04, 0x0C, 0x1C};
-    auto it = std::find(acc_values.begin(), acc_values.end(), acc_);
-    if (it != acc_values.end()) {
-        int index = std::distance(acc_values.begin(), it);
-        acc_ = acc_values[(index + 1) % acc_values.size()];
+void M18::pause(TimingProfile::usec duration) {
+    if (duration.count() > 0) {
+        std::this_thread::sleep_until(std::min(std::chrono::steady_clock::now() + duration, deadline_));
     }
 }
 
-void M18::send(const std::vector<uint8_t>& command) {
+void M18::print_bytes(const char* prefix, const uint8_t* data, size_t length) {
+    std::cout << prefix;
+    for (size_t i = 0; i < length; ++i) {
+        std::cout << std::hex << std::setw(2) << std::setfill('0') << (int)data[i] << " ";
+    }
+    std::cout << std::dec << std::endl;
+}
+
+void M18::send_wire(const uint8_t* wire, size_t length, LinkCommand command) {
     if (!is_connected()) {
         throw std::runtime_error("Not connected to serial port");
     }
+    if (deadline_passed()) {
+        throw std::runtime_error("Session deadline passed");
+    }
 
     port_->reset_input_buffer();
 
-    std::vector<uint8_t> msb_command;
-    for (uint8_t byte : command) {
-        msb_command.push_back(reverse_bits(byte));
-    }
-
     if (print_tx) {
-        std::cout << "Sending:  ";
-        for (uint8_t byte : command) {
-            std::cout << std::hex << std::setw(2) << std::setfill('0') << (int)byte << " ";
-        }
-        std::cout << std::dec << std::endl;
+        uint8_t lsb_command[frame_codec::MAX_FRAME];
+        std::copy(wire, wire + length, lsb_command);
+        frame_codec::reverse_in_place(lsb_command, length);
+        print_bytes("Sending:  ", lsb_command, length);
     }
 
-    port_->write(msb_command);
+    port_->write(wire, length);
+
+    command_ = command;
+    sent_at_ = std::chrono::steady_clock::now();
+    CommandMetrics& metrics = metrics_[command];
+    ++metrics.requests;
+    metrics.bytes_tx += length;
+}
+
+void M18::send(const std::vector<uint8_t>& command) {
+    uint8_t wire[frame_codec::MAX_FRAME];
+    size_t length = std::min(command.size(), sizeof(wire));
+    std::copy(command.begin(), command.begin() + length, wire);
+    frame_codec::reverse_in_place(wire, length);
+    send_wire(wire, length);
 }
 
-void M18::send_command(std::vector<uint8_t> command) {
-    send(add_checksum(command));
+void M18::send_command(const uint8_t* command, size_t length, LinkCommand type) {
+    uint8_t wire[frame_codec::MAX_FRAME];
+    send_wire(wire, frame_codec::encode(command, length, wire), type);
 }
 
-std::vector<uint8_t> M18::read_response(size_t size) {
+void M18::send_command(const std::vector<uint8_t>& command) {
+    send_command(command.data(), command.size());
+}
+
+size_t M18::receive(uint8_t* response, size_t size) {
     if (!is_connected()) {
         throw std::runtime_error("Not connected to serial port");
     }
 
-    auto msb_response = port_->read(1);
-    if (msb_response.empty()) {
+    // Each part of the frame gets the full timeout, but returns as soon as
+    // the expected number of bytes has arrived
+    CommandMetrics& metrics = metrics_[command_];
+    const auto timeout = timing_.response_timeout;
+    if (port_->read_exact(response, 1, std::min(SerialPort::Clock::now() + timeout, deadline_)) == 0) {
+        ++metrics.timeouts;
         throw std::runtime_error("Empty response");
     }
 
-    if (reverse_bits(msb_response[0]) == 0x82) {
-        auto next = port_->read(1);
-        msb_response.insert(msb_response.end(), next.begin(), next.end());
-    } else {
-        auto rest = port_->read(size - 1);
-        msb_response.insert(msb_response.end(), rest.begin(), rest.end());
-    }
+    size_t remaining = (reverse_bits(response[0]) == 0x82) ? 1 : (size > 0 ? size - 1 : 0);
+    size_t got = 1 + port_->read_exact(response + 1, remaining,
+                                       std::min(SerialPort::Clock::now() + timeout, deadline_));
+    frame_codec::reverse_in_place(response, got);
 
-    std::vector<uint8_t> lsb_response;
-    for (uint8_t byte : msb_response) {
-        lsb_response.push_back(reverse_bits(byte));
+    metrics.bytes_rx += got;
+    if (got < remaining + 1) {
+        ++metrics.timeouts;
+    } else {
+        auto latency = std::chrono::steady_clock::now() - sent_at_;
+        metrics.latency.record(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+        if (response[0] == 0x82) {
+            ++metrics.error_responses;
+        } else if (got > frame_codec::HEADER_SIZE && !frame_codec::checksum_ok(response, got)) {
+            ++metrics.checksum_failures;
+        }
     }
 
     if (print_rx) {
-        std::cout << "Received: ";
-        for (uint8_t byte : lsb_response) {
-            std::cout << std::hex << std::setw(2) << std::setfill('0') << (int)byte << " ";
-        }
-        std::cout << std::dec << std::endl;
+        print_bytes("Received: ", response, got);
     }
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
-    return lsb_response;
+    pause(timing_.frame_gap(size));
+    return got;
+}
+
+std::vector<uint8_t> M18::read_response(size_t size) {
+    std::vector<uint8_t> response(std::max<size_t>(size, 2));
+    response.resize(receive(response.data(), size));
+    return response;
 }
 
 bool M18::reset() {
@@ -193,30 +242,61 @@ bool M18::reset() {
     try {
         port_->set_break(true);
         port_->set_dtr(true);
-        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        pause(timing_.break_hold);
         port_->set_break(false);
         port_->set_dtr(false);
-        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        pause(timing_.break_recovery);
         
-        send(std::vector<uint8_t>{SYNC_BYTE});
-        auto response = read_response(1);
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const uint8_t sync = frame_codec::reverse_bits(SYNC_BYTE);
+        send_wire(&sync, 1, LinkCommand::Reset);
+        uint8_t response[2];
+        size_t got = receive(response, 1);
+        pause(timing_.sync_settle);
         
-        return !response.empty() && response[0] == SYNC_BYTE;
+        return got > 0 && response[0] == SYNC_BYTE;
     } catch (const std::exception& e) {
         std::cerr << "Reset failed: " << e.what() << std::endl;
         return false;
     }
 }
 
+bool M18::resync() {
+    // Let any late or partial response finish arriving, then drop it
+    try {
+        uint8_t discard[64];
+        for (int i = 0; i < 32; ++i) {
+            if (port_->read_exact(discard, sizeof(discard), std::min(SerialPort::Clock::now() + RESYNC_QUIET, deadline_)) == 0) {
+                break;
+            }
+        }
+
+        const uint8_t sync = frame_codec::reverse_bits(SYNC_BYTE);
+        send_wire(&sync, 1, LinkCommand::Resync);
+        uint8_t response[2];
+        size_t got = receive(response, 1);
+        pause(timing_.sync_settle);
+
+        return got > 0 && response[0] == SYNC_BYTE;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+size_t M18::cmd_into(uint8_t a, uint8_t b, uint8_t c, uint16_t length, uint8_t command, uint8_t* response) {
+    const uint8_t frame[] = {command, 0x04, 0x03, a, b, c};
+    send_command(frame, sizeof(frame));
+    return receive(response, length);
+}
+
 std::vector<uint8_t> M18::cmd(uint8_t a, uint8_t b, uint8_t c, uint16_t length, uint8_t command) {
-    send_command({command, 0x04, 0x03, a, b, c});
-    return read_response(length);
+    std::vector<uint8_t> response(std::max<uint16_t>(length, 2));
+    response.resize(cmd_into(a, b, c, length, command, response.data()));
+    return response;
 }
 
 std::vector<uint8_t> M18::configure(uint8_t state) {
     acc_ = 4;
-    std::vector<uint8_t> cmd = {
+    const uint8_t cmd[] = {
         CONF_CMD, acc_, 8,
         static_cast<uint8_t>((CUTOFF_CURRENT >> 8) & 0xFF),
         static_cast<uint8_t>(CUTOFF_CURRENT & 0xFF),
@@ -226,25 +306,215 @@ std::vector<uint8_t> M18::configure(uint8_t state) {
         static_cast<uint8_t>(MAX_CURRENT & 0xFF),
         state, 13
     };
-    send_command(cmd);
+    send_command(cmd, sizeof(cmd), LinkCommand::Configure);
     return read_response(5);
 }
 
+size_t M18::short_command(const std::array<frame_codec::ShortFrame, 3>& frames, LinkCommand command,
+                          bool advance_acc, uint8_t* response, size_t size) {
+    const auto& frame = frames[frame_codec::acc_index(acc_)];
+    send_wire(frame.data(), frame.size(), command);
+    if (advance_acc) {
+        update_acc();
+    }
+    return receive(response, size);
+}
+
 std::vector<uint8_t> M18::get_snapchat() {
-    send_command({SNAP_CMD, acc_, 0});
-    update_acc();
-    return read_response(8);
+    std::vector<uint8_t> response(8);
+    response.resize(short_command(SNAP_FRAMES, LinkCommand::Snapchat, true, response.data(), response.size()));
+    return response;
 }
 
 std::vector<uint8_t> M18::keepalive() {
-    send_command({KEEPALIVE_CMD, acc_, 0});
-    return read_response(9);
+    std::vector<uint8_t> response(9);
+    response.resize(short_command(KEEPALIVE_FRAMES, LinkCommand::Keepalive, false, response.data(), response.size()));
+    return response;
 }
 
 std::vector<uint8_t> M18::calibrate() {
-    send_command({CAL_CMD, acc_, 0});
-    update_acc();
-    return read_response(8);
+    std::vector<uint8_t> response(8);
+    response.resize(short_command(CAL_FRAMES, LinkCommand::Calibrate, true, response.data(), response.size()));
+    return response;
+}
+
+void M18::set_timing_profile(const TimingProfile& profile) {
+    timing_ = profile;
+}
+
+const TimingProfile& M18::timing_profile() const {
+    return timing_;
+}
+
+bool M18::probe_read(uint16_t addr, uint16_t length) {
+    try {
+        auto response = cmd((addr >> 8) & 0xFF, addr & 0xFF, length, length + 5);
+        return response.size() == length + 5u && response[0] == 0x81;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+TimingProfile M18::characterize_link(int trials) {
+    using usec = TimingProfile::usec;
+
+    if (!is_connected()) {
+        throw std::runtime_error("Not connected to serial port");
+    }
+
+    // Candidates are tried longest first; the shortest one that passes every
+    // trial wins. The refresh settle time cannot be observed from the link and
+    // keeps its default.
+    static const long BREAK_CANDIDATES_US[] = {300000, 200000, 150000, 100000, 50000, 20000, 10000};
+    static const long GAP_CANDIDATES_US[] = {50000, 30000, 20000, 10000, 5000, 2000, 1000, 0};
+    constexpr uint16_t SHORT_ADDR = 0x0000, SHORT_LEN = 0x02;
+    constexpr uint16_t LONG_ADDR = 0x9000, LONG_LEN = 0x3A;
+
+    const TimingProfile saved = timing_;
+    bool print_tx_save = print_tx;
+    bool print_rx_save = print_rx;
+    print_tx = print_rx = false;
+
+    timing_ = TimingProfile();
+    TimingProfile result = timing_;
+    result.adapter = port_->port_name() + " (" + adapter_chip_name(port_->adapter().chip) + ")";
+    auto worst_latency = usec(0);
+
+    auto resets_ok = [&]() {
+        for (int i = 0; i < trials; ++i) {
+            if (!reset()) {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto reads_ok = [&](uint16_t addr, uint16_t length) {
+        if (!reset()) {
+            return false;
+        }
+        for (int i = 0; i < trials; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            if (!probe_read(addr, length)) {
+                return false;
+            }
+            auto elapsed = std::chrono::duration_cast<usec>(std::chrono::steady_clock::now() - start);
+            worst_latency = std::max(worst_latency, elapsed - timing_.frame_gap(length + 5));
+        }
+        return true;
+    };
+    auto search = [&](const char* name, usec TimingProfile::*member,
+                      const long* candidates, size_t count, auto&& check) {
+        for (size_t i = 0; i < count; ++i) {
+            timing_.*member = usec(candidates[i]);
+            bool ok = check();
+            std::cout << "  " << std::setw(16) << std::left << name << std::right
+                      << std::setw(7) << candidates[i] << "us: " << (ok ? "ok" : "FAIL") << std::endl;
+            if (!ok) {
+                break;
+            }
+            result.*member = timing_.*member;
+        }
+        timing_.*member = result.*member;
+    };
+
+    std::cout << "Characterizing link on " << port_->port_name() << std::endl;
+    try {
+        constexpr size_t NUM_BREAK = sizeof(BREAK_CANDIDATES_US) / sizeof(BREAK_CANDIDATES_US[0]);
+        constexpr size_t NUM_GAP = sizeof(GAP_CANDIDATES_US) / sizeof(GAP_CANDIDATES_US[0]);
+
+        if (!resets_ok()) {
+            throw std::runtime_error("Battery does not respond with default timing");
+        }
+        search("break_hold", &TimingProfile::break_hold, BREAK_CANDIDATES_US, NUM_BREAK, resets_ok);
+        search("break_recovery", &TimingProfile::break_recovery, BREAK_CANDIDATES_US, NUM_BREAK, resets_ok);
+        search("sync_settle", &TimingProfile::sync_settle, GAP_CANDIDATES_US, NUM_GAP,
+               [&]() { return reads_ok(SHORT_ADDR, SHORT_LEN); });
+
+        // Turnaround after short and long responses gives a base plus per-byte cost
+        search("turnaround", &TimingProfile::turnaround, GAP_CANDIDATES_US, NUM_GAP,
+               [&]() { return reads_ok(SHORT_ADDR, SHORT_LEN); });
+        usec short_gap = result.turnaround;
+        timing_.turnaround = result.turnaround = TimingProfile().turnaround;
+        search("turnaround(long)", &TimingProfile::turnaround, GAP_CANDIDATES_US, NUM_GAP,
+               [&]() { return reads_ok(LONG_ADDR, LONG_LEN); });
+        usec long_gap = result.turnaround;
+        result.turnaround = short_gap;
+        result.turnaround_per_byte = std::max(usec(0), (long_gap - short_gap) / (LONG_LEN - SHORT_LEN));
+    } catch (...) {
+        idle();
+        timing_ = saved;
+        print_tx = print_tx_save;
+        print_rx = print_rx_save;
+        throw;
+    }
+
+    // Leave a safety margin of 50% (at least 1ms) on every measured gap
+    auto margin = [](usec value) { return value + std::max(value / 2, usec(1000)); };
+    result.break_hold = margin(result.break_hold);
+    result.break_recovery = margin(result.break_recovery);
+    result.sync_settle = margin(result.sync_settle);
+    result.turnaround = margin(result.turnaround);
+    result.response_timeout = std::max(usec(200000), worst_latency * 3);
+
+    idle();
+    timing_ = saved;
+    print_tx = print_tx_save;
+    print_rx = print_rx_save;
+
+    std::cout << "Worst response latency: " << worst_latency.count() << "us" << std::endl;
+    return result;
+}
+
+void M18::adapter_report(int trials) {
+    if (!is_connected()) {
+        throw std::runtime_error("Not connected to serial port");
+    }
+
+    const AdapterInfo& info = port_->adapter();
+    std::cout << "Adapter: " << adapter_chip_name(info.chip)
+              << " (driver " << (info.driver.empty() ? "unknown" : info.driver) << ") on " << info.tty << std::endl;
+    if (!info.latency_timer_path.empty()) {
+        std::cout << "  latency_timer:     " << info.latency_timer_ms << "ms";
+        if (info.original_latency_timer_ms != info.latency_timer_ms) {
+            std::cout << " (was " << info.original_latency_timer_ms << "ms, restored on disconnect)";
+        } else if (info.latency_timer_ms > 1) {
+            std::cout << " (could not lower it; check permissions)";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "  ASYNC_LOW_LATENCY: " << (info.low_latency ? "on" : "off") << std::endl;
+
+    if (!reset()) {
+        throw std::runtime_error("Battery did not respond to reset");
+    }
+
+    // A 2 byte read is 8 bytes out and 7 back; at 11 bits per byte (8N2)
+    // that time is spent on the wire whatever the adapter does
+    constexpr uint16_t LENGTH = 2;
+    const auto wire_time = std::chrono::microseconds((8 + LENGTH + 5) * 11 * 1000000LL / port_->baudrate());
+
+    std::vector<long> round_trip;
+    for (int i = 0; i < trials; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        if (!probe_read(0x0000, LENGTH)) {
+            continue;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start) - timing_.frame_gap(LENGTH + 5);
+        round_trip.push_back(elapsed.count());
+    }
+    idle();
+
+    if (round_trip.empty()) {
+        std::cout << "  No reads succeeded" << std::endl;
+        return;
+    }
+    std::sort(round_trip.begin(), round_trip.end());
+    long median = round_trip[round_trip.size() / 2];
+    std::cout << "  Round trip:        median " << median << "us, max " << round_trip.back()
+              << "us over " << round_trip.size() << " reads" << std::endl;
+    std::cout << "  Per-frame latency: " << std::max(0L, median - static_cast<long>(wire_time.count()))
+              << "us beyond " << wire_time.count() << "us of wire time" << std::endl;
 }
 
 void M18::high() {
@@ -268,49 +538,15 @@ void M18::high_for(int duration_seconds) {
 }
 
 std::string M18::bytes_to_date_string(const std::vector<uint8_t>& data) {
-    uint32_t epoch_time = 0;
-    for (size_t i = 0; i < std::min(size_t(4), data.size()); ++i) {
-        epoch_time = (epoch_time << 8) | data[i];
-    }
-
-    std::time_t time = epoch_time;
-    std::tm* tm = std::gmtime(&time);
-    char buffer[256];
-    std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", tm);
-    return std::string(buffer);
+    return date_string(read_be(data.data(), data.size()));
 }
 
 std::string M18::bytes_to_hhmmss(const std::vector<uint8_t>& data) {
-    uint32_t dur = 0;
-    for (size_t i = 0; i < std::min(size_t(4), data.size()); ++i) {
-        dur = (dur << 8) | data[i];
-    }
-
-    uint32_t ss = dur % 60;
-    dur /= 60;
-    uint32_t mm = dur % 60;
-    uint32_t hh = dur / 60;
-
-    std::stringstream ss_str;
-    ss_str << hh << ":" << std::setfill('0') << std::setw(2) << mm << ":" 
-           << std::setfill('0') << std::setw(2) << ss;
-    return ss_str.str();
+    return hhmmss_string(read_be(data.data(), data.size()));
 }
 
 float M18::calculate_temperature(uint16_t adc_value) {
-    constexpr float r1 = 10e3;
-    constexpr float r2 = 20e3;
-    constexpr float t1 = 50.0f;
-    constexpr float t2 = 35.0f;
-    constexpr uint16_t adc1 = 0x0180;
-    constexpr uint16_t adc2 = 0x022E;
-
-    float m = (t2 - t1) / (r2 - r1);
-    float b = t1 - m * r1;
-    float resistance = r1 + (adc_value - adc1) * (r2 - r1) / (adc2 - adc1);
-    float temperature = m * resistance + b;
-
-    return std::round(temperature * 100) / 100;
+    return adc_to_celsius(adc_value);
 }
 
 CellVoltages M18::extract_cell_voltages(const std::vector<uint8_t>& data) {
@@ -322,44 +558,278 @@ CellVoltages M18::extract_cell_voltages(const std::vector<uint8_t>& data) {
     return cv;
 }
 
+bool M18::read_span(const ReadSpan& span, uint8_t* response, bool* rejected) {
+    const size_t expected = span.length + 5u;
+    if (rejected != nullptr) {
+        *rejected = false;
+    }
+    for (int attempt = 0; attempt < READ_ATTEMPTS; ++attempt) {
+        if (attempt > 0) {
+            ++metrics_[LinkCommand::Cmd].retries;
+        }
+
+        size_t got = 0;
+        try {
+            got = cmd_into((span.addr >> 8) & 0xFF, span.addr & 0xFF, span.length, expected, 0x01, response);
+        } catch (const std::exception&) {
+            if (!is_connected()) {
+                throw;
+            }
+        }
+
+        if (got == expected && response[0] == 0x81 && response[2] == span.length &&
+            frame_codec::checksum_ok(response, got)) {
+            return true;
+        }
+        if (got == 2 && response[0] == 0x82) {
+            if (rejected != nullptr) {
+                *rejected = true;
+            }
+            return false;  // The pack rejected the address; the link is fine
+        }
+
+        // Timeout, short frame or bad checksum: the link may be out of step.
+        // Try the cheap resync first and only then the full break cycle.
+        if (attempt + 1 < READ_ATTEMPTS) {
+            bool synced = attempt == 0 && resync();
+            if (!synced && !reset()) {
+                throw std::runtime_error("Battery did not respond to reset");
+            }
+        }
+    }
+    return false;
+}
+
+size_t M18::fetch(const std::vector<ReadSpan>& plan, RegisterImage& image) {
+    size_t failed = 0;
+    uint8_t response[frame_codec::MAX_FRAME];
+    for (const auto& span : plan) {
+        if (read_span(span, response)) {
+            // Payload follows the 3 byte header; the merged buffer is sliced
+            // into individual registers by address when they are decoded
+            image.store(span.addr, response + 3, span.length);
+        } else {
+            ++failed;
+        }
+    }
+    return failed;
+}
+
+void M18::refresh(RegisterImage& image) {
+    // Reading DATA_MATRIX makes the pack update the 0x9000 block once the
+    // session ends. Keep everything the sweep returned, start a new session
+    // and drop only the regions that change so callers re-read just those.
+    fetch(data_matrix_reads(), image);
+    idle();
+    pause(timing_.refresh_settle);
+
+    if (!reset()) {
+        throw std::runtime_error("Battery did not respond to reset");
+    }
+    for (const auto& region : REGISTER_REGIONS) {
+        if (region.refreshed) {
+            image.invalidate(region.start, region.end - region.start);
+        }
+    }
+}
+
+bool M18::restore_cached(RegisterImage& image) {
+    return cache_ && cache_->restore(image);
+}
+
+void M18::remember_cached(const RegisterImage& image) {
+    if (cache_) {
+        cache_->remember(image);
+    }
+}
+
+RegisterImage M18::snapshot() {
+    // As read_all: the DATA_MATRIX sweep makes the pack update the 0x9000
+    // block, so the refreshed registers are read again after it
+    std::vector<int> ids(DATA_ID.size());
+    std::iota(ids.begin(), ids.end(), 0);
+    RegisterImage image = read_registers(ids, true);
+
+    size_t missing = 0;
+    for (int id : ids) {
+        if (!image.contains(DATA_ID[id].addr, DATA_ID[id].length)) {
+            ++missing;
+        }
+    }
+    if (missing > 0) {
+        std::cerr << "Warning: " << missing << " registers could not be read; snapshot is incomplete" << std::endl;
+    }
+    return image;
+}
+
+RegisterImage M18::read_registers(const std::vector<int>& ids, bool force_refresh, ReadCounts* counts) {
+    if (!reset()) {
+        throw std::runtime_error("Battery did not respond to reset");
+    }
+
+    // The cache is keyed by serial, so it is always read
+    std::vector<int> wanted = ids;
+    if (cache_) {
+        wanted.push_back(RegisterCache::SERIAL_ID);
+    }
+    const std::vector<ReadSpan> plan = plan_reads(wanted);
+
+    // Read the span holding the serial first, so the registers cached for
+    // the pack can be restored. A refresh sweep reads them anyway, so this
+    // is only done without one or in re-test mode, where a known pack then
+    // skips the sweep.
+    RegisterImage image;
+    bool cached = false;
+    if (cache_ && (!force_refresh || retest_)) {
+        const DataIdEntry& sn = DATA_ID[RegisterCache::SERIAL_ID];
+        for (const auto& span : plan) {
+            if (span.addr <= sn.addr && sn.addr + sn.length <= span.addr + span.length) {
+                fetch({span}, image);
+                break;
+            }
+        }
+        cached = restore_cached(image);
+    }
+    if (force_refresh && !cached) {
+        refresh(image);
+    }
+
+    // Read each planned span the image does not already hold. Spans are read
+    // whole, so cached registers never split a merged read.
+    std::vector<ReadSpan> missing;
+    for (const auto& span : plan) {
+        if (!image.contains(span.addr, span.length)) {
+            missing.push_back(span);
+        }
+    }
+    size_t failed = fetch(missing, image);
+    idle();
+    if (counts != nullptr) {
+        counts->reads = missing.size();
+        counts->failed = failed;
+    }
+    if (!cached) {
+        remember_cached(image);
+    }
+    return image;
+}
+
+DecodedRegisters M18::read_values(std::vector<int> ids, bool force_refresh) {
+    if (!is_connected()) {
+        throw std::runtime_error("Not connected to battery");
+    }
+    if (ids.empty()) {
+        for (size_t i = 0; i < DATA_ID.size(); ++i) {
+            ids.push_back(static_cast<int>(i));
+        }
+    }
+    RegisterImage image = read_registers(ids, force_refresh);
+    DecodedRegisters values{};
+    for (int id : ids) {
+        values[id] = decode_register(id, image);
+    }
+    return values;
+}
+
 void M18::read_id(std::vector<int> id_array, bool force_refresh, const std::string& output) {
-    // Implementation similar to Python version
-    // This is a simplified version - full implementation would be quite long
+    if (!is_connected()) {
+        throw std::runtime_error("Not connected to battery");
+    }
+
+    // If empty, default is print all
     if (id_array.empty()) {
-        // Read all - attempt to communicate with battery
-        if (!is_connected()) {
-            throw std::runtime_error("Not connected to battery");
+        for (size_t i = 0; i < DATA_ID.size(); ++i) {
+            id_array.push_back(static_cast<int>(i));
         }
-        
-        // Attempt to reset and read first register to verify battery is responding
-        if (!reset()) {
-            throw std::runtime_error("Battery did not respond to reset");
+    }
+
+    bool labelled = true;
+    if (output == "raw") {
+        labelled = false;
+    } else if (output != "label") {
+        std::cout << "Unrecognised 'output' = " << output << ". Please choose \"label\" or \"raw\"" << std::endl;
+    }
+
+    DecodedRegisters values = read_values(id_array, force_refresh);
+
+    // Add date to top
+    std::time_t now = std::time(nullptr);
+    char formatted_time[32];
+    std::strftime(formatted_time, sizeof(formatted_time), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+    std::cout << formatted_time << std::endl;
+    if (labelled) {
+        std::cout << "ID  ADDR   LEN TYPE       LABEL                                   VALUE" << std::endl;
+    }
+
+    // One flush for the whole table rather than one per row
+    for (int id : id_array) {
+        const DataIdEntry& entry = DATA_ID.at(id);
+        if (labelled) {
+            std::cout << std::setw(3) << id << " 0x" << std::hex << std::uppercase << std::setw(4)
+                      << std::setfill('0') << entry.addr << std::dec << std::nouppercase << std::setfill(' ')
+                      << " " << std::setw(2) << entry.length << " " << std::setw(6) << reg_type_name(entry.type) << "   "
+                      << std::left << std::setw(39) << entry.label << std::right << " ";
         }
-        
-        try {
-            // Try to read a simple register to verify communication
-            auto response = cmd(0x00, 0x00, 0x00, 5, 0x05);
-            if (response.empty()) {
-                throw std::runtime_error("No response from battery");
-            }
-            std::cout << "Battery diagnostics available (stub implementation)" << std::endl;
-        } catch (const std::exception& e) {
-            throw std::runtime_error(std::string("Failed to read battery registers: ") + e.what());
+        write_register_value(std::cout, id, values[id], labelled);
+        std::cout << '\n';
+    }
+    std::cout.flush();
+}
+
+uint64_t M18::stream(TelemetryWriter& writer, int duration_seconds, const std::atomic<bool>* stop) {
+    if (!is_connected()) {
+        throw std::runtime_error("Not connected to battery");
+    }
+    if (!reset()) {
+        throw std::runtime_error("Battery did not respond to reset");
+    }
+
+    uint8_t response[frame_codec::MAX_FRAME];
+    auto read_into = [&](uint16_t addr, uint8_t* field, uint16_t length, uint8_t flag, TelemetrySample& sample) {
+        if (read_span({addr, length}, response)) {
+            std::memcpy(field, response + 3, length);
+            sample.valid |= flag;
         }
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto limit = std::chrono::seconds(duration_seconds);
+    uint64_t sequence = 0;
+    while (stop == nullptr || !stop->load(std::memory_order_relaxed)) {
+        if (duration_seconds >= 0 && std::chrono::steady_clock::now() - start >= limit) {
+            break;
+        }
+
+        TelemetrySample sample;
+        sample.sequence = sequence++;
+        sample.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        // 0x400A-0x4014 would be 12 bytes, over the 0x4000 block's 10 byte
+        // read limit, so these are three reads
+        read_into(0x400A, sample.cells, sizeof(sample.cells), TelemetrySample::CELLS_VALID, sample);
+        read_into(0x4014, sample.temperature, sizeof(sample.temperature), TelemetrySample::TEMP_VALID, sample);
+        read_into(0x401F, sample.forge_temperature, sizeof(sample.forge_temperature),
+                  TelemetrySample::FORGE_TEMP_VALID, sample);
+        writer.push(sample);
     }
+
+    idle();
+    return sequence;
 }
 
-void M18::simulate(int duration_seconds) {
+SimulationStats M18::simulate(int duration_seconds, std::chrono::milliseconds period, const std::atomic<bool>* stop) {
     std::cout << "Simulating charger communication";
     if (duration_seconds > 0) {
         std::cout << " for " << duration_seconds << " seconds";
     }
-    std::cout << std::endl;
+    std::cout << ", keepalive every " << period.count() << "ms" << std::endl;
 
     bool print_tx_save = print_tx;
     bool print_rx_save = print_rx;
     print_tx = print_rx = true;
 
+    SimulationStats stats;
+    auto start_time = std::chrono::steady_clock::now();
     try {
         if (!reset()) {
             throw std::runtime_error("Reset failed");
@@ -372,21 +842,31 @@ void M18::simulate(int duration_seconds) {
         configure(1);
         get_snapchat();
 
-        auto start_time = std::chrono::steady_clock::now();
+        start_time = std::chrono::steady_clock::now();
+        PeriodicTimer timer(period);
+        std::chrono::steady_clock::time_point last_sent;
 
-        while (true) {
-            if (duration_seconds > 0) {
-                auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
-                    std::chrono::steady_clock::now() - start_time
-                );
-                if (elapsed.count() >= duration_seconds) {
-                    break;
-                }
+        while (stop == nullptr || !stop->load(std::memory_order_relaxed)) {
+            if (duration_seconds > 0 && std::chrono::steady_clock::now() - start_time >= std::chrono::seconds(duration_seconds)) {
+                break;
+            }
+
+            auto late = std::chrono::duration_cast<std::chrono::microseconds>(timer.wait());
+            auto sent = std::chrono::steady_clock::now();
+            stats.lateness.record(static_cast<uint64_t>(std::max<int64_t>(late.count(), 0)));
+            if (stats.keepalives > 0) {
+                auto error = std::chrono::duration_cast<std::chrono::microseconds>(sent - last_sent - period).count();
+                stats.max_period_error_us = std::max<uint64_t>(stats.max_period_error_us, std::abs(error));
             }
+            last_sent = sent;
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
-            keepalive();
+            uint8_t response[9];
+            if (short_command(KEEPALIVE_FRAMES, LinkCommand::Keepalive, false, response, sizeof(response)) < sizeof(response)) {
+                ++stats.failed_keepalives;
+            }
+            ++stats.keepalives;
         }
+        stats.missed_deadlines = timer.missed();
     } catch (const std::exception& e) {
         std::cerr << "Simulation error: " << e.what() << std::endl;
     }
@@ -394,25 +874,74 @@ void M18::simulate(int duration_seconds) {
     idle();
     print_tx = print_tx_save;
     print_rx = print_rx_save;
-    
-    if (duration_seconds > 0) {
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - std::chrono::steady_clock::now()
-        );
-        std::cout << "Duration: " << elapsed.count() << "ms" << std::endl;
+
+    stats.elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    std::cout << "Duration: " << static_cast<long>(stats.elapsed_seconds * 1000) << "ms, " << stats.keepalives
+              << " keepalives (" << stats.failed_keepalives << " failed), " << stats.missed_deadlines
+              << " missed deadlines" << std::endl;
+    if (stats.lateness.count() > 0) {
+        std::cout << "Wakeup lateness: p50 " << stats.lateness.percentile(0.5) << "us, p99 "
+                  << stats.lateness.percentile(0.99) << "us, max " << stats.lateness.max()
+                  << "us; max period error " << stats.max_period_error_us << "us" << std::endl;
     }
+    return stats;
 }
 
-BatteryHealth M18::health(bool force_refresh) {
-    BatteryHealth health;
-    // Implementation of health diagnostics
-    // This would parse the read_id output and format it nicely
-    return health;
+BatteryHealth M18::health(bool force_refresh, ReadCounts* counts) {
+    if (!is_connected()) {
+        throw std::runtime_error("Not connected to battery");
+    }
+    std::vector<int> ids(HEALTH_IDS.begin(), HEALTH_IDS.end());
+    return decode_health(read_registers(ids, force_refresh, counts));
 }
 
 void M18::read_all_spreadsheet() {
-    std::cout << "Reading all registers in spreadsheet format..." << std::endl;
-    // Implementation for reading all registers
+    try {
+        if (!reset()) {
+            throw std::runtime_error("Battery did not respond to reset");
+        }
+
+        RegisterImage image;
+        refresh(image);
+
+        // Add date to top
+        std::time_t now = std::time(nullptr);
+        char formatted_time[32];
+        std::strftime(formatted_time, sizeof(formatted_time), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+        std::cout << formatted_time << std::endl;
+
+        // Only the rows invalidated by the refresh go back on the bus
+        std::vector<ReadSpan> missing;
+        for (const auto& span : data_matrix_reads()) {
+            if (span.length > 0 && !image.contains(span.addr, span.length)) {
+                missing.push_back(span);
+            }
+        }
+        fetch(missing, image);
+
+        for (const auto& span : data_matrix_reads()) {
+            std::cout << "0x" << std::hex << std::uppercase << std::setw(4) << std::setfill('0')
+                      << span.addr << std::dec << std::nouppercase << std::setfill(' ') << std::endl;
+            const uint8_t* data = image.data(span.addr, span.length);
+            if (span.length == 0) {
+                std::cout << "EMPTY" << std::endl;
+            } else if (data) {
+                for (size_t i = 0; i < span.length; ++i) {
+                    std::cout << static_cast<int>(data[i]) << std::endl;
+                }
+            } else {
+                std::cout << "INV" << std::endl;
+                // pad with "blank" so data lines up in spreadsheet
+                for (size_t i = 1; i < span.length; ++i) {
+                    std::cout << "blank" << std::endl;
+                }
+            }
+        }
+        idle();
+    } catch (const std::exception& e) {
+        std::cerr << "read_all_spreadsheet: Failed with error: " << e.what() << std::endl;
+        idle();
+    }
 }
 
 void M18::brute(uint8_t addr_msb, uint8_t addr_lsb, uint16_t length, uint8_t command) {
@@ -436,21 +965,68 @@ void M18::brute(uint8_t addr_msb, uint8_t addr_lsb, uint16_t length, uint8_t com
 }
 
 void M18::full_brute(uint16_t start, uint16_t stop, uint16_t length) {
+    // Survey with the adaptive scanner rather than brute() on every
+    // address, which would take months at 4800 baud
+    ScanOptions options;
+    options.max_length = std::clamp<uint16_t>(length, 1, 0xFF);
+    RegisterScanner scanner(start, stop, options);
+    uint32_t reported = start;
     try {
-        for (uint16_t addr = start; addr < stop; ++addr) {
-            uint8_t msb = (addr >> 8) & 0xFF;
-            uint8_t lsb = addr & 0xFF;
-            brute(msb, lsb, length, 0x01);
-            if ((addr % 256) == 0) {
+        scan(scanner, [&](const RegisterScanner& s) {
+            if (s.next() / 0x1000 != reported / 0x1000) {
+                reported = s.next();
                 auto now = std::chrono::system_clock::now();
                 std::time_t t = std::chrono::system_clock::to_time_t(now);
-                std::cout << "addr = 0x" << std::hex << std::setw(4) << std::setfill('0') 
-                         << addr << " " << std::ctime(&t) << std::dec;
+                std::cout << "addr = 0x" << std::hex << std::setw(4) << std::setfill('0') << reported
+                          << std::dec << std::setfill(' ') << ", " << s.regions().size() << " regions, "
+                          << s.probes() << " reads " << std::ctime(&t);
             }
-        }
+            return true;
+        });
     } catch (const std::exception& e) {
         std::cerr << "Full brute interrupted: " << e.what() << std::endl;
     }
+    RegisterScanner::print_map(std::cout, scanner.regions());
+}
+
+void M18::scan(RegisterScanner& scanner, const RegisterScanner::Progress& progress) {
+    if (!is_connected()) {
+        throw std::runtime_error("Not connected to battery");
+    }
+
+    uint8_t response[frame_codec::MAX_FRAME];
+    auto probe = [&](uint16_t addr, uint16_t length) {
+        bool rejected = false;
+        if (read_span({addr, length}, response, &rejected)) {
+            return ProbeResult::Valid;
+        }
+        return rejected ? ProbeResult::Rejected : ProbeResult::NoResponse;
+    };
+
+    constexpr int MAX_RECOVERIES = 3;
+    uint32_t failed_at = UINT32_MAX;
+    int recoveries = 0;
+    while (!scanner.done()) {
+        try {
+            if (!reset()) {
+                throw std::runtime_error("Battery did not respond to reset");
+            }
+            if (!scanner.run(probe, progress)) {
+                break;  // Stopped by progress
+            }
+        } catch (const std::exception& e) {
+            if (!is_connected()) {
+                throw;
+            }
+            recoveries = scanner.next() == failed_at ? recoveries + 1 : 1;
+            failed_at = scanner.next();
+            if (recoveries > MAX_RECOVERIES) {
+                idle();
+                throw;
+            }
+            std::cerr << "Scan stalled (" << e.what() << "), resetting" << std::endl;
+        }
+    }
     idle();
 }
 
@@ -503,7 +1079,7 @@ void M18::write_message(const std::string& message) {
         
         for (size_t i = 0; i < padded_msg.length(); ++i) {
             uint8_t wcmd_data[6] = {0x01, 0x05, 0x03, 0x00, static_cast<uint8_t>(0x23 + i), (uint8_t)padded_msg[i]};
-            send_command(std::vector<uint8_t>(wcmd_data, wcmd_data + 6));
+            send_command(wcmd_data, sizeof(wcmd_data));
             read_response(2);
         }
     } catch (const std::exception& e) {
@@ -1,8 +1,24 @@
 #include "m18.hpp"
+#include "fleet.hpp"
+#include "snapshot_store.hpp"
+#include "column_store.hpp"
+#include "query_engine.hpp"
+#include "fleet_usage.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <cstring>
+#include <unistd.h>
 
 #ifdef HAVE_READLINE
 #include <readline/readline.h>
@@ -13,21 +29,94 @@ void print_help() {
     std::cout << R"(M18 Protocol Interface
 
 Usage: m18 [OPTIONS]
+       m18 query DIR [QUERY OPTIONS]
+       m18 usage DIR [USAGE OPTIONS]
 
 OPTIONS:
   --port PORT              Serial port to connect to (e.g., /dev/ttyUSB0)
   --health                 Print health report and exit
   --idle                   Set TX=Low and exit (prevents charge increments)
   --interactive            Enter interactive shell (default)
+  --timing FILE            Load link timing profile from FILE
+  --no-low-latency         Leave the adapter's latency settings untouched
+  --retest                 Re-test known packs: read the serial, take the
+                           fixed registers from the cache and skip the
+                           refresh sweep. Unknown packs are read in full
+                           and added to the cache
+  --cache FILE             Register cache for --retest (default:
+                           ~/.cache/m18/registers)
+  --characterize FILE      Measure link timing, save profile to FILE and exit
+  --fleet                  Read health from every ttyUSB/ttyACM port in parallel
+  --fleet-timeout SEC      Per-session budget in fleet mode (default: 120)
+  --engine ENGINE          Fleet engine: threads (default) or reactor
+  --output FILE            Write fleet results to FILE instead of stdout
+  --records FILE           Also write every register of each pack to FILE
+                           ("-" for stdout, with --output), one per line
+  --records-format FMT     Record format: ndjson (default) or csv
+  --metrics FILE           Write link metrics to FILE on exit (Prometheus
+                           text, or JSON if FILE ends in .json)
+  --store DIR              Snapshot store directory (default: snapshots)
+  --site TAG               Site/label tag recorded with new snapshots
+  --snapshot               Read every register into the store and exit
+  --history SERIAL         List stored snapshots of a serial number and exit.
+                           With --health, print the health report decoded
+                           from each snapshot (no battery needed)
+  --export DIR             Write every stored snapshot to DIR as typed
+                           columns (one mappable file per field) and exit
+  --export-csv FILE        Write the same columns as CSV ("-" for stdout)
+  --stream FILE            Poll cell voltages and temperatures as fast as the
+                           link allows, writing samples to FILE ("-" for
+                           stdout) until Ctrl+C
+  --stream-format FORMAT   csv (default) or binary
+  --stream-seconds N       Stop streaming after N seconds
+  --scan START-STOP        Map the readable registers in [START, STOP)
+                           (e.g. 0x0000-0x10000) and exit
+  --scan-exhaustive        Probe every address instead of skipping pages
+                           whose samples are all rejected
+  --simulate               Simulate a charger until Ctrl+C, then print
+                           keepalive timing statistics
+  --simulate-seconds N     Stop the simulation after N seconds
+  --keepalive-ms MS        Keepalive period when simulating (default: 500)
+  --checkpoint FILE        Save scan progress to FILE and resume from it
+                           if it exists. With --fleet, the range is split
+                           across every adapter (packs of one model)
   --help                   Show this help message
 
+QUERY OPTIONS (m18 query DIR, DIR written by --export):
+  --where EXPR             Filter rows, e.g. "cell_imbalance > 50 and
+                           discharge_to_empty > 20" or "type == 424"
+  --stat COL[,COL...]      Print count, sum, min, max and percentiles
+  --percentiles P[,P...]   Percentiles to print (default: 50,90,99)
+  --select COL[,COL...]    Print these columns of matching rows
+  --limit N                Rows printed by --select (default: 20)
+  --latest                 Only the newest snapshot of each pack
+  --threads N              Scan threads (default: one per core)
+  --columns                List the export's columns and exit
+
+USAGE OPTIONS (m18 usage DIR, DIR written by --export):
+  --by COL[,COL...]        Group packs by these columns, e.g. site,model
+                           (default: model; "all" for one group)
+  --where EXPR             Only packs matching EXPR (as for query)
+  --high AMPS              Current counted as high load (default: 100)
+  --percentiles P[,P...]   Current percentiles to print (default: 50,90,99)
+  --histograms             Also print every group's merged histograms
+  --all-snapshots          Count every snapshot, not just each pack's newest
+  --threads N              Aggregation threads (default: one per core)
+
 COMMANDS (in interactive shell):
   health                   Print simple health report on battery
   read_id                  Print labelled and formatted diagnostics
-  simulate                 Simulate charging communication
+  simulate [SEC [MS]]      Simulate charging communication (keepalive
+                           every MS milliseconds)
   high                     Bring J2 pin high (20V)
   idle                     Pull J2 pin low (0V)
   high_for N               Bring J2 high for N seconds then idle
+  characterize [FILE]      Measure link timing (and save profile to FILE)
+  metrics [FILE]           Print link metrics as JSON (or save them to FILE)
+  adapter                  Show the adapter chip and measured frame latency
+  snapshot [SITE]          Read every register into the snapshot store
+  stream FILE [SECONDS]    Stream live telemetry to FILE (Ctrl+C stops)
+  scan [START STOP]        Map readable registers (default: whole space)
   help                     Show command help
   
 Connect UART-TX to M18-J2 and UART-RX to M18-J1 to fake the charger
@@ -35,12 +124,357 @@ Connect UART-GND to M18-GND
 )" << std::endl;
 }
 
+// Read a full register image and append it to the store
+void save_snapshot(M18& m18, const std::string& store_dir, const std::string& site) {
+    std::cout << "Reading all registers..." << std::endl;
+    RegisterImage image = m18.snapshot();
+    SnapshotStore store(store_dir);
+    uint64_t offset = store.append(image, site);
+    Snapshot saved = store.read(offset);
+    std::cout << "Snapshot of serial " << saved.serial << " stored at offset " << offset
+              << " in " << store_dir << " (" << store.count(saved.serial) << " for this pack)" << std::endl;
+}
+
+// Query paths open the store read-only, so a damaged record is reported
+// rather than repaired
+void report_damage(const SnapshotStore& store) {
+    if (store.damaged_records() > 0) {
+        std::cerr << "Warning: skipped " << store.damaged_records() << " damaged record(s) in "
+                  << store.directory() << "/snapshots.dat" << std::endl;
+    }
+}
+
+int print_history(const std::string& store_dir, uint32_t serial, bool with_health) {
+    SnapshotStore store(store_dir, true);
+    report_damage(store);
+    auto history = store.history(serial);
+    if (history.empty()) {
+        std::cout << "No snapshots of serial " << serial << " in " << store_dir << std::endl;
+        return 1;
+    }
+    std::cout << history.size() << " snapshots of serial " << serial << " (type " << history.front().type
+              << "), newest first:" << std::endl;
+    for (const auto& snapshot : history) {
+        std::time_t t = static_cast<std::time_t>(snapshot.timestamp);
+        std::cout << "  " << std::put_time(std::gmtime(&t), "%Y-%m-%d %H:%M:%S")
+                  << "  offset " << std::setw(10) << snapshot.offset
+                  << "  " << snapshot.image.valid_count() << " bytes";
+        if (!snapshot.site.empty()) {
+            std::cout << "  site " << snapshot.site;
+        }
+        std::cout << std::endl;
+        if (with_health) {
+            print_health(std::cout, decode_health(snapshot.image));
+            std::cout << std::endl;
+        }
+    }
+    return 0;
+}
+
+// Columnar and/or CSV export of the whole store
+int export_store(const std::string& store_dir, const std::string& export_dir, const std::string& csv_file) {
+    SnapshotStore store(store_dir, true);
+    report_damage(store);
+    std::unique_ptr<ColumnFileWriter> columns;
+    std::unique_ptr<CsvColumnWriter> csv;
+    std::vector<ColumnSink*> sinks;
+    std::ofstream csv_out;
+    if (!export_dir.empty()) {
+        columns = std::make_unique<ColumnFileWriter>(export_dir, snapshot_columns());
+        sinks.push_back(columns.get());
+    }
+    if (!csv_file.empty()) {
+        std::ostream* out = &std::cout;
+        if (csv_file != "-") {
+            csv_out.open(csv_file);
+            if (!csv_out) {
+                std::cerr << "Cannot open " << csv_file << std::endl;
+                return 1;
+            }
+            out = &csv_out;
+        }
+        csv = std::make_unique<CsvColumnWriter>(*out, snapshot_columns());
+        sinks.push_back(csv.get());
+    }
+
+    size_t rows = export_snapshots(store, sinks);
+    bool ok = true;
+    for (ColumnSink* sink : sinks) {
+        ok = sink->finish() && ok;
+    }
+    if (columns) {
+        std::cerr << "Exported " << rows << " snapshots, " << snapshot_columns().size() << " columns to "
+                  << export_dir << std::endl;
+    }
+    return ok ? 0 : 1;
+}
+
+std::vector<std::string> split_list(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+// m18 query DIR [QUERY OPTIONS]; answered from an export alone
+int run_query_command(int argc, char* argv[]) {
+    if (argc < 1 || std::string(argv[0]).rfind("--", 0) == 0) {
+        std::cerr << "Usage: m18 query DIR [--where EXPR] [--stat COLS] [--select COLS]" << std::endl;
+        return 1;
+    }
+    const std::string directory = argv[0];
+    QueryOptions options;
+    std::vector<std::string> select;
+    size_t limit = 20;
+    bool list_columns = false;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--where" && i + 1 < argc) {
+                auto predicates = parse_predicates(argv[++i]);
+                options.where.insert(options.where.end(), predicates.begin(), predicates.end());
+            } else if (arg == "--stat" && i + 1 < argc) {
+                for (const auto& column : split_list(argv[++i])) {
+                    options.stats.push_back(column);
+                }
+            } else if (arg == "--percentiles" && i + 1 < argc) {
+                options.percentiles.clear();
+                for (const auto& p : split_list(argv[++i])) {
+                    options.percentiles.push_back(std::stod(p) / 100);
+                }
+            } else if (arg == "--select" && i + 1 < argc) {
+                select = split_list(argv[++i]);
+            } else if (arg == "--limit" && i + 1 < argc) {
+                limit = std::stoul(argv[++i]);
+            } else if (arg == "--latest") {
+                options.latest_only = true;
+            } else if (arg == "--threads" && i + 1 < argc) {
+                options.threads = std::stoul(argv[++i]);
+            } else if (arg == "--columns") {
+                list_columns = true;
+            } else {
+                std::cerr << "Unknown query option: " << arg << std::endl;
+                return 1;
+            }
+        }
+        options.max_rows = select.empty() ? 0 : limit;
+
+        ColumnTable table(directory);
+        if (list_columns) {
+            for (const auto& column : table.columns()) {
+                std::cout << std::left << std::setw(24) << column.name << std::setw(6)
+                          << column_type_name(column.type) << std::right << column.label << std::endl;
+            }
+            return 0;
+        }
+        QueryResult result = run_query(table, options);
+        print_query_result(std::cout, table, options, result, select);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// m18 usage DIR [USAGE OPTIONS]; merged usage histograms of an export
+int run_usage_command(int argc, char* argv[]) {
+    if (argc < 1 || std::string(argv[0]).rfind("--", 0) == 0) {
+        std::cerr << "Usage: m18 usage DIR [--by COLS] [--where EXPR] [--high AMPS] [--histograms]" << std::endl;
+        return 1;
+    }
+    const std::string directory = argv[0];
+    UsageOptions options;
+    bool histograms = false;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--by" && i + 1 < argc) {
+                std::string by = argv[++i];
+                options.group_by = by == "all" ? std::vector<std::string>() : split_list(by);
+            } else if (arg == "--where" && i + 1 < argc) {
+                auto predicates = parse_predicates(argv[++i]);
+                options.where.insert(options.where.end(), predicates.begin(), predicates.end());
+            } else if (arg == "--high" && i + 1 < argc) {
+                options.high_current = std::stoi(argv[++i]);
+            } else if (arg == "--percentiles" && i + 1 < argc) {
+                options.percentiles.clear();
+                for (const auto& p : split_list(argv[++i])) {
+                    options.percentiles.push_back(std::stod(p) / 100);
+                }
+            } else if (arg == "--histograms") {
+                histograms = true;
+            } else if (arg == "--all-snapshots") {
+                options.latest_only = false;
+            } else if (arg == "--threads" && i + 1 < argc) {
+                options.threads = std::stoul(argv[++i]);
+            } else {
+                std::cerr << "Unknown usage option: " << arg << std::endl;
+                return 1;
+            }
+        }
+
+        ColumnTable table(directory);
+        UsageResult result = aggregate_usage(table, options);
+        print_usage_summary(std::cout, options, result);
+        if (histograms) {
+            for (const auto& group : result.groups) {
+                print_usage_histograms(std::cout, group);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+std::atomic<bool> stop_requested{false};
+
+void on_stop_signal(int) {
+    stop_requested = true;
+}
+
+// Ctrl+C sets stop_requested instead of exiting while a long-running
+// command is active
+struct StopOnInterrupt {
+    void (*previous)(int);
+    StopOnInterrupt() {
+        stop_requested = false;
+        previous = std::signal(SIGINT, on_stop_signal);
+    }
+    ~StopOnInterrupt() { std::signal(SIGINT, previous); }
+};
+
+// Stream live telemetry until the time limit or Ctrl+C. Progress goes to
+// stderr so samples can be written to stdout.
+void run_stream(M18& m18, const std::string& file, StreamFormat format, int seconds) {
+    std::ofstream file_out;
+    if (file != "-") {
+        file_out.open(file, std::ios::binary);
+        if (!file_out) {
+            throw std::runtime_error("Cannot open " + file);
+        }
+    }
+    std::ostream& out = file_out.is_open() ? static_cast<std::ostream&>(file_out) : std::cout;
+
+    std::cerr << "Streaming telemetry to " << file << (seconds >= 0 ? "" : " (Ctrl+C to stop)") << std::endl;
+    StopOnInterrupt interrupt;
+    auto start = std::chrono::steady_clock::now();
+
+    TelemetryWriter writer(out, format);
+    uint64_t samples = m18.stream(writer, seconds, &stop_requested);
+    writer.finish();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << samples << " samples in " << std::fixed << std::setprecision(1) << elapsed << "s ("
+              << (elapsed > 0 ? samples / elapsed : 0) << "/s), " << writer.dropped() << " dropped" << std::endl;
+    std::cerr.unsetf(std::ios::floatfield);
+}
+
+// "START-STOP" in hex or decimal; STOP is exclusive
+bool parse_range(const std::string& text, uint32_t& start, uint32_t& stop) {
+    size_t dash = text.find('-');
+    if (dash == std::string::npos) {
+        return false;
+    }
+    try {
+        start = static_cast<uint32_t>(std::stoul(text.substr(0, dash), nullptr, 0));
+        stop = static_cast<uint32_t>(std::stoul(text.substr(dash + 1), nullptr, 0));
+    } catch (const std::exception&) {
+        return false;
+    }
+    return start < stop && stop <= 0x10000;
+}
+
+// Shards for a scan of [start, stop), resumed from checkpoint if it exists
+std::unique_ptr<ScanQueue> make_scan_queue(uint32_t start, uint32_t stop, size_t shards,
+                                           const ScanOptions& options, const std::string& checkpoint) {
+    std::vector<RegisterScanner> scanners;
+    if (!checkpoint.empty() && ::access(checkpoint.c_str(), F_OK) == 0) {
+        if (!load_scan_checkpoint(checkpoint, scanners)) {
+            throw std::runtime_error("Cannot resume from " + checkpoint);
+        }
+        if (scanners.front().start() != start || scanners.back().stop() != stop) {
+            throw std::runtime_error(checkpoint + " belongs to a scan of a different range; remove it to start over");
+        }
+        std::cerr << "Resuming scan from " << checkpoint << std::endl;
+    } else {
+        scanners = shard_scan(start, stop, shards, options);
+    }
+    return std::make_unique<ScanQueue>(std::move(scanners), checkpoint);
+}
+
+void report_scan(const ScanQueue& queue, std::chrono::steady_clock::time_point began, const std::string& checkpoint) {
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+    RegisterScanner::print_map(std::cout, queue.regions());
+    std::cout << queue.probes() << " reads, " << std::fixed << std::setprecision(1) << elapsed << "s this run"
+              << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    if (!queue.done()) {
+        std::cout << "Scan incomplete: " << queue.shards_done() << " of " << queue.shard_count() << " shards done";
+        if (!checkpoint.empty()) {
+            std::cout << "; run again with --checkpoint " << checkpoint << " to continue";
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Map readable registers with the connected pack
+void run_scan(M18& m18, const std::string& port, uint32_t start, uint32_t stop, const ScanOptions& options,
+              const std::string& checkpoint) {
+    auto queue = make_scan_queue(start, stop, 1, options, checkpoint);
+    StopOnInterrupt interrupt;
+    auto began = std::chrono::steady_clock::now();
+    queue->work(m18, port, &stop_requested);
+    report_scan(*queue, began, checkpoint);
+}
+
 int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "query") {
+        return run_query_command(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "usage") {
+        return run_usage_command(argc - 2, argv + 2);
+    }
+
     std::string port;
     bool health_mode = false;
     bool idle_mode = false;
     bool interactive = true;
     bool help_requested = false;
+    std::string timing_file;
+    std::string characterize_file;
+    bool fleet_mode = false;
+    FleetOptions fleet_options;
+    std::string output_file;
+    std::string records_file;
+    RecordFormat records_format = RecordFormat::Ndjson;
+    std::string metrics_file;
+    bool low_latency = true;
+    bool retest = false;
+    std::string cache_file;
+    std::string store_dir = "snapshots";
+    std::string site;
+    bool snapshot_mode = false;
+    std::string history_serial;
+    std::string export_dir;
+    std::string export_csv;
+    std::string stream_file;
+    StreamFormat stream_format = StreamFormat::Csv;
+    int stream_seconds = -1;
+    bool scan_mode = false;
+    uint32_t scan_start = 0;
+    uint32_t scan_stop = 0x10000;
+    ScanOptions scan_options;
+    std::string checkpoint_file;
+    bool simulate_mode = false;
+    int simulate_seconds = -1;
+    int keepalive_ms = 500;
 
     // Parse command line arguments
     for (int i = 1; i < argc; ++i) {
@@ -58,6 +492,98 @@ int main(int argc, char* argv[]) {
             interactive = false;
         } else if (arg == "--interactive") {
             interactive = true;
+        } else if (arg == "--timing" && i + 1 < argc) {
+            timing_file = argv[++i];
+        } else if (arg == "--characterize" && i + 1 < argc) {
+            characterize_file = argv[++i];
+            interactive = false;
+        } else if (arg == "--fleet") {
+            fleet_mode = true;
+            interactive = false;
+        } else if (arg == "--fleet-timeout" && i + 1 < argc) {
+            char* end = nullptr;
+            long seconds = std::strtol(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || seconds <= 0) {
+                std::cerr << "Invalid fleet timeout: " << argv[i] << std::endl;
+                return 1;
+            }
+            fleet_options.timeout = std::chrono::seconds(seconds);
+        } else if (arg == "--engine" && i + 1 < argc) {
+            std::string engine = argv[++i];
+            if (engine != "threads" && engine != "reactor") {
+                std::cerr << "Unknown engine: " << engine << std::endl;
+                return 1;
+            }
+            fleet_options.reactor = (engine == "reactor");
+        } else if (arg == "--no-low-latency") {
+            low_latency = false;
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cache_file = argv[++i];
+        } else if (arg == "--retest") {
+            retest = true;
+        } else if (arg == "--metrics" && i + 1 < argc) {
+            metrics_file = argv[++i];
+        } else if (arg == "--output" && i + 1 < argc) {
+            output_file = argv[++i];
+        } else if (arg == "--records" && i + 1 < argc) {
+            records_file = argv[++i];
+        } else if (arg == "--records-format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format != "ndjson" && format != "csv") {
+                std::cerr << "Unknown records format: " << format << std::endl;
+                return 1;
+            }
+            records_format = format == "csv" ? RecordFormat::Csv : RecordFormat::Ndjson;
+        } else if (arg == "--store" && i + 1 < argc) {
+            store_dir = argv[++i];
+        } else if (arg == "--site" && i + 1 < argc) {
+            site = argv[++i];
+        } else if (arg == "--snapshot") {
+            snapshot_mode = true;
+            interactive = false;
+        } else if (arg == "--history" && i + 1 < argc) {
+            history_serial = argv[++i];
+            interactive = false;
+        } else if (arg == "--export" && i + 1 < argc) {
+            export_dir = argv[++i];
+            interactive = false;
+        } else if (arg == "--export-csv" && i + 1 < argc) {
+            export_csv = argv[++i];
+            interactive = false;
+        } else if (arg == "--stream" && i + 1 < argc) {
+            stream_file = argv[++i];
+            interactive = false;
+        } else if (arg == "--stream-format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format != "csv" && format != "binary") {
+                std::cerr << "Unknown stream format: " << format << std::endl;
+                return 1;
+            }
+            stream_format = format == "binary" ? StreamFormat::Binary : StreamFormat::Csv;
+        } else if (arg == "--stream-seconds" && i + 1 < argc) {
+            stream_seconds = std::atoi(argv[++i]);
+        } else if (arg == "--scan" && i + 1 < argc) {
+            if (!parse_range(argv[++i], scan_start, scan_stop)) {
+                std::cerr << "Invalid scan range: " << argv[i] << std::endl;
+                return 1;
+            }
+            scan_mode = true;
+            interactive = false;
+        } else if (arg == "--scan-exhaustive") {
+            scan_options.page_size = 0;
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpoint_file = argv[++i];
+        } else if (arg == "--simulate") {
+            simulate_mode = true;
+            interactive = false;
+        } else if (arg == "--simulate-seconds" && i + 1 < argc) {
+            simulate_seconds = std::atoi(argv[++i]);
+        } else if (arg == "--keepalive-ms" && i + 1 < argc) {
+            keepalive_ms = std::atoi(argv[++i]);
+            if (keepalive_ms <= 0) {
+                std::cerr << "Invalid keepalive period: " << argv[i] << std::endl;
+                return 1;
+            }
         }
     }
 
@@ -66,13 +592,120 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
+    // History is answered from the store alone, without a battery
+    if (!history_serial.empty()) {
+        try {
+            return print_history(store_dir, static_cast<uint32_t>(std::stoul(history_serial)), health_mode);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (!export_dir.empty() || !export_csv.empty()) {
+        try {
+            return export_store(store_dir, export_dir, export_csv);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Status goes to stderr when the results themselves are written to
+    // stdout: a telemetry stream to "-" or fleet JSON
+    std::ostream& status = (stream_file == "-" || fleet_mode) ? std::cerr : std::cout;
+
+    TimingProfile profile;
+    if (!timing_file.empty()) {
+        if (!profile.load(timing_file)) {
+            return 1;
+        }
+        status << "Loaded timing profile from " << timing_file << std::endl;
+    }
+
+    // The cache is only kept for --retest, so other runs leave no files
+    std::shared_ptr<RegisterCache> cache;
+    if (retest) {
+        cache = std::make_shared<RegisterCache>(cache_file.empty() ? RegisterCache::default_path() : cache_file);
+    }
+
+    if (fleet_mode) {
+        // Records and the fleet JSON cannot share stdout
+        if (records_file == "-" && output_file.empty()) {
+            std::cerr << "--records - needs --output FILE for the fleet results" << std::endl;
+            return 1;
+        }
+        auto ports = find_fleet_ports();
+        if (ports.empty()) {
+            std::cerr << "No USB serial ports found" << std::endl;
+            return 1;
+        }
+
+        if (scan_mode) {
+            // One shard per adapter; a resumed scan keeps its original shards
+            try {
+                auto queue = make_scan_queue(scan_start, scan_stop, ports.size(), scan_options, checkpoint_file);
+                std::cerr << "Scanning with " << ports.size() << " adapters..." << std::endl;
+                StopOnInterrupt interrupt;
+                auto began = std::chrono::steady_clock::now();
+                run_sharded_scan(ports, *queue, profile, low_latency, &stop_requested);
+                report_scan(*queue, began, checkpoint_file);
+                return queue->done() ? 0 : 2;
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                return 1;
+            }
+        }
+
+        if (!records_file.empty()) {
+            try {
+                fleet_options.records = std::make_shared<RecordWriter>(records_file, records_format);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                return 1;
+            }
+        }
+
+        std::cerr << "Scanning " << ports.size() << " ports..." << std::endl;
+        fleet_options.timing = profile;
+        fleet_options.low_latency = low_latency;
+        fleet_options.cache = cache;
+        fleet_options.retest = retest;
+        auto results = fleet_options.reactor ? run_fleet_reactor(ports, fleet_options)
+                                             : run_fleet(ports, fleet_options);
+
+        if (output_file.empty()) {
+            write_fleet_json(std::cout, results);
+        } else {
+            std::ofstream out(output_file);
+            write_fleet_json(out, results);
+            std::cerr << "Fleet results written to " << output_file << std::endl;
+        }
+
+        if (fleet_options.records && !fleet_options.records->ok()) {
+            return 1;
+        }
+
+        // Scanning completes even if some ports fail; report it in the exit code
+        for (const auto& r : results) {
+            if (r.status != "ok") {
+                return 2;
+            }
+        }
+        return 0;
+    }
+
     try {
         // Create M18 instance
         M18 m18;
+        m18.set_timing_profile(profile);
+        m18.set_low_latency(low_latency);
+        m18.set_register_cache(cache);
+        m18.set_retest(retest);
 
         // Connect to port
         if (port.empty()) {
-            std::cout << "*** NO PORT SPECIFIED ***" << std::endl;
+            status << "*** NO PORT SPECIFIED ***" << std::endl;
             port = m18.select_port();
         }
 
@@ -81,39 +714,59 @@ int main(int argc, char* argv[]) {
             return 1;
         }
 
-        std::cout << "Connected to " << port << std::endl;
+        status << "Connected to " << port << std::endl;
         
         // Test if battery is responding
         try {
             if (!m18.reset()) {
-                std::cout << "\nWARNING: Battery may not be responding" << std::endl;
-                std::cout << "Check connections and battery power" << std::endl;
-                std::cout << "Continuing anyway..." << std::endl;
+                status << "\nWARNING: Battery may not be responding" << std::endl;
+                status << "Check connections and battery power" << std::endl;
+                status << "Continuing anyway..." << std::endl;
             }
         } catch (const std::exception& e) {
-            std::cout << "\nWARNING: Battery communication test failed: " << e.what() << std::endl;
-            std::cout << "Check connections: UART-TX->J2, UART-RX->J1, GND->GND" << std::endl;
-            std::cout << "Continuing anyway..." << std::endl;
+            status << "\nWARNING: Battery communication test failed: " << e.what() << std::endl;
+            status << "Check connections: UART-TX->J2, UART-RX->J1, GND->GND" << std::endl;
+            status << "Continuing anyway..." << std::endl;
         }
 
         // Execute appropriate mode
-        if (idle_mode) {
+        if (!characterize_file.empty()) {
+            auto profile = m18.characterize_link();
+            if (!profile.save(characterize_file)) {
+                return 1;
+            }
+            std::cout << "Timing profile saved to " << characterize_file << std::endl;
+        } else if (simulate_mode) {
+            StopOnInterrupt interrupt;
+            m18.simulate(simulate_seconds, std::chrono::milliseconds(keepalive_ms), &stop_requested);
+        } else if (scan_mode) {
+            run_scan(m18, port, scan_start, scan_stop, scan_options, checkpoint_file);
+        } else if (!stream_file.empty()) {
+            run_stream(m18, stream_file, stream_format, stream_seconds);
+        } else if (snapshot_mode) {
+            save_snapshot(m18, store_dir, site);
+        } else if (idle_mode) {
             m18.idle();
             std::cout << "TX should now be low voltage (<1V). Safe to connect" << std::endl;
         } else if (health_mode) {
             std::cout << "Reading battery health..." << std::endl;
-            auto health = m18.health();
-            std::cout << "Health report completed" << std::endl;
+            print_health(std::cout, m18.health());
         } else if (interactive) {
             std::cout << R"(
 Entering interactive shell...
 Available commands:
   health              - Print simple health report
   read_id             - Print all diagnostics
-  simulate            - Simulate charging
+  simulate [SEC [MS]] - Simulate charging
   high                - Bring J2 high
   idle                - Bring J2 low
   high_for N          - High for N seconds
+  characterize [FILE] - Measure link timing
+  metrics [FILE]      - Show link metrics
+  adapter             - Show adapter latency
+  snapshot [SITE]     - Store all registers
+  stream FILE [SEC]   - Stream live telemetry
+  scan [START STOP]   - Map readable registers
   help                - Show help
   exit                - Exit
   
@@ -163,13 +816,7 @@ Try: health
                         if (health.type.empty() && health.model.empty()) {
                             std::cout << "Warning: Battery not responding or no data available" << std::endl;
                         } else {
-                            std::cout << "Battery Health Report:" << std::endl;
-                            std::cout << "  Type: " << health.type << std::endl;
-                            std::cout << "  Model: " << health.model << std::endl;
-                            std::cout << "  Serial: " << health.serial << std::endl;
-                            std::cout << "  Pack Voltage: " << health.pack_voltage << "V" << std::endl;
-                            std::cout << "  Temperature: " << health.temperature << "°C" << std::endl;
-                            std::cout << "  Total Discharge: " << health.total_discharge_ah << "Ah" << std::endl;
+                            print_health(std::cout, health);
                         }
                     } catch (const std::exception& e) {
                         std::cout << "Error reading battery health: " << e.what() << std::endl;
@@ -199,9 +846,16 @@ Try: health
                             std::cout << "Ensure battery power is connected" << std::endl;
                         }
                     }
-                } else if (command == "simulate") {
+                } else if (command == "simulate" || command.substr(0, 9) == "simulate ") {
                     try {
-                        m18.simulate();
+                        std::istringstream args(command.substr(std::min<size_t>(command.size(), 9)));
+                        int seconds = -1;
+                        int period_ms = keepalive_ms;
+                        if (args >> seconds) {
+                            args >> period_ms;
+                        }
+                        StopOnInterrupt interrupt;
+                        m18.simulate(seconds, std::chrono::milliseconds(std::max(period_ms, 1)), &stop_requested);
                     } catch (const std::exception& e) {
                         std::cout << "Error during simulation: " << e.what() << std::endl;
                     }
@@ -230,14 +884,93 @@ Try: health
                     } catch (...) {
                         std::cout << "Usage: high_for N" << std::endl;
                     }
+                } else if (command == "characterize" || command.substr(0, 13) == "characterize ") {
+                    try {
+                        auto profile = m18.characterize_link();
+                        m18.set_timing_profile(profile);
+                        std::cout << "Timing profile applied to this session" << std::endl;
+                        if (command.size() > 13) {
+                            std::string file = command.substr(13);
+                            if (profile.save(file)) {
+                                std::cout << "Timing profile saved to " << file << std::endl;
+                            }
+                        }
+                    } catch (const std::exception& e) {
+                        std::cout << "Error characterizing link: " << e.what() << std::endl;
+                    }
+                } else if (command == "metrics" || command.substr(0, 8) == "metrics ") {
+                    if (command.size() > 8) {
+                        std::string file = command.substr(8);
+                        if (m18.metrics().save(file, port)) {
+                            std::cout << "Metrics written to " << file << std::endl;
+                        }
+                    } else {
+                        m18.metrics().write_json(std::cout);
+                    }
+                } else if (command == "adapter") {
+                    try {
+                        m18.adapter_report();
+                    } catch (const std::exception& e) {
+                        std::cout << "Error measuring adapter: " << e.what() << std::endl;
+                    }
+                } else if (command == "snapshot" || command.substr(0, 9) == "snapshot ") {
+                    try {
+                        save_snapshot(m18, store_dir, command.size() > 9 ? command.substr(9) : site);
+                    } catch (const std::exception& e) {
+                        std::cout << "Error storing snapshot: " << e.what() << std::endl;
+                    }
+                } else if (command.substr(0, 7) == "stream ") {
+                    try {
+                        std::istringstream args(command.substr(7));
+                        std::string file;
+                        int seconds = -1;
+                        args >> file;
+                        if (!(args >> seconds)) {
+                            seconds = -1;
+                        }
+                        run_stream(m18, file, stream_format, seconds);
+                    } catch (const std::exception& e) {
+                        std::cout << "Error streaming telemetry: " << e.what() << std::endl;
+                    }
+                } else if (command == "scan" || command.substr(0, 5) == "scan ") {
+                    try {
+                        uint32_t start = 0;
+                        uint32_t stop = 0x10000;
+                        if (command.size() > 5) {
+                            std::istringstream args(command.substr(5));
+                            std::string first;
+                            std::string second;
+                            args >> first >> second;
+                            if (!parse_range(first + "-" + second, start, stop)) {
+                                throw std::invalid_argument("Usage: scan [START STOP]");
+                            }
+                        }
+                        run_scan(m18, port, start, stop, scan_options, checkpoint_file);
+                    } catch (const std::exception& e) {
+                        std::cout << "Error scanning registers: " << e.what() << std::endl;
+                    }
                 } else if (command == "help") {
                     std::cout << R"(Available commands:
   health              - Print simple health report on battery
   read_id             - Print all registers in labelled format
-  simulate            - Simulate charger communication
+  simulate [SEC [MS]] - Simulate charger communication for SEC seconds (or
+                        until Ctrl+C), keepalive every MS ms (default 500)
   high                - Bring J2 pin high (20V)
   idle                - Pull J2 pin low (0V)
   high_for N          - Bring J2 high for N seconds then idle
+  characterize [FILE] - Measure link timing and apply it (optionally save)
+  metrics [FILE]      - Print latency/error metrics as JSON, or save them
+                        to FILE (Prometheus text, or JSON for *.json)
+  adapter             - Show the adapter chip, its latency settings and
+                        the measured per-frame latency
+  snapshot [SITE]     - Read every register and append the image to the
+                        snapshot store (--store DIR), tagged with SITE
+  stream FILE [SEC]   - Poll cell voltages and temperatures back to back
+                        into FILE (CSV, or --stream-format binary) until
+                        SEC seconds pass or Ctrl+C
+  scan [START STOP]   - Map readable registers between START and STOP
+                        (hex, STOP exclusive) with the longest read each
+                        block accepts
   exit or quit        - Exit the program
 )" << std::endl;
                 } else if (!command.empty()) {
@@ -247,7 +980,11 @@ Try: health
         }
 
         m18.disconnect();
-        std::cout << "Disconnected" << std::endl;
+        status << "Disconnected" << std::endl;
+
+        if (!metrics_file.empty() && m18.metrics().save(metrics_file, port)) {
+            status << "Metrics written to " << metrics_file << std::endl;
+        }
 
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
@@ -0,0 +1,37 @@
+#include "periodic_timer.hpp"
+#include <cerrno>
+#include <stdexcept>
+#include <time.h>
+
+PeriodicTimer::PeriodicTimer(std::chrono::nanoseconds period) : period_(period), deadline_(clock::now() + period) {
+    if (period <= std::chrono::nanoseconds::zero()) {
+        throw std::invalid_argument("PeriodicTimer period must be positive");
+    }
+}
+
+std::chrono::nanoseconds PeriodicTimer::wait() {
+    auto now = clock::now();
+    if (now >= deadline_ + period_) {
+        // Overran by at least one full period: resume on the next deadline
+        // in the original phase rather than firing a burst to catch up
+        auto skipped = (now - deadline_) / period_;
+        missed_ += static_cast<uint64_t>(skipped);
+        deadline_ += period_ * skipped;
+    }
+
+    // steady_clock is CLOCK_MONOTONIC on Linux, so its epoch matches
+    const auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline_.time_since_epoch());
+    timespec ts{};
+    ts.tv_sec = static_cast<time_t>(since_epoch.count() / 1000000000);
+    ts.tv_nsec = static_cast<long>(since_epoch.count() % 1000000000);
+    int rc;
+    while ((rc = ::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr)) == EINTR) {
+    }
+    if (rc != 0) {
+        throw std::runtime_error("clock_nanosleep failed");
+    }
+
+    auto late = clock::now() - deadline_;
+    deadline_ += period_;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(late);
+}
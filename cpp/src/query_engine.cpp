@@ -0,0 +1,474 @@
+#include "query_engine.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+// Rows per block. Each thread reuses one mask of this size, so a block's
+// mask and column slices stay in L1 while every predicate runs over them.
+constexpr size_t BLOCK = 4096;
+static_assert(BLOCK % 8 == 0, "blocks start on a validity bitmap byte");
+
+using Mask = std::array<uint8_t, BLOCK>;
+using BlockFilter = std::function<void(size_t begin, size_t count, uint8_t* mask)>;
+using BlockCollect = std::function<void(size_t begin, size_t count, const uint8_t* mask, std::vector<double>& out)>;
+
+// The kernels below are plain loops over packed values with no branches,
+// which the compiler turns into SIMD compares
+template <typename T>
+void keep_inside(const T* __restrict x, size_t n, T lo, T hi, uint8_t* __restrict mask) {
+    for (size_t i = 0; i < n; ++i) {
+        mask[i] &= static_cast<uint8_t>((x[i] >= lo) & (x[i] <= hi));
+    }
+}
+
+template <typename T>
+void keep_outside(const T* __restrict x, size_t n, T lo, T hi, uint8_t* __restrict mask) {
+    for (size_t i = 0; i < n; ++i) {
+        mask[i] &= static_cast<uint8_t>((x[i] < lo) | (x[i] > hi));
+    }
+}
+
+// Columns with in-band nulls
+template <typename T>
+void keep_not_null(const T* __restrict x, size_t n, uint8_t* __restrict mask) {
+    for (size_t i = 0; i < n; ++i) {
+        mask[i] &= static_cast<uint8_t>(!is_column_null(x[i]));
+    }
+}
+
+// Columns with a validity bitmap; bits starts at the block's first row,
+// which is a multiple of 8
+void keep_valid(const uint8_t* __restrict bits, size_t n, uint8_t* __restrict mask) {
+    for (size_t i = 0; i < n; ++i) {
+        mask[i] &= static_cast<uint8_t>((bits[i >> 3] >> (i & 7)) & 1);
+    }
+}
+
+template <typename T>
+T clamp_to(double value) {
+    if (value >= static_cast<double>(std::numeric_limits<T>::max())) {
+        return std::numeric_limits<T>::max();
+    }
+    if (value <= static_cast<double>(std::numeric_limits<T>::lowest())) {
+        return std::numeric_limits<T>::lowest();
+    }
+    return static_cast<T>(value);
+}
+
+// Closed range [lo, hi] of stored values that satisfy "x op value". An
+// empty range has lo > hi. Nulls are filtered out separately.
+template <typename T>
+std::pair<T, T> value_range(CompareOp op, double value) {
+    constexpr T EMPTY_LO = std::numeric_limits<T>::max();
+    constexpr T EMPTY_HI = std::numeric_limits<T>::lowest();
+
+    if constexpr (std::is_floating_point_v<T>) {
+        // Compare against the value rounded to the column's precision, so
+        // "pack_voltage < 19.3" leaves out a stored 19.3f
+        constexpr T inf = std::numeric_limits<T>::infinity();
+        const T f = static_cast<T>(value);
+        switch (op) {
+            case CompareOp::Greater: return {std::nextafter(f, inf), inf};
+            case CompareOp::GreaterEqual: return {f, inf};
+            case CompareOp::Less: return {-inf, std::nextafter(f, -inf)};
+            case CompareOp::LessEqual: return {-inf, f};
+            default: return {f, f};
+        }
+    } else {
+        double lo = -INFINITY;
+        double hi = INFINITY;
+        switch (op) {
+            case CompareOp::Greater: lo = std::floor(value) + 1; break;
+            case CompareOp::GreaterEqual: lo = std::ceil(value); break;
+            case CompareOp::Less: hi = std::ceil(value) - 1; break;
+            case CompareOp::LessEqual: hi = std::floor(value); break;
+            default:
+                if (value != std::floor(value)) {
+                    return {EMPTY_LO, EMPTY_HI};
+                }
+                lo = hi = value;
+                break;
+        }
+        // A bound beyond the type's range must not be clamped onto it, or
+        // "x < 0" on an unsigned column would match zeros
+        if (lo > hi || hi < static_cast<double>(std::numeric_limits<T>::lowest()) ||
+            lo > static_cast<double>(std::numeric_limits<T>::max())) {
+            return {EMPTY_LO, EMPTY_HI};
+        }
+        return {clamp_to<T>(lo), clamp_to<T>(hi)};
+    }
+}
+
+// strtod also takes "nan" and "inf", which have no place in a range bound
+bool parse_number(const std::string& text, double& value) {
+    if (text.empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    return *end == '\0' && std::isfinite(value);
+}
+
+BlockFilter compile_predicate(ColumnTable& table, const Predicate& predicate) {
+    const ColumnSpec* spec = table.find(predicate.column);
+    if (spec == nullptr) {
+        throw std::invalid_argument("Unknown column: " + predicate.column);
+    }
+    const bool outside = predicate.op == CompareOp::NotEqual;
+
+    if (spec->type == ColumnType::Dict) {
+        if (predicate.op != CompareOp::Equal && predicate.op != CompareOp::NotEqual) {
+            throw std::invalid_argument(predicate.column + " can only be compared with == or !=");
+        }
+        const auto& strings = table.dictionary(spec->name);
+        auto it = std::find(strings.begin(), strings.end(), predicate.value);
+        uint32_t lo = std::numeric_limits<uint32_t>::max();
+        uint32_t hi = 0;
+        if (it != strings.end()) {
+            lo = hi = static_cast<uint32_t>(it - strings.begin());
+        }
+        const uint32_t* codes = table.values<uint32_t>(spec->name);
+        return [=](size_t begin, size_t count, uint8_t* mask) {
+            (outside ? keep_outside<uint32_t> : keep_inside<uint32_t>)(codes + begin, count, lo, hi, mask);
+            keep_not_null(codes + begin, count, mask);
+        };
+    }
+
+    double value = 0;
+    if (!parse_number(predicate.value, value)) {
+        throw std::invalid_argument("Not a number for " + predicate.column + ": " + predicate.value);
+    }
+    const void* data = table.map(spec->name);
+    const uint8_t* valid = table.validity(spec->name);
+    return dispatch_column_type(spec->type, [&](auto zero) -> BlockFilter {
+        using T = decltype(zero);
+        auto [lo, hi] = value_range<T>(predicate.op, value);
+        const T* values = static_cast<const T*>(data);
+        return [=](size_t begin, size_t count, uint8_t* mask) {
+            (outside ? keep_outside<T> : keep_inside<T>)(values + begin, count, lo, hi, mask);
+            if (valid != nullptr) {
+                keep_valid(valid + begin / 8, count, mask);
+            } else {
+                keep_not_null(values + begin, count, mask);
+            }
+        };
+    });
+}
+
+BlockCollect compile_collect(ColumnTable& table, const std::string& column) {
+    const ColumnSpec* spec = table.find(column);
+    if (spec == nullptr) {
+        throw std::invalid_argument("Unknown column: " + column);
+    }
+    if (spec->type == ColumnType::Dict) {
+        throw std::invalid_argument("Cannot aggregate text column " + column);
+    }
+    const void* data = table.map(spec->name);
+    const uint8_t* valid = table.validity(spec->name);
+    return dispatch_column_type(spec->type, [&](auto zero) -> BlockCollect {
+        using T = decltype(zero);
+        const T* values = static_cast<const T*>(data);
+        return [=](size_t begin, size_t count, const uint8_t* mask, std::vector<double>& out) {
+            for (size_t i = 0; i < count; ++i) {
+                if (mask[i] && column_valid(values, valid, begin + i)) {
+                    out.push_back(static_cast<double>(values[begin + i]));
+                }
+            }
+        };
+    });
+}
+
+// 1 for the newest snapshot of each serial number (the last one on ties)
+std::vector<uint8_t> latest_rows(ColumnTable& table) {
+    const uint32_t* serials = table.values<uint32_t>("serial");
+    const uint8_t* valid = table.validity("serial");
+    const int64_t* timestamps = table.values<int64_t>("timestamp");
+    std::unordered_map<uint32_t, size_t> newest;
+    for (size_t row = 0; row < table.rows(); ++row) {
+        if (!validity_bit(valid, row)) {
+            continue;
+        }
+        auto [it, added] = newest.emplace(serials[row], row);
+        if (!added && timestamps[row] >= timestamps[it->second]) {
+            it->second = row;
+        }
+    }
+    std::vector<uint8_t> latest(table.rows(), 0);
+    for (const auto& entry : newest) {
+        latest[entry.second] = 1;
+    }
+    return latest;
+}
+
+struct Partial {
+    size_t matched = 0;
+    std::vector<std::vector<double>> values;
+    std::vector<size_t> rows;
+};
+
+} // namespace
+
+std::vector<Predicate> parse_predicates(const std::string& expression) {
+    std::vector<std::string> tokens;
+    size_t i = 0;
+    while (i < expression.size()) {
+        char c = expression[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            ++i;
+        } else if (c == '"') {
+            size_t end = expression.find('"', i + 1);
+            if (end == std::string::npos) {
+                throw std::invalid_argument("Unterminated string in query");
+            }
+            tokens.push_back(expression.substr(i, end - i + 1));
+            i = end + 1;
+        } else if (std::strchr("<>=!&", c) != nullptr) {
+            size_t length = (i + 1 < expression.size() && std::strchr("=&", expression[i + 1])) ? 2 : 1;
+            tokens.push_back(expression.substr(i, length));
+            i += length;
+        } else {
+            size_t end = i;
+            while (end < expression.size() && !std::isspace(static_cast<unsigned char>(expression[end])) &&
+                   std::strchr("<>=!&\"", expression[end]) == nullptr) {
+                ++end;
+            }
+            tokens.push_back(expression.substr(i, end - i));
+            i = end;
+        }
+    }
+
+    static const std::pair<const char*, CompareOp> OPS[] = {
+        {"<", CompareOp::Less}, {"<=", CompareOp::LessEqual}, {">", CompareOp::Greater},
+        {">=", CompareOp::GreaterEqual}, {"==", CompareOp::Equal}, {"=", CompareOp::Equal},
+        {"!=", CompareOp::NotEqual},
+    };
+
+    std::vector<Predicate> predicates;
+    for (size_t t = 0; t < tokens.size();) {
+        if (!predicates.empty()) {
+            if (tokens[t] != "and" && tokens[t] != "&&") {
+                throw std::invalid_argument("Expected 'and' before " + tokens[t]);
+            }
+            ++t;
+        }
+        if (t + 3 > tokens.size()) {
+            throw std::invalid_argument("Expected COLUMN OP VALUE at end of query");
+        }
+        Predicate predicate;
+        predicate.column = tokens[t];
+        auto op = std::find_if(std::begin(OPS), std::end(OPS),
+                               [&](const auto& entry) { return tokens[t + 1] == entry.first; });
+        if (op == std::end(OPS)) {
+            throw std::invalid_argument("Unknown operator " + tokens[t + 1]);
+        }
+        predicate.op = op->second;
+        predicate.value = tokens[t + 2];
+        if (predicate.value.size() >= 2 && predicate.value.front() == '"') {
+            predicate.value = predicate.value.substr(1, predicate.value.size() - 2);
+        }
+        predicates.push_back(std::move(predicate));
+        t += 3;
+    }
+    return predicates;
+}
+
+QueryResult run_query(ColumnTable& table, const QueryOptions& options) {
+    const auto start = std::chrono::steady_clock::now();
+
+    // Map everything up front; the table is not shared safely while mapping
+    std::vector<BlockFilter> filters;
+    for (const auto& predicate : options.where) {
+        filters.push_back(compile_predicate(table, predicate));
+    }
+    std::vector<BlockCollect> collects;
+    for (const auto& column : options.stats) {
+        collects.push_back(compile_collect(table, column));
+    }
+    std::vector<uint8_t> latest;
+    if (options.latest_only) {
+        latest = latest_rows(table);
+    }
+
+    const size_t rows = table.rows();
+    const size_t blocks = (rows + BLOCK - 1) / BLOCK;
+    size_t threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max<size_t>(1, std::min(threads, blocks));
+
+    std::vector<Partial> partials(threads);
+    auto work = [&](size_t index) {
+        Partial& partial = partials[index];
+        partial.values.resize(collects.size());
+        Mask mask;
+        const size_t first = blocks * index / threads;
+        const size_t last = blocks * (index + 1) / threads;
+        for (size_t block = first; block < last; ++block) {
+            const size_t begin = block * BLOCK;
+            const size_t count = std::min(BLOCK, rows - begin);
+            if (latest.empty()) {
+                std::memset(mask.data(), 1, count);
+            } else {
+                std::memcpy(mask.data(), latest.data() + begin, count);
+            }
+            for (const auto& filter : filters) {
+                filter(begin, count, mask.data());
+            }
+
+            size_t matched = 0;
+            for (size_t i = 0; i < count; ++i) {
+                matched += mask[i];
+            }
+            if (matched == 0) {
+                continue;
+            }
+            partial.matched += matched;
+            for (size_t s = 0; s < collects.size(); ++s) {
+                collects[s](begin, count, mask.data(), partial.values[s]);
+            }
+            for (size_t i = 0; i < count && partial.rows.size() < options.max_rows; ++i) {
+                if (mask[i]) {
+                    partial.rows.push_back(begin + i);
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t) {
+        workers.emplace_back(work, t);
+    }
+    if (blocks > 0) {
+        work(0);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    QueryResult result;
+    result.scanned = options.latest_only ? static_cast<size_t>(std::count(latest.begin(), latest.end(), 1)) : rows;
+    result.threads = blocks > 0 ? threads : 0;
+    for (const auto& partial : partials) {
+        result.matched += partial.matched;
+        for (size_t row : partial.rows) {
+            if (result.rows.size() < options.max_rows) {
+                result.rows.push_back(row);
+            }
+        }
+    }
+    for (size_t s = 0; s < options.stats.size(); ++s) {
+        ColumnStats stats;
+        stats.column = options.stats[s];
+        std::vector<double> values;
+        for (auto& partial : partials) {
+            if (!partial.values.empty()) {
+                values.insert(values.end(), partial.values[s].begin(), partial.values[s].end());
+            }
+        }
+        stats.count = values.size();
+        if (!values.empty()) {
+            std::sort(values.begin(), values.end());
+            for (double v : values) {
+                stats.sum += v;
+            }
+            stats.min = values.front();
+            stats.max = values.back();
+            for (double p : options.percentiles) {
+                // Nearest rank, as LatencyHistogram::percentile
+                size_t rank = static_cast<size_t>(std::max(1.0, p * values.size() + 0.5));
+                stats.percentiles.push_back(values[std::min(rank, values.size()) - 1]);
+            }
+        } else {
+            stats.percentiles.assign(options.percentiles.size(), 0);
+        }
+        result.stats.push_back(std::move(stats));
+    }
+    result.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void print_query_result(std::ostream& out, ColumnTable& table, const QueryOptions& options,
+                        const QueryResult& result, const std::vector<std::string>& select) {
+    out << result.matched << " of " << result.scanned << (options.latest_only ? " packs" : " snapshots")
+        << " match (" << std::fixed << std::setprecision(2) << result.elapsed_ms << " ms, " << result.threads
+        << (result.threads == 1 ? " thread)" : " threads)") << std::defaultfloat << std::setprecision(6) << std::endl;
+
+    if (!result.stats.empty()) {
+        out << "\n" << std::left << std::setw(24) << "column" << std::right << std::setw(8) << "count"
+            << std::setw(12) << "sum" << std::setw(12) << "min" << std::setw(12) << "max";
+        for (double p : options.percentiles) {
+            out << std::setw(12) << ("p" + std::to_string(static_cast<int>(std::lround(p * 100))));
+        }
+        out << std::endl;
+        for (const auto& stats : result.stats) {
+            out << std::left << std::setw(24) << stats.column << std::right << std::setw(8) << stats.count
+                << std::setw(12) << stats.sum << std::setw(12) << stats.min << std::setw(12) << stats.max;
+            for (double value : stats.percentiles) {
+                out << std::setw(12) << value;
+            }
+            out << std::endl;
+        }
+    }
+
+    if (select.empty() || result.rows.empty()) {
+        return;
+    }
+
+    std::vector<std::vector<std::string>> cells(result.rows.size());
+    std::vector<size_t> widths;
+    for (const auto& column : select) {
+        const ColumnSpec* spec = table.find(column);
+        if (spec == nullptr) {
+            throw std::invalid_argument("Unknown column: " + column);
+        }
+        const void* data = table.map(column);
+        const uint8_t* valid = table.validity(column);
+        size_t width = column.size();
+        for (size_t r = 0; r < result.rows.size(); ++r) {
+            const size_t row = result.rows[r];
+            std::string text = "-";
+            if (spec->type == ColumnType::Dict) {
+                uint32_t code = static_cast<const uint32_t*>(data)[row];
+                const auto& strings = table.dictionary(column);
+                if (code < strings.size()) {
+                    text = strings[code];
+                }
+            } else {
+                dispatch_column_type(spec->type, [&](auto zero) {
+                    using T = decltype(zero);
+                    const T* values = static_cast<const T*>(data);
+                    if (column_valid(values, valid, row)) {
+                        std::ostringstream formatted;
+                        formatted << +values[row];
+                        text = formatted.str();
+                    }
+                });
+            }
+            width = std::max(width, text.size());
+            cells[r].push_back(std::move(text));
+        }
+        widths.push_back(width);
+    }
+
+    out << "\n" << std::left;
+    for (size_t c = 0; c < select.size(); ++c) {
+        out << std::setw(static_cast<int>(widths[c] + 2)) << select[c];
+    }
+    out << std::endl;
+    for (const auto& row : cells) {
+        for (size_t c = 0; c < row.size(); ++c) {
+            out << std::setw(static_cast<int>(widths[c] + 2)) << row[c];
+        }
+        out << std::endl;
+    }
+    out << std::right;
+}
@@ -0,0 +1,385 @@
+#include "reactor.hpp"
+#include "frame_codec.hpp"
+#include "m18.hpp"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+BatterySession::BatterySession(const std::string& port, std::vector<ReadSpan> plan,
+                               const TimingProfile& timing, bool force_refresh, uint8_t configure_state)
+    : port_name_(port), plan_(std::move(plan)), timing_(timing), configure_state_(configure_state),
+      timer_fd_(-1), state_(State::Start), phase_(force_refresh ? Phase::Sweep : Phase::Reads),
+      reads_(force_refresh ? data_matrix_reads() : plan_), next_span_(0), failed_reads_(0), resets_(0),
+      configured_(false), response_{}, expected_(0), received_(0), awaiting_configure_(false) {
+}
+
+BatterySession::~BatterySession() {
+    if (timer_fd_ >= 0) {
+        ::close(timer_fd_);
+    }
+}
+
+double BatterySession::elapsed_seconds() const {
+    auto end = finished() ? finished_ : std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - started_).count();
+}
+
+void BatterySession::start() {
+    started_ = std::chrono::steady_clock::now();
+    if (retest_ && cache_ && phase_ == Phase::Sweep) {
+        // Read the span holding the serial; the sweep follows only if the
+        // cache does not know the pack
+        const DataIdEntry& sn = DATA_ID[RegisterCache::SERIAL_ID];
+        ReadSpan serial{sn.addr, sn.length};
+        for (const auto& span : plan_) {
+            if (span.addr <= sn.addr && sn.addr + sn.length <= span.addr + span.length) {
+                serial = span;
+                break;
+            }
+        }
+        phase_ = Phase::Serial;
+        reads_ = {serial};
+    }
+    try {
+        port_ = std::make_unique<SerialPort>(port_name_, 4800, 0.8);
+        port_->set_low_latency(low_latency_);
+        if (!port_->open()) {
+            finish(State::Failed, "failed to configure port");
+            return;
+        }
+        timer_fd_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timer_fd_ < 0) {
+            throw std::runtime_error("timerfd_create failed: " + std::string(strerror(errno)));
+        }
+        begin_reset();
+    } catch (const std::exception& e) {
+        finish(State::Failed, e.what());
+    }
+}
+
+void BatterySession::arm_timer(TimingProfile::usec delay) {
+    // Every state waits on the timer, so clamping it to the deadline is
+    // enough to end the session there. An all-zero itimerspec disarms the
+    // timer, so a zero gap becomes 1ns.
+    auto wait = std::min<std::chrono::nanoseconds>(delay, deadline_ - std::chrono::steady_clock::now());
+    auto ns = std::max<long long>(wait.count(), 1);
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = static_cast<time_t>(ns / 1000000000);
+    spec.it_value.tv_nsec = static_cast<long>(ns % 1000000000);
+    ::timerfd_settime(timer_fd_, 0, &spec, nullptr);
+}
+
+void BatterySession::begin_reset() {
+    if (++resets_ > MAX_RESETS) {
+        finish(State::Failed, "battery did not respond to reset");
+        return;
+    }
+    port_->set_break(true);
+    port_->set_dtr(true);
+    state_ = State::BreakHold;
+    arm_timer(timing_.break_hold);
+}
+
+void BatterySession::begin_known_or_sweep() {
+    // A known pack goes straight to the planned reads it still needs,
+    // within the same session; otherwise the sweep runs as usual
+    cached_ = cache_->restore(image_);
+    reads_.clear();
+    if (cached_) {
+        for (const auto& span : plan_) {
+            if (!image_.contains(span.addr, span.length)) {
+                reads_.push_back(span);
+            }
+        }
+        phase_ = Phase::Reads;
+    } else {
+        reads_ = data_matrix_reads();
+        phase_ = Phase::Sweep;
+    }
+    next_span_ = 0;
+    failed_reads_ = 0;
+    send_next();
+}
+
+void BatterySession::begin_reads() {
+    // As M18::refresh(): once the sweep ends the pack updates the 0x9000
+    // block, so idle, drop the regions that change and reset before reading
+    // them (and anything the sweep failed to read) again
+    port_->set_break(true);
+    port_->set_dtr(true);
+    for (const auto& region : REGISTER_REGIONS) {
+        if (region.refreshed) {
+            image_.invalidate(region.start, region.end - region.start);
+        }
+    }
+    reads_.clear();
+    for (const auto& span : plan_) {
+        if (!image_.contains(span.addr, span.length)) {
+            reads_.push_back(span);
+        }
+    }
+    phase_ = Phase::Reads;
+    next_span_ = 0;
+    failed_reads_ = 0;
+    state_ = State::RefreshSettle;
+    arm_timer(timing_.refresh_settle);
+}
+
+void BatterySession::send_next() {
+    uint8_t command[11];
+    size_t length = 0;
+
+    if (configure_state_ != 0 && !configured_) {
+        const uint8_t conf[] = {
+            M18::CONF_CMD, 4, 8,
+            static_cast<uint8_t>((M18::CUTOFF_CURRENT >> 8) & 0xFF),
+            static_cast<uint8_t>(M18::CUTOFF_CURRENT & 0xFF),
+            static_cast<uint8_t>((M18::MAX_CURRENT >> 8) & 0xFF),
+            static_cast<uint8_t>(M18::MAX_CURRENT & 0xFF),
+            static_cast<uint8_t>((M18::MAX_CURRENT >> 8) & 0xFF),
+            static_cast<uint8_t>(M18::MAX_CURRENT & 0xFF),
+            configure_state_, 13
+        };
+        std::memcpy(command, conf, sizeof(conf));
+        length = sizeof(conf);
+        expected_ = 5;
+        awaiting_configure_ = true;
+    } else if (next_span_ < reads_.size()) {
+        const ReadSpan& span = reads_[next_span_];
+        const uint8_t read[] = {
+            0x01, 0x04, 0x03,
+            static_cast<uint8_t>((span.addr >> 8) & 0xFF),
+            static_cast<uint8_t>(span.addr & 0xFF),
+            static_cast<uint8_t>(span.length)
+        };
+        std::memcpy(command, read, sizeof(read));
+        length = sizeof(read);
+        expected_ = span.length + 5u;
+    } else if (phase_ == Phase::Serial) {
+        begin_known_or_sweep();
+        return;
+    } else if (phase_ == Phase::Sweep) {
+        begin_reads();
+        return;
+    } else {
+        if (cache_ && !cached_) {
+            cache_->remember(image_);
+        }
+        finish(State::Done);
+        return;
+    }
+
+    uint8_t wire[frame_codec::MAX_FRAME];
+    size_t size = frame_codec::encode(command, length, wire);
+    port_->reset_input_buffer();
+    port_->write(wire, size);
+    received_ = 0;
+    state_ = State::AwaitResponse;
+    arm_timer(timing_.response_timeout);
+}
+
+void BatterySession::complete_response() {
+    frame_codec::reverse_in_place(response_, received_);
+
+    if (awaiting_configure_) {
+        awaiting_configure_ = false;
+        configured_ = true;
+    } else {
+        const ReadSpan& span = reads_[next_span_];
+        if (response_[0] == 0x81 && received_ == span.length + 5u &&
+            frame_codec::checksum_ok(response_, received_)) {
+            image_.store(span.addr, response_ + 3, span.length);
+        } else {
+            ++failed_reads_;
+        }
+        ++next_span_;
+    }
+
+    state_ = State::Gap;
+    arm_timer(timing_.frame_gap(expected_));
+}
+
+void BatterySession::on_readable() {
+    port_->pump();
+
+    if (state_ == State::AwaitSync) {
+        uint8_t byte;
+        if (port_->take(&byte, 1) == 1) {
+            if (frame_codec::reverse_bits(byte) == M18::SYNC_BYTE) {
+                resets_ = 0;
+                state_ = State::SyncSettle;
+                arm_timer(timing_.sync_settle);
+            } else {
+                begin_reset();
+            }
+        }
+    } else if (state_ == State::AwaitResponse) {
+        received_ += port_->take(response_ + received_, expected_ - received_);
+        if (received_ >= 1 && frame_codec::reverse_bits(response_[0]) == 0x82) {
+            expected_ = 2;  // error responses are two bytes
+        }
+        if (received_ >= expected_) {
+            received_ = expected_;
+            complete_response();
+        }
+    }
+
+    // Anything outside a response is line noise
+    if (state_ != State::AwaitSync && state_ != State::AwaitResponse && port_ && port_->is_open()) {
+        uint8_t scratch[64];
+        while (port_->take(scratch, sizeof(scratch)) > 0) {
+        }
+    }
+}
+
+void BatterySession::on_timer() {
+    uint64_t expirations;
+    if (::read(timer_fd_, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;  // spurious wakeup
+    }
+    if (std::chrono::steady_clock::now() >= deadline_) {
+        finish(State::TimedOut, "session deadline passed");
+        return;
+    }
+
+    switch (state_) {
+        case State::BreakHold:
+            port_->set_break(false);
+            port_->set_dtr(false);
+            state_ = State::BreakRecovery;
+            arm_timer(timing_.break_recovery);
+            break;
+        case State::BreakRecovery: {
+            port_->reset_input_buffer();
+            const uint8_t sync = frame_codec::reverse_bits(M18::SYNC_BYTE);
+            port_->write(&sync, 1);
+            state_ = State::AwaitSync;
+            arm_timer(timing_.response_timeout);
+            break;
+        }
+        case State::AwaitSync:
+            begin_reset();
+            break;
+        case State::AwaitResponse:
+            // A timeout usually means the pack lost sync: count the read as
+            // failed and resync before moving on
+            if (awaiting_configure_) {
+                awaiting_configure_ = false;
+                configured_ = true;
+            } else {
+                ++failed_reads_;
+                ++next_span_;
+            }
+            begin_reset();
+            break;
+        case State::SyncSettle:
+        case State::Gap:
+            send_next();
+            break;
+        case State::RefreshSettle:
+            begin_reset();
+            break;
+        default:
+            break;
+    }
+}
+
+void BatterySession::finish(State state, const std::string& error) {
+    state_ = state;
+    error_ = error;
+    finished_ = std::chrono::steady_clock::now();
+
+    if (port_ && port_->is_open()) {
+        try {
+            // Leave the pack idle (TX low) like M18::idle()
+            port_->set_break(true);
+            port_->set_dtr(true);
+        } catch (const std::exception&) {
+        }
+        port_->close();
+    }
+    if (timer_fd_ >= 0) {
+        ::close(timer_fd_);
+        timer_fd_ = -1;
+    }
+}
+
+SessionReactor::SessionReactor() : epoll_fd_(::epoll_create1(EPOLL_CLOEXEC)) {
+    if (epoll_fd_ < 0) {
+        throw std::runtime_error("epoll_create1 failed: " + std::string(strerror(errno)));
+    }
+}
+
+SessionReactor::~SessionReactor() {
+    ::close(epoll_fd_);
+}
+
+void SessionReactor::add(BatterySession& session) {
+    sessions_.push_back(&session);
+    session.start();
+    if (session.finished()) {
+        return;
+    }
+
+    for (bool timer : {false, true}) {
+        handles_.push_back(std::make_unique<Handle>(Handle{&session, timer}));
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = handles_.back().get();
+        int fd = timer ? session.timer_fd_ : session.port_->fd();
+        if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            session.finish(BatterySession::State::Failed,
+                           "epoll_ctl failed: " + std::string(strerror(errno)));
+            return;
+        }
+    }
+}
+
+void SessionReactor::run() {
+    constexpr int MAX_EVENTS = 64;
+    struct epoll_event events[MAX_EVENTS];
+
+    auto pending = [this]() {
+        for (auto* session : sessions_) {
+            if (!session->finished()) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    while (pending()) {
+        int count = ::epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("epoll_wait failed: " + std::string(strerror(errno)));
+        }
+
+        for (int i = 0; i < count; ++i) {
+            auto* handle = static_cast<Handle*>(events[i].data.ptr);
+            BatterySession* session = handle->session;
+            if (session->finished()) {
+                continue;  // fds were closed earlier in this batch
+            }
+            try {
+                if (handle->timer) {
+                    session->on_timer();
+                } else if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    // A hung-up tty stays ready and reads nothing, so
+                    // on_readable() would spin on it until the timer fired
+                    session->finish(BatterySession::State::Failed, "Serial port disconnected");
+                } else {
+                    session->on_readable();
+                }
+            } catch (const std::exception& e) {
+                session->finish(BatterySession::State::Failed, e.what());
+            }
+        }
+    }
+}
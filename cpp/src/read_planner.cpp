@@ -0,0 +1,51 @@
+#include "read_planner.hpp"
+#include "data_tables.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+std::vector<ReadSpan> plan_reads(const std::vector<int>& ids) {
+    // Sort the requested fields by address, dropping duplicates
+    std::vector<ReadSpan> fields;
+    fields.reserve(ids.size());
+    for (int id : ids) {
+        if (id < 0 || static_cast<size_t>(id) >= DATA_ID.size()) {
+            throw std::out_of_range("DATA_ID index out of range: " + std::to_string(id));
+        }
+        fields.push_back({DATA_ID[id].addr, DATA_ID[id].length});
+    }
+    std::sort(fields.begin(), fields.end(), [](const ReadSpan& a, const ReadSpan& b) {
+        return a.addr < b.addr || (a.addr == b.addr && a.length > b.length);
+    });
+
+    // Greedy merge in address order is optimal for a fixed maximum span
+    std::vector<ReadSpan> plan;
+    const RegisterRegion* current_region = nullptr;
+    for (const auto& field : fields) {
+        const RegisterRegion* region = find_region(field.addr);
+        if (!plan.empty() && region != nullptr && region == current_region) {
+            ReadSpan& last = plan.back();
+            uint32_t last_end = last.addr + last.length;
+            uint32_t field_end = field.addr + field.length;
+            if (field_end <= last_end) {
+                continue;  // already covered
+            }
+            if (field.addr <= last_end && field_end - last.addr <= region->max_read) {
+                last.length = static_cast<uint16_t>(field_end - last.addr);
+                continue;
+            }
+        }
+        plan.push_back(field);
+        current_region = region;
+    }
+    return plan;
+}
+
+std::vector<ReadSpan> data_matrix_reads() {
+    std::vector<ReadSpan> plan;
+    plan.reserve(DATA_MATRIX.size());
+    for (const auto& row : DATA_MATRIX) {
+        plan.push_back({row.addr(), row.length});
+    }
+    return plan;
+}
@@ -0,0 +1,248 @@
+#include "record_writer.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+char* put_digits(char* out, uint64_t value, int width) {
+    for (int i = width - 1; i >= 0; --i) {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+    return out + width;
+}
+
+int64_t floor_div(int64_t a, int64_t b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+} // namespace
+
+char* format_date(char* out, int64_t epoch_seconds, bool with_time) {
+    const int64_t days = floor_div(epoch_seconds, 86400);
+    const int64_t seconds = epoch_seconds - days * 86400;
+    const CivilDate date = civil_from_days(days);
+    out = put_digits(out, static_cast<uint64_t>(date.year), 4);
+    *out++ = '-';
+    out = put_digits(out, date.month, 2);
+    *out++ = '-';
+    out = put_digits(out, date.day, 2);
+    if (with_time) {
+        *out++ = ' ';
+        out = put_digits(out, static_cast<uint64_t>(seconds / 3600), 2);
+        *out++ = ':';
+        out = put_digits(out, static_cast<uint64_t>(seconds / 60 % 60), 2);
+        *out++ = ':';
+        out = put_digits(out, static_cast<uint64_t>(seconds % 60), 2);
+    }
+    return out;
+}
+
+char* format_hhmmss(char* out, uint32_t seconds) {
+    out = std::to_chars(out, out + 10, seconds / 3600).ptr;
+    *out++ = ':';
+    out = put_digits(out, seconds / 60 % 60, 2);
+    *out++ = ':';
+    return put_digits(out, seconds % 60, 2);
+}
+
+std::string date_string(int64_t epoch_seconds, bool with_time) {
+    char text[DATE_CHARS];
+    return std::string(text, format_date(text, epoch_seconds, with_time));
+}
+
+std::string hhmmss_string(uint32_t seconds) {
+    char text[HHMMSS_CHARS];
+    return std::string(text, format_hhmmss(text, seconds));
+}
+
+void RecordBuffer::put_date(int64_t epoch_seconds) {
+    char text[DATE_CHARS];
+    data_.insert(data_.end(), text, format_date(text, epoch_seconds));
+}
+
+void RecordBuffer::put_hhmmss(uint32_t seconds) {
+    char text[HHMMSS_CHARS];
+    data_.insert(data_.end(), text, format_hhmmss(text, seconds));
+}
+
+void RecordBuffer::put_json_string(std::string_view text) {
+    static constexpr char HEX[] = "0123456789abcdef";
+    put('"');
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            put('\\');
+            put(static_cast<char>(c));
+        } else if (c < 0x20 || c >= 0x7F) {
+            const char escaped[] = {'\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xF]};
+            put(std::string_view(escaped, sizeof(escaped)));
+        } else {
+            put(static_cast<char>(c));
+        }
+    }
+    put('"');
+}
+
+void RecordBuffer::put_csv_field(std::string_view text) {
+    if (text.find_first_of(",\"\r\n") == std::string_view::npos) {
+        put(text);
+        return;
+    }
+    put('"');
+    for (char c : text) {
+        if (c == '"') {
+            put('"');
+        }
+        put(c);
+    }
+    put('"');
+}
+
+RecordWriter::RecordWriter(const std::string& path, RecordFormat format) : format_(format) {
+    if (path == "-") {
+        fd_ = STDOUT_FILENO;
+        owns_fd_ = false;
+    } else {
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            throw std::runtime_error("Cannot create " + path + ": " + strerror(errno));
+        }
+        owns_fd_ = true;
+    }
+
+    if (format_ == RecordFormat::Csv) {
+        RecordBuffer header;
+        header.put("time,source");
+        for (size_t id = 0; id < DATA_ID.size(); ++id) {
+            const DataIdEntry& entry = DATA_ID[id];
+            if (entry.length == 0) {
+                continue;
+            }
+            const std::string name = "id" + std::to_string(id);
+            if (entry.type == RegType::Sn) {
+                header.put("," + name + ".type," + name + ".serial");
+            } else if (entry.type == RegType::CellV) {
+                for (int cell = 1; cell <= 5; ++cell) {
+                    header.put("," + name + ".cell" + std::to_string(cell));
+                }
+            } else {
+                header.put("," + name);
+            }
+        }
+        header.put('\n');
+        emit(header);
+    }
+}
+
+RecordWriter::~RecordWriter() {
+    if (owns_fd_) {
+        ::close(fd_);
+    }
+}
+
+bool RecordWriter::ok() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !failed_;
+}
+
+void RecordWriter::write(int64_t timestamp, std::string_view source, const DecodedRegisters& values) {
+    // Reused by every record this thread writes
+    thread_local RecordBuffer buffer;
+    buffer.clear();
+    const bool json = format_ == RecordFormat::Ndjson;
+
+    if (json) {
+        buffer.put("{\"time\":\"");
+        buffer.put_date(timestamp);
+        buffer.put("\",\"source\":");
+        buffer.put_json_string(source);
+    } else {
+        buffer.put_date(timestamp);
+        buffer.put(',');
+        buffer.put_csv_field(source);
+    }
+
+    char key[16] = "id";
+    for (size_t id = 0; id < DATA_ID.size(); ++id) {
+        if (DATA_ID[id].length == 0) {
+            continue;
+        }
+        if (json) {
+            char* end = std::to_chars(key + 2, key + sizeof(key), id).ptr;
+            buffer.put(",\"");
+            buffer.put(std::string_view(key, static_cast<size_t>(end - key)));
+            buffer.put("\":");
+        } else {
+            buffer.put(',');
+        }
+
+        std::visit([&](const auto& v) {
+            using V = std::decay_t<decltype(v)>;
+            if constexpr (std::is_same_v<V, std::monostate>) {
+                if (json) {
+                    buffer.put("null");
+                } else if (DATA_ID[id].type == RegType::Sn) {
+                    buffer.put(',');
+                } else if (DATA_ID[id].type == RegType::CellV) {
+                    buffer.put(",,,,");
+                }
+            } else if constexpr (std::is_same_v<V, uint32_t>) {
+                buffer.put_number(v);
+            } else if constexpr (std::is_same_v<V, DateValue>) {
+                json ? buffer.put('"') : void();
+                buffer.put_date(v.epoch);
+                json ? buffer.put('"') : void();
+            } else if constexpr (std::is_same_v<V, DurationValue>) {
+                json ? buffer.put('"') : void();
+                buffer.put_hhmmss(v.seconds);
+                json ? buffer.put('"') : void();
+            } else if constexpr (std::is_same_v<V, AsciiValue>) {
+                json ? buffer.put_json_string(v.view()) : buffer.put_csv_field(v.view());
+            } else if constexpr (std::is_same_v<V, SerialNumber>) {
+                buffer.put(json ? "{\"type\":" : "");
+                buffer.put_number(v.type);
+                buffer.put(json ? ",\"serial\":" : ",");
+                buffer.put_number(v.serial);
+                json ? buffer.put('}') : void();
+            } else if constexpr (std::is_same_v<V, CellArray>) {
+                json ? buffer.put('[') : void();
+                for (size_t i = 0; i < v.size(); ++i) {
+                    if (i) {
+                        buffer.put(',');
+                    }
+                    buffer.put_number(v[i]);
+                }
+                json ? buffer.put(']') : void();
+            } else if constexpr (std::is_same_v<V, TemperatureValue>) {
+                buffer.put_number(v.celsius);
+            }
+        }, values[id]);
+    }
+    buffer.put(json ? "}\n" : "\n");
+    emit(buffer);
+}
+
+void RecordWriter::emit(const RecordBuffer& buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const char* data = buffer.data();
+    size_t remaining = buffer.size();
+    // A single write normally takes the whole record; the loop only
+    // matters for pipes that accept part of it
+    while (remaining > 0 && !failed_) {
+        ssize_t n = ::write(fd_, data, remaining);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Cannot write records: " << strerror(errno) << std::endl;
+            failed_ = true;
+            break;
+        }
+        data += n;
+        remaining -= static_cast<size_t>(n);
+    }
+}
@@ -0,0 +1,204 @@
+#include "register_cache.hpp"
+#include "register_decode.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Create the directories leading up to path; existing ones are fine
+void make_parents(const std::string& path) {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        ::mkdir(path.substr(0, slash).c_str(), 0755);
+    }
+}
+
+bool parse_hex(const std::string& text, uint8_t* out, size_t length) {
+    if (text.size() != length * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        char* end = nullptr;
+        std::string byte = text.substr(i * 2, 2);
+        unsigned long value = std::strtoul(byte.c_str(), &end, 16);
+        if (*end != '\0') {
+            return false;
+        }
+        out[i] = static_cast<uint8_t>(value);
+    }
+    return true;
+}
+
+} // namespace
+
+RegisterCache::RegisterCache(std::string path) : path_(std::move(path)) {
+    if (!path_.empty() && ::access(path_.c_str(), F_OK) == 0 && !load(path_)) {
+        std::cerr << "Warning: ignoring register cache " << path_ << std::endl;
+    }
+}
+
+size_t RegisterCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+bool RegisterCache::restore(RegisterImage& image) const {
+    const DataIdEntry& sn_entry = DATA_ID[SERIAL_ID];
+    const uint8_t* sn_data = image.data(sn_entry.addr, sn_entry.length);
+    if (sn_data == nullptr) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(decode_id<SERIAL_ID>(sn_data).serial);
+    if (it == entries_.end()) {
+        return false;
+    }
+
+    // Validate before storing anything: a different pack type with the
+    // same serial must be read in full
+    const uint8_t* cached = it->second.data();
+    size_t offset = 0;
+    for (int id : IDS) {
+        if (id == SERIAL_ID && std::memcmp(cached + offset, sn_data, sn_entry.length) != 0) {
+            return false;
+        }
+        offset += DATA_ID[id].length;
+    }
+
+    // Registers just read from the pack are kept over cached copies
+    offset = 0;
+    for (int id : IDS) {
+        if (!image.contains(DATA_ID[id].addr, DATA_ID[id].length)) {
+            image.store(DATA_ID[id].addr, cached + offset, DATA_ID[id].length);
+        }
+        offset += DATA_ID[id].length;
+    }
+    return true;
+}
+
+bool RegisterCache::remember(const RegisterImage& image) {
+    std::array<uint8_t, BYTES> bytes;
+    size_t offset = 0;
+    for (int id : IDS) {
+        const uint8_t* data = image.data(DATA_ID[id].addr, DATA_ID[id].length);
+        if (data == nullptr) {
+            return false;
+        }
+        std::memcpy(bytes.data() + offset, data, DATA_ID[id].length);
+        offset += DATA_ID[id].length;
+    }
+
+    const uint32_t serial = decode_id<SERIAL_ID>(image.data(DATA_ID[SERIAL_ID].addr, DATA_ID[SERIAL_ID].length)).serial;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto inserted = entries_.emplace(serial, bytes);
+    if (!inserted.second) {
+        if (inserted.first->second == bytes) {
+            return false;
+        }
+        inserted.first->second = bytes;
+    }
+    if (!path_.empty()) {
+        save_locked(path_);
+    }
+    return true;
+}
+
+bool RegisterCache::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open register cache: " << path << std::endl;
+        return false;
+    }
+
+    std::unordered_map<uint32_t, std::array<uint8_t, BYTES>> loaded;
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        uint32_t serial = 0;
+        if (!(fields >> serial)) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                continue;
+            }
+            std::cerr << path << ":" << line_no << ": expected a serial number" << std::endl;
+            return false;
+        }
+
+        std::array<uint8_t, BYTES> bytes;
+        size_t offset = 0;
+        for (int id : IDS) {
+            std::string hex;
+            if (!(fields >> hex) || !parse_hex(hex, bytes.data() + offset, DATA_ID[id].length)) {
+                std::cerr << path << ":" << line_no << ": invalid register 0x" << std::hex << std::setw(4)
+                          << std::setfill('0') << DATA_ID[id].addr << std::dec << std::setfill(' ') << std::endl;
+                return false;
+            }
+            offset += DATA_ID[id].length;
+        }
+        loaded[serial] = bytes;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_ = std::move(loaded);
+    return true;
+}
+
+bool RegisterCache::save(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return save_locked(path);
+}
+
+bool RegisterCache::save_locked(const std::string& path) const {
+    make_parents(path);
+    // Write a new file and rename it, so a crash never leaves half a cache
+    const std::string tmp = path + ".tmp";
+    std::ofstream out(tmp);
+    if (!out) {
+        std::cerr << "Cannot write register cache: " << tmp << std::endl;
+        return false;
+    }
+
+    out << "# M18 register cache: serial";
+    for (int id : IDS) {
+        out << " 0x" << std::hex << std::setw(4) << std::setfill('0') << DATA_ID[id].addr;
+    }
+    out << std::dec << std::setfill(' ') << "\n";
+
+    out << std::hex << std::uppercase << std::setfill('0');
+    for (const auto& entry : entries_) {
+        out << std::dec << entry.first << std::hex;
+        size_t offset = 0;
+        for (int id : IDS) {
+            out << ' ';
+            for (uint16_t i = 0; i < DATA_ID[id].length; ++i) {
+                out << std::setw(2) << static_cast<int>(entry.second[offset + i]);
+            }
+            offset += DATA_ID[id].length;
+        }
+        out << "\n";
+    }
+    out.close();
+
+    if (!out || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "Cannot write register cache: " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string RegisterCache::default_path() {
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0') {
+        return std::string(xdg) + "/m18/registers";
+    }
+    const char* home = std::getenv("HOME");
+    return std::string(home != nullptr ? home : ".") + "/.cache/m18/registers";
+}
@@ -0,0 +1,78 @@
+#include "register_image.hpp"
+#include <algorithm>
+
+void RegisterImage::store(uint16_t addr, const uint8_t* data, size_t length) {
+    // Reads normally stay inside one region, so look it up once per run
+    size_t i = 0;
+    while (i < length) {
+        uint16_t a = static_cast<uint16_t>(addr + i);
+        const RegisterRegion* region = find_region(a);
+        if (region == nullptr) {
+            ++i;
+            continue;
+        }
+        size_t run = std::min<size_t>(length - i, region->end - a);
+        long offset = offset_of(a);
+        std::copy(data + i, data + i + run, bytes_.begin() + offset);
+        for (size_t j = 0; j < run; ++j) {
+            valid_.set(offset + j);
+        }
+        i += run;
+    }
+}
+
+const uint8_t* RegisterImage::data(uint16_t addr, size_t length) const {
+    if (!contains(addr, length)) {
+        return nullptr;
+    }
+    return bytes_.data() + offset_of(addr);
+}
+
+bool RegisterImage::contains(uint16_t addr, size_t length) const {
+    // Fields never straddle two regions, so one offset lookup is enough
+    const RegisterRegion* region = find_region(addr);
+    if (region == nullptr || length == 0 || addr + length > region->end) {
+        return false;
+    }
+    long offset = offset_of(addr);
+    for (size_t i = 0; i < length; ++i) {
+        if (!valid_.test(offset + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void RegisterImage::invalidate(uint16_t addr, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        long offset = offset_of(static_cast<uint16_t>(addr + i));
+        if (offset >= 0) {
+            valid_.reset(offset);
+        }
+    }
+}
+
+void RegisterImage::clear() {
+    valid_.reset();
+}
+
+void RegisterImage::pack_valid(uint8_t* bits) const {
+    std::fill(bits, bits + VALID_BYTES, 0);
+    for (size_t i = 0; i < SIZE; ++i) {
+        if (valid_.test(i)) {
+            bits[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+        }
+    }
+}
+
+void RegisterImage::assign_raw(const uint8_t* bytes, const uint8_t* bits, size_t size) {
+    // Images written with a different SIZE keep their common prefix
+    size = std::min(size, SIZE);
+    clear();
+    std::copy(bytes, bytes + size, bytes_.begin());
+    for (size_t i = 0; i < size; ++i) {
+        if (bits[i / 8] & (1u << (i % 8))) {
+            valid_.set(i);
+        }
+    }
+}
@@ -0,0 +1,308 @@
+#include "register_scanner.hpp"
+#include "data_tables.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t ADDRESS_SPACE = 0x10000;
+
+std::string hex4(uint32_t value) {
+    std::ostringstream out;
+    out << "0x" << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << value;
+    return out.str();
+}
+
+} // namespace
+
+RegisterScanner::RegisterScanner(uint32_t start, uint32_t stop, const ScanOptions& options)
+    : start_(start), stop_(std::min(stop, ADDRESS_SPACE)), next_(start), options_(options) {
+    if (options_.max_length == 0 || options_.max_length > 0xFF) {
+        throw std::invalid_argument("Scan max_length must be between 1 and 0xFF");
+    }
+}
+
+bool RegisterScanner::run(const Probe& probe, const Progress& progress) {
+    while (!done()) {
+        step(probe);
+        if (progress && !progress(*this)) {
+            break;
+        }
+    }
+    return done();
+}
+
+void RegisterScanner::restore(uint32_t next, uint64_t probes, std::vector<ScanRegion> regions) {
+    next_ = std::max(next, start_);
+    probes_ = probes;
+    regions_ = std::move(regions);
+}
+
+bool RegisterScanner::check(const Probe& probe, uint16_t addr, uint16_t length) {
+    ++probes_;
+    ProbeResult result = probe(addr, length);
+    if (result == ProbeResult::NoResponse) {
+        throw std::runtime_error("No response reading " + std::to_string(length) + " bytes at " + hex4(addr));
+    }
+    return result == ProbeResult::Valid;
+}
+
+void RegisterScanner::step(const Probe& probe) {
+    const uint32_t addr = next_;
+
+    // Blocks the tables already describe cost a single read to confirm.
+    // Scanning resumes at their end, so a block that grew on a newer
+    // revision is still followed to its real end.
+    if (options_.use_known_regions) {
+        const RegisterRegion* known = find_region(static_cast<uint16_t>(addr));
+        if (known != nullptr && known->start == addr) {
+            uint16_t max_read = std::min(known->max_read, options_.max_length);
+            uint16_t length = static_cast<uint16_t>(std::min<uint32_t>(max_read, known->end - known->start));
+            if (check(probe, known->start, length)) {
+                add_region(known->start, known->end, max_read);
+                next_ = known->end;
+                return;
+            }
+        }
+    }
+
+    if (skip_page(probe)) {
+        next_ = addr + options_.page_size;
+        return;
+    }
+    if (!check(probe, static_cast<uint16_t>(addr), 1)) {
+        next_ = addr + 1;
+        return;
+    }
+    next_ = follow_region(probe, addr);
+}
+
+bool RegisterScanner::skip_page(const Probe& probe) {
+    const uint32_t addr = next_;
+    const uint32_t page = options_.page_size;
+    if (page == 0 || addr % page != 0 || addr + page > stop_) {
+        return false;
+    }
+    const uint32_t samples = std::clamp<uint32_t>(options_.page_samples, 1, page);
+    const uint32_t stride = page / samples;
+    for (uint32_t i = 0; i < samples; ++i) {
+        if (check(probe, static_cast<uint16_t>(addr + i * stride), 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t RegisterScanner::follow_region(const Probe& probe, uint32_t addr) {
+    // addr is known to accept a 1 byte read. Take the longest read the pack
+    // accepts there and continue from its end until a read comes up short
+    // or the next address is rejected.
+    uint16_t max_read = 0;
+    uint32_t chunk = addr;
+    while (true) {
+        const uint16_t limit = static_cast<uint16_t>(std::min<uint32_t>(options_.max_length, ADDRESS_SPACE - chunk));
+        uint16_t length;
+        if (max_read > 0 && max_read <= limit && check(probe, static_cast<uint16_t>(chunk), max_read)) {
+            length = max_read;
+        } else {
+            // Accepted lengths run from 1 up to a bound, so binary search it
+            uint16_t lo = 1;
+            uint16_t hi = (max_read > 0 && max_read <= limit) ? max_read - 1 : limit;
+            while (lo < hi) {
+                uint16_t mid = static_cast<uint16_t>((lo + hi + 1) / 2);
+                if (check(probe, static_cast<uint16_t>(chunk), mid)) {
+                    lo = mid;
+                } else {
+                    hi = mid - 1;
+                }
+            }
+            length = lo;
+        }
+        max_read = std::max(max_read, length);
+
+        const uint32_t end = chunk + length;
+        if (length < max_read || end >= ADDRESS_SPACE || !check(probe, static_cast<uint16_t>(end), 1)) {
+            add_region(addr, end, max_read);
+            return end;
+        }
+        chunk = end;
+    }
+}
+
+void RegisterScanner::add_region(uint32_t start, uint32_t end, uint16_t max_read) {
+    if (!regions_.empty() && regions_.back().end == start && regions_.back().max_read == max_read) {
+        regions_.back().end = end;
+        return;
+    }
+    regions_.push_back({start, end, max_read});
+}
+
+void RegisterScanner::print_map(std::ostream& out, const std::vector<ScanRegion>& regions) {
+    for (const auto& region : regions) {
+        out << hex4(region.start) << "-" << hex4(region.end) << "  " << std::setw(5) << (region.end - region.start)
+            << " bytes  max read " << "0x" << std::hex << std::uppercase << std::setw(2) << std::setfill('0')
+            << region.max_read << std::dec << std::nouppercase << std::setfill(' ') << std::endl;
+    }
+}
+
+std::vector<RegisterScanner> shard_scan(uint32_t start, uint32_t stop, size_t count, const ScanOptions& options) {
+    const uint32_t page = options.page_size ? options.page_size : 0x100;
+    const uint32_t pages = (stop - start + page - 1) / page;
+    count = std::clamp<size_t>(count, 1, std::max<uint32_t>(pages, 1));
+
+    std::vector<RegisterScanner> shards;
+    uint32_t shard_start = start;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t shard_stop = i + 1 == count ? stop : std::min(stop, start + static_cast<uint32_t>(pages * (i + 1) / count) * page);
+        shards.emplace_back(shard_start, shard_stop, options);
+        shard_start = shard_stop;
+    }
+    return shards;
+}
+
+std::vector<ScanRegion> merge_scan_regions(const std::vector<RegisterScanner>& shards) {
+    std::vector<ScanRegion> all;
+    for (const auto& shard : shards) {
+        all.insert(all.end(), shard.regions().begin(), shard.regions().end());
+    }
+    std::sort(all.begin(), all.end(), [](const ScanRegion& a, const ScanRegion& b) { return a.start < b.start; });
+
+    std::vector<ScanRegion> merged;
+    for (const auto& region : all) {
+        if (!merged.empty()) {
+            ScanRegion& last = merged.back();
+            // A shard that starts inside a block maps only its tail, which
+            // overlaps what the previous shard followed past its stop
+            if (region.start < last.end || (region.start == last.end && region.max_read == last.max_read)) {
+                last.end = std::max(last.end, region.end);
+                last.max_read = std::max(last.max_read, region.max_read);
+                continue;
+            }
+        }
+        merged.push_back(region);
+    }
+    return merged;
+}
+
+bool save_scan_checkpoint(const std::string& path, const std::vector<RegisterScanner>& shards) {
+    if (shards.empty()) {
+        return false;
+    }
+    const std::string tmp = path + ".tmp";
+    std::ofstream out(tmp);
+    if (!out) {
+        std::cerr << "Cannot write scan checkpoint: " << tmp << std::endl;
+        return false;
+    }
+
+    const ScanOptions& options = shards.front().options();
+    out << "# M18 register scan checkpoint\n"
+        << "max_length = " << hex4(options.max_length) << "\n"
+        << "page_size = " << hex4(options.page_size) << "\n"
+        << "page_samples = " << options.page_samples << "\n"
+        << "known_regions = " << (options.use_known_regions ? 1 : 0) << "\n";
+    for (const auto& shard : shards) {
+        out << "shard = " << hex4(shard.start()) << " " << hex4(shard.stop()) << " "
+            << hex4(std::min(shard.next(), shard.stop())) << " " << shard.probes() << "\n";
+        for (const auto& region : shard.regions()) {
+            out << "region = " << hex4(region.start) << " " << hex4(region.end) << " "
+                << hex4(region.max_read) << "\n";
+        }
+    }
+    out.close();
+
+    if (!out || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "Cannot write scan checkpoint: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool load_scan_checkpoint(const std::string& path, std::vector<RegisterScanner>& shards) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open scan checkpoint: " << path << std::endl;
+        return false;
+    }
+
+    ScanOptions options;
+    std::vector<RegisterScanner> loaded;
+    std::vector<ScanRegion> regions;
+    uint32_t next = 0;
+    uint64_t probes = 0;
+    auto finish_shard = [&]() {
+        if (!loaded.empty()) {
+            loaded.back().restore(next, probes, std::move(regions));
+            regions.clear();
+        }
+    };
+
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        line = line.substr(0, line.find('#'));
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                continue;
+            }
+            std::cerr << path << ":" << line_no << ": expected key = value" << std::endl;
+            return false;
+        }
+        std::istringstream key_in(line.substr(0, eq));
+        std::string key;
+        key_in >> key;
+        std::istringstream value(line.substr(eq + 1));
+        value >> std::setbase(0);
+
+        bool ok = true;
+        if (key == "max_length" || key == "page_size" || key == "page_samples") {
+            uint32_t number = 0;
+            ok = static_cast<bool>(value >> number) && number <= 0xFFFF;
+            uint16_t ScanOptions::*field = key == "max_length" ? &ScanOptions::max_length
+                                         : key == "page_size" ? &ScanOptions::page_size
+                                                              : &ScanOptions::page_samples;
+            options.*field = static_cast<uint16_t>(number);
+        } else if (key == "known_regions") {
+            int flag = 1;
+            ok = static_cast<bool>(value >> flag);
+            options.use_known_regions = flag != 0;
+        } else if (key == "shard") {
+            uint32_t start = 0;
+            uint32_t stop = 0;
+            finish_shard();
+            ok = static_cast<bool>(value >> start >> stop >> next >> probes) && start < stop && stop <= ADDRESS_SPACE;
+            if (ok) {
+                try {
+                    loaded.emplace_back(start, stop, options);
+                } catch (const std::exception&) {
+                    ok = false;
+                }
+            }
+        } else if (key == "region") {
+            ScanRegion region{};
+            ok = !loaded.empty() && static_cast<bool>(value >> region.start >> region.end >> region.max_read);
+            regions.push_back(region);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << path << ":" << line_no << ": invalid " << key << std::endl;
+            return false;
+        }
+    }
+    finish_shard();
+
+    if (loaded.empty()) {
+        std::cerr << path << ": no shards" << std::endl;
+        return false;
+    }
+    shards = std::move(loaded);
+    return true;
+}
@@ -0,0 +1,84 @@
+#include "register_values.hpp"
+#include "record_writer.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+RegisterValue decode_register(size_t id, const RegisterImage& image) {
+    const DataIdEntry& entry = DATA_ID.at(id);
+    const uint8_t* data = image.data(entry.addr, entry.length);
+    if (data == nullptr) {
+        return std::monostate{};
+    }
+    return dispatch_reg_type(entry.type, [&](auto type) -> RegisterValue {
+        constexpr RegType T = decltype(type)::value;
+        auto value = RegDecoder<T>::decode(data, entry.length);
+
+        if constexpr (T == RegType::Date) {
+            return DateValue{value};
+        } else if constexpr (T == RegType::Hhmmss) {
+            return DurationValue{value};
+        } else if constexpr (T == RegType::AdcT || T == RegType::DecT) {
+            return TemperatureValue{value};
+        } else if constexpr (T == RegType::Ascii) {
+            AsciiValue ascii{};
+            ascii.length = static_cast<uint8_t>(std::min(value.size(), ascii.chars.size()));
+            std::copy_n(value.begin(), ascii.length, ascii.chars.begin());
+            return ascii;
+        } else {
+            return value;  // uint32_t, SerialNumber, CellArray
+        }
+    });
+}
+
+void decode_registers(const RegisterImage& image, DecodedRegisters& values) {
+    for (size_t id = 0; id < DATA_ID.size(); ++id) {
+        values[id] = decode_register(id, image);
+    }
+}
+
+void write_register_value(std::ostream& out, size_t id, const RegisterValue& value, bool labelled) {
+    const DataIdEntry& entry = DATA_ID.at(id);
+    std::visit([&](const auto& v) {
+        using V = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<V, std::monostate>) {
+            out << "------";
+        } else if constexpr (std::is_same_v<V, uint32_t>) {
+            out << v;
+        } else if constexpr (std::is_same_v<V, DateValue>) {
+            char text[DATE_CHARS];
+            out.write(text, format_date(text, v.epoch) - text);
+        } else if constexpr (std::is_same_v<V, DurationValue>) {
+            char text[HHMMSS_CHARS];
+            out.write(text, format_hhmmss(text, v.seconds) - text);
+        } else if constexpr (std::is_same_v<V, AsciiValue>) {
+            out << '"' << v.view() << '"';
+        } else if constexpr (std::is_same_v<V, SerialNumber>) {
+            if (labelled) {
+                out << "Type: " << std::setw(3) << v.type << ", Serial: " << v.serial;
+            } else {
+                out << v.type << "\n" << v.serial;
+            }
+        } else if constexpr (std::is_same_v<V, TemperatureValue>) {
+            if (entry.type == RegType::DecT) {
+                out << std::fixed << std::setprecision(2) << v.celsius << std::defaultfloat << std::setprecision(6);
+            } else {
+                out << v.celsius;
+            }
+        } else if constexpr (std::is_same_v<V, CellArray>) {
+            for (size_t i = 0; i < v.size(); ++i) {
+                if (labelled) {
+                    out << (i ? ", " : "") << (i + 1) << ": " << std::setw(4) << v[i];
+                } else {
+                    out << (i ? "\n" : "") << std::setw(4) << v[i];
+                }
+            }
+        }
+    }, value);
+}
+
+std::string format_register_value(size_t id, const RegisterValue& value, bool labelled) {
+    std::ostringstream out;
+    write_register_value(out, id, value, labelled);
+    return out.str();
+}
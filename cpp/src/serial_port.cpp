@@ -3,14 +3,20 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <linux/serial.h>
+#include <sys/uio.h>
+#include <poll.h>
 #include <errno.h>
 #include <cstring>
 #include <stdexcept>
+#include <algorithm>
 #include <thread>
 #include <chrono>
 
 SerialPort::SerialPort(const std::string& port, int baudrate, double timeout_seconds)
-    : port_name_(port), baudrate_(baudrate), timeout_seconds_(timeout_seconds), fd_(-1) {
+    : port_name_(port), baudrate_(baudrate), timeout_seconds_(timeout_seconds), fd_(-1),
+      low_latency_(true), sysfs_root_("/sys"), saved_serial_flags_(-1),
+      rx_buffer_{}, rx_head_(0), rx_count_(0) {
 }
 
 SerialPort::~SerialPort() {
@@ -35,9 +41,67 @@ bool SerialPort::open() {
         return false;
     }
 
+    adapter_ = detect_adapter(port_name_, sysfs_root_);
+    if (low_latency_) {
+        apply_low_latency();
+    }
     return true;
 }
 
+void SerialPort::apply_low_latency() {
+    // FTDI chips hold short responses for latency_timer ms (16 by default)
+    // before sending them over USB. Writing it normally needs root or a udev
+    // rule, so a failure here just leaves the old value in place.
+    if (!adapter_.latency_timer_path.empty() && adapter_.latency_timer_ms > 1 &&
+        write_latency_timer(adapter_.latency_timer_path, 1)) {
+        adapter_.latency_timer_ms = read_latency_timer(adapter_.latency_timer_path);
+    }
+
+    // Ask the tty layer to push received bytes to readers immediately.
+    // Not every driver (or a pty) supports this.
+    struct serial_struct serial;
+    if (ioctl(fd_, TIOCGSERIAL, &serial) == 0) {
+        adapter_.low_latency = (serial.flags & ASYNC_LOW_LATENCY) != 0;
+        if (!adapter_.low_latency) {
+            int flags = serial.flags;
+            serial.flags |= ASYNC_LOW_LATENCY;
+            if (ioctl(fd_, TIOCSSERIAL, &serial) == 0) {
+                saved_serial_flags_ = flags;
+                adapter_.low_latency = true;
+            }
+        }
+    }
+}
+
+void SerialPort::restore_low_latency() {
+    if (adapter_.latency_timer_ms != adapter_.original_latency_timer_ms &&
+        adapter_.original_latency_timer_ms > 0 &&
+        write_latency_timer(adapter_.latency_timer_path, adapter_.original_latency_timer_ms)) {
+        adapter_.latency_timer_ms = adapter_.original_latency_timer_ms;
+    }
+
+    struct serial_struct serial;
+    if (saved_serial_flags_ >= 0 && ioctl(fd_, TIOCGSERIAL, &serial) == 0) {
+        serial.flags = saved_serial_flags_;
+        if (ioctl(fd_, TIOCSSERIAL, &serial) == 0) {
+            adapter_.low_latency = false;
+        }
+    }
+    saved_serial_flags_ = -1;
+}
+
+void SerialPort::set_low_latency(bool enable) {
+    low_latency_ = enable;
+}
+
+void SerialPort::set_sysfs_root(const std::string& root) {
+    sysfs_root_ = root;
+}
+
+const AdapterInfo& SerialPort::adapter() const {
+    return adapter_;
+}
+
 bool SerialPort::configure_port() {
     struct termios tty;
     
@@ -84,9 +148,9 @@ bool SerialPort::configure_port() {
     tty.c_oflag = 0;
     tty.c_iflag = 0;
 
-    // Set timeout
+    // Never block in read(); timeouts are handled by ppoll() in fill_rx_buffer()
     tty.c_cc[VMIN] = 0;
-    tty.c_cc[VTIME] = static_cast<cc_t>(timeout_seconds_ * 10);  // timeout in deciseconds
+    tty.c_cc[VTIME] = 0;
 
     if (tcsetattr(fd_, TCSANOW, &tty) != 0) {
         throw std::runtime_error("Failed to set terminal attributes: " + std::string(strerror(errno)));
@@ -97,9 +161,12 @@ bool SerialPort::configure_port() {
 
 void SerialPort::close() {
     if (is_open()) {
+        restore_low_latency();
         ::close(fd_);
         fd_ = -1;
     }
+    rx_head_ = 0;
+    rx_count_ = 0;
 }
 
 bool SerialPort::is_open() const {
@@ -107,35 +174,131 @@ bool SerialPort::is_open() const {
 }
 
 bool SerialPort::write(const std::vector<uint8_t>& data) {
+    return write(data.data(), data.size());
+}
+
+bool SerialPort::write(const uint8_t* data, size_t length) {
     if (!is_open()) {
         throw std::runtime_error("Serial port is not open");
     }
 
-    ssize_t bytes_written = ::write(fd_, data.data(), data.size());
+    ssize_t bytes_written = ::write(fd_, data, length);
     if (bytes_written < 0) {
         throw std::runtime_error("Failed to write to serial port: " + std::string(strerror(errno)));
     }
 
-    return static_cast<size_t>(bytes_written) == data.size();
+    return static_cast<size_t>(bytes_written) == length;
 }
 
 std::vector<uint8_t> SerialPort::read(size_t num_bytes) {
+    auto timeout = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(timeout_seconds_));
+    return read_exact(num_bytes, Clock::now() + timeout);
+}
+
+std::vector<uint8_t> SerialPort::read_exact(size_t num_bytes, Clock::time_point deadline) {
+    std::vector<uint8_t> buffer(num_bytes);
+    buffer.resize(read_exact(buffer.data(), num_bytes, deadline));
+    return buffer;
+}
+
+size_t SerialPort::read_exact(uint8_t* dst, size_t num_bytes, Clock::time_point deadline) {
     if (!is_open()) {
         throw std::runtime_error("Serial port is not open");
     }
 
-    std::vector<uint8_t> buffer(num_bytes);
-    ssize_t bytes_read = ::read(fd_, buffer.data(), num_bytes);
+    size_t total = take_rx_buffer(dst, num_bytes);
+    while (total < num_bytes) {
+        if (!fill_rx_buffer(deadline)) {
+            break;  // deadline passed
+        }
+        total += take_rx_buffer(dst + total, num_bytes - total);
+    }
+    return total;
+}
+
+size_t SerialPort::available() const {
+    return rx_count_;
+}
+
+int SerialPort::fd() const {
+    return fd_;
+}
+
+size_t SerialPort::pump() {
+    if (!is_open()) {
+        throw std::runtime_error("Serial port is not open");
+    }
+
+    // A deadline in the past makes fill_rx_buffer() try exactly one readv()
+    size_t before = rx_count_;
+    while (rx_count_ < RX_BUFFER_SIZE && fill_rx_buffer(Clock::time_point::min())) {
+    }
+    return rx_count_ - before;
+}
 
-    if (bytes_read < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            return std::vector<uint8_t>();  // timeout, return empty
+size_t SerialPort::take(uint8_t* dst, size_t max_bytes) {
+    return take_rx_buffer(dst, max_bytes);
+}
+
+bool SerialPort::fill_rx_buffer(Clock::time_point deadline) {
+    // With VMIN = VTIME = 0 an empty read is normal, but not right after
+    // ppoll() said the port is readable: that is a hangup
+    bool readable = false;
+    while (true) {
+        if (rx_count_ == RX_BUFFER_SIZE) {
+            return true;  // buffer full, caller must drain it first
+        }
+
+        // Take everything the driver has in one syscall, wrapping around the ring
+        size_t tail = (rx_head_ + rx_count_) % RX_BUFFER_SIZE;
+        size_t first = std::min(RX_BUFFER_SIZE - rx_count_, RX_BUFFER_SIZE - tail);
+        struct iovec iov[2] = {
+            {rx_buffer_.data() + tail, first},
+            {rx_buffer_.data(), RX_BUFFER_SIZE - rx_count_ - first}
+        };
+        ssize_t bytes_read = ::readv(fd_, iov, iov[1].iov_len > 0 ? 2 : 1);
+        if (bytes_read > 0) {
+            rx_count_ += static_cast<size_t>(bytes_read);
+            return true;
+        }
+        if (bytes_read < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            throw std::runtime_error("Failed to read from serial port: " + std::string(strerror(errno)));
+        }
+        if (bytes_read == 0 && readable) {
+            throw std::runtime_error("Serial port disconnected");
+        }
+
+        auto now = Clock::now();
+        if (now >= deadline) {
+            return false;
+        }
+
+        auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now);
+        struct timespec ts;
+        ts.tv_sec = static_cast<time_t>(remaining.count() / 1000000000);
+        ts.tv_nsec = static_cast<long>(remaining.count() % 1000000000);
+
+        struct pollfd pfd = {fd_, POLLIN, 0};
+        int ret = ::ppoll(&pfd, 1, &ts, nullptr);
+        if (ret < 0 && errno != EINTR) {
+            throw std::runtime_error("Failed to poll serial port: " + std::string(strerror(errno)));
         }
-        throw std::runtime_error("Failed to read from serial port: " + std::string(strerror(errno)));
+        if (ret > 0 && !(pfd.revents & POLLIN) && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+            throw std::runtime_error("Serial port disconnected");
+        }
+        readable = ret > 0 && (pfd.revents & POLLIN);
     }
+}
 
-    buffer.resize(bytes_read);
-    return buffer;
+size_t SerialPort::take_rx_buffer(uint8_t* dst, size_t max_bytes) {
+    size_t count = std::min(max_bytes, rx_count_);
+    size_t first = std::min(count, RX_BUFFER_SIZE - rx_head_);
+    std::memcpy(dst, rx_buffer_.data() + rx_head_, first);
+    std::memcpy(dst + first, rx_buffer_.data(), count - first);
+    rx_head_ = (rx_head_ + count) % RX_BUFFER_SIZE;
+    rx_count_ -= count;
+    return count;
 }
 
 void SerialPort::set_dtr(bool state) {
@@ -180,6 +343,8 @@ void SerialPort::reset_input_buffer() {
     if (is_open()) {
         tcflush(fd_, TCIFLUSH);
     }
+    rx_head_ = 0;
+    rx_count_ = 0;
 }
 
 void SerialPort::reset_output_buffer() {
@@ -0,0 +1,485 @@
+#include "snapshot_store.hpp"
+#include "register_decode.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t RECORD_MAGIC = 0x5338314D;  // "M18S"
+constexpr uint16_t RECORD_VERSION = 1;
+constexpr char INDEX_MAGIC[8] = {'M', '1', '8', 'I', 'D', 'X', '1', '\0'};
+constexpr uint64_t INITIAL_CAPACITY = 1024;  // Slots; always a power of two
+
+struct RecordHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t site_length;
+    int64_t timestamp;
+    uint64_t prev_offset;  // Previous record of the same serial
+    uint32_t serial;
+    uint16_t type;
+    uint16_t image_size;   // RegisterImage::SIZE when written
+    uint32_t checksum;     // FNV-1a of the payload
+    uint32_t reserved;
+};
+static_assert(sizeof(RecordHeader) == 40, "record header layout");
+
+// Payload: site tag, image bytes, validity bits
+size_t payload_size(const RecordHeader& header) {
+    return header.site_length + header.image_size + (header.image_size + 7u) / 8u;
+}
+
+uint32_t fnv1a(const uint8_t* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+std::runtime_error io_error(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " " + path + ": " + strerror(errno));
+}
+
+bool pread_all(int fd, void* buffer, size_t length, uint64_t offset) {
+    auto* out = static_cast<uint8_t*>(buffer);
+    while (length > 0) {
+        ssize_t n = ::pread(fd, out, length, static_cast<off_t>(offset));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        out += n;
+        offset += static_cast<uint64_t>(n);
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool read_header(int fd, uint64_t offset, uint64_t file_size, RecordHeader& header) {
+    return offset + sizeof(header) <= file_size && pread_all(fd, &header, sizeof(header), offset) &&
+           header.magic == RECORD_MAGIC && header.version == RECORD_VERSION &&
+           offset + sizeof(header) + payload_size(header) <= file_size;
+}
+
+} // namespace
+
+struct SnapshotStore::IndexHeader {
+    char magic[8];
+    uint64_t capacity;
+    uint64_t used;           // Occupied slots (distinct serials)
+    uint64_t records;        // Records indexed
+    uint64_t indexed_bytes;  // Prefix of snapshots.dat covered by the index
+};
+
+struct SnapshotStore::IndexSlot {
+    uint32_t key;     // serial + 1; 0 marks an empty slot
+    uint32_t count;
+    uint64_t latest;  // Offset of the newest record
+};
+
+SnapshotStore::SnapshotStore(const std::string& directory, bool read_only)
+    : directory_(directory), read_only_(read_only), data_fd_(-1), index_fd_(-1), data_size_(0),
+      index_map_(nullptr), index_map_size_(0), damaged_(0) {
+    if (!read_only && ::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw io_error("Cannot create snapshot directory", directory);
+    }
+
+    const std::string data_path = directory + "/snapshots.dat";
+    data_fd_ = read_only ? ::open(data_path.c_str(), O_RDONLY | O_CLOEXEC)
+                         : ::open(data_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (data_fd_ < 0) {
+        throw io_error("Cannot open", data_path);
+    }
+    struct stat st;
+    if (::fstat(data_fd_, &st) != 0) {
+        ::close(data_fd_);
+        throw io_error("Cannot stat", data_path);
+    }
+    data_size_ = static_cast<uint64_t>(st.st_size);
+
+    try {
+        open_index(false);
+    } catch (...) {
+        unmap_index();
+        if (index_fd_ >= 0) {
+            ::close(index_fd_);
+        }
+        ::close(data_fd_);
+        throw;
+    }
+}
+
+SnapshotStore::~SnapshotStore() {
+    unmap_index();
+    if (index_fd_ >= 0) {
+        ::close(index_fd_);
+    }
+    if (data_fd_ >= 0) {
+        ::close(data_fd_);
+    }
+}
+
+SnapshotStore::IndexHeader* SnapshotStore::header() const {
+    return static_cast<IndexHeader*>(index_map_);
+}
+
+SnapshotStore::IndexSlot* SnapshotStore::slots() const {
+    return reinterpret_cast<IndexSlot*>(static_cast<uint8_t*>(index_map_) + sizeof(IndexHeader));
+}
+
+void SnapshotStore::open_index(bool rebuild) {
+    const std::string path = directory_ + "/snapshots.idx";
+    if (index_fd_ < 0) {
+        index_fd_ = read_only_ ? ::open(path.c_str(), O_RDONLY | O_CLOEXEC)
+                               : ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        // A read-only store without an index builds one in memory
+        if (index_fd_ < 0 && !(read_only_ && errno == ENOENT)) {
+            throw io_error("Cannot open", path);
+        }
+    }
+
+    struct stat st{};
+    if (index_fd_ >= 0 && ::fstat(index_fd_, &st) != 0) {
+        throw io_error("Cannot stat", path);
+    }
+
+    IndexHeader existing{};
+    bool usable = !rebuild && index_fd_ >= 0 && static_cast<size_t>(st.st_size) >= sizeof(IndexHeader) &&
+                  pread_all(index_fd_, &existing, sizeof(existing), 0) &&
+                  std::memcmp(existing.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+                  existing.capacity > 0 && (existing.capacity & (existing.capacity - 1)) == 0 &&
+                  static_cast<uint64_t>(st.st_size) == sizeof(IndexHeader) + existing.capacity * sizeof(IndexSlot) &&
+                  existing.indexed_bytes <= data_size_;
+
+    if (usable) {
+        map_index(existing.capacity, false);
+    } else {
+        map_index(INITIAL_CAPACITY, true);
+        std::memcpy(header()->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    }
+    catch_up();
+}
+
+void SnapshotStore::map_index(uint64_t capacity, bool create) {
+    const size_t size = sizeof(IndexHeader) + capacity * sizeof(IndexSlot);
+    if (read_only_) {
+        // A private mapping: catch_up() and grow_index() change it in memory only
+        void* map = create ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+                           : ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, index_fd_, 0);
+        if (map == MAP_FAILED) {
+            throw io_error("Cannot map", directory_ + "/snapshots.idx");
+        }
+        index_map_ = map;
+        index_map_size_ = size;
+        if (create) {
+            header()->capacity = capacity;
+        }
+        return;
+    }
+
+    if (create) {
+        // Truncating to zero first leaves every slot zeroed (empty)
+        if (::ftruncate(index_fd_, 0) != 0 || ::ftruncate(index_fd_, static_cast<off_t>(size)) != 0) {
+            throw io_error("Cannot resize", directory_ + "/snapshots.idx");
+        }
+    }
+
+    void* map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, index_fd_, 0);
+    if (map == MAP_FAILED) {
+        throw io_error("Cannot map", directory_ + "/snapshots.idx");
+    }
+    index_map_ = map;
+    index_map_size_ = size;
+
+    if (create) {
+        header()->capacity = capacity;
+    }
+}
+
+void SnapshotStore::unmap_index() {
+    if (index_map_ != nullptr) {
+        ::munmap(index_map_, index_map_size_);
+        index_map_ = nullptr;
+        index_map_size_ = 0;
+    }
+}
+
+SnapshotStore::IndexSlot* SnapshotStore::find_slot(uint32_t serial) const {
+    const uint64_t mask = header()->capacity - 1;
+    const uint32_t key = serial + 1;
+    uint64_t i = (static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull >> 32) & mask;
+    IndexSlot* table = slots();
+    while (table[i].key != 0 && table[i].key != key) {
+        i = (i + 1) & mask;
+    }
+    return &table[i];
+}
+
+void SnapshotStore::grow_index() {
+    const IndexHeader old_header = *header();
+    std::vector<IndexSlot> old_slots(slots(), slots() + old_header.capacity);
+
+    // The magic is only written back once every slot has been reinserted, so
+    // a crash part way through leaves an index that gets rebuilt on open
+    unmap_index();
+    map_index(old_header.capacity * 2, true);
+    for (const auto& slot : old_slots) {
+        if (slot.key != 0) {
+            *find_slot(slot.key - 1) = slot;
+        }
+    }
+    header()->used = old_header.used;
+    header()->records = old_header.records;
+    header()->indexed_bytes = old_header.indexed_bytes;
+    std::memcpy(header()->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+}
+
+void SnapshotStore::index_record(uint64_t offset, uint32_t serial, uint64_t end) {
+    // Keep the load factor under 0.7 so probes stay short
+    if ((header()->used + 1) * 10 > header()->capacity * 7) {
+        grow_index();
+    }
+
+    IndexSlot* slot = find_slot(serial);
+    if (slot->key == 0) {
+        slot->key = serial + 1;
+        ++header()->used;
+    }
+    slot->latest = offset;
+    ++slot->count;
+    ++header()->records;
+    header()->indexed_bytes = end;
+}
+
+void SnapshotStore::catch_up() {
+    uint64_t offset = header()->indexed_bytes;
+    while (offset < data_size_) {
+        Snapshot snapshot;
+        uint64_t next = 0;
+        if (read_record(offset, &snapshot, nullptr, &next)) {
+            index_record(offset, snapshot.serial, next);
+            offset = next;
+            continue;
+        }
+
+        // A damaged record stays in the file; indexing resumes at the next
+        // readable one
+        const uint64_t resume = find_record(offset + 1);
+        if (resume != NO_OFFSET) {
+            ++damaged_;
+            header()->indexed_bytes = resume;
+            offset = resume;
+            continue;
+        }
+
+        // Nothing readable follows. A record cut short by a crash is dropped
+        // so appends stay aligned; anything else is left alone.
+        if (!torn_tail(offset)) {
+            ++damaged_;
+        } else if (!read_only_) {
+            if (::ftruncate(data_fd_, static_cast<off_t>(offset)) != 0) {
+                throw io_error("Cannot truncate", directory_ + "/snapshots.dat");
+            }
+            data_size_ = offset;
+        }
+        break;
+    }
+}
+
+uint64_t SnapshotStore::find_record(uint64_t from) const {
+    std::vector<uint8_t> chunk(64 * 1024);
+    uint64_t offset = from;
+    while (offset + sizeof(RecordHeader) <= data_size_) {
+        const size_t length = static_cast<size_t>(std::min<uint64_t>(chunk.size(), data_size_ - offset));
+        if (!pread_all(data_fd_, chunk.data(), length, offset)) {
+            return NO_OFFSET;
+        }
+        for (size_t i = 0; i + sizeof(RECORD_MAGIC) <= length; ++i) {
+            if (std::memcmp(chunk.data() + i, &RECORD_MAGIC, sizeof(RECORD_MAGIC)) == 0 &&
+                read_record(offset + i, nullptr, nullptr, nullptr)) {
+                return offset + i;
+            }
+        }
+        // Overlap chunks so a magic split across the boundary is still seen
+        offset += length - (sizeof(RECORD_MAGIC) - 1);
+    }
+    return NO_OFFSET;
+}
+
+bool SnapshotStore::torn_tail(uint64_t offset) const {
+    RecordHeader rec{};
+    const size_t available = static_cast<size_t>(std::min<uint64_t>(sizeof(rec), data_size_ - offset));
+    if (!pread_all(data_fd_, &rec, available, offset) ||
+        std::memcmp(&rec.magic, &RECORD_MAGIC, std::min(available, sizeof(RECORD_MAGIC))) != 0) {
+        return false;
+    }
+    if (available < sizeof(rec)) {
+        return true;
+    }
+    // A flipped length field would also run past EOF, so the header must
+    // describe a record this build writes
+    return rec.version == RECORD_VERSION && rec.image_size == RegisterImage::SIZE &&
+           offset + sizeof(rec) + payload_size(rec) > data_size_;
+}
+
+bool SnapshotStore::read_record(uint64_t offset, Snapshot* snapshot, uint64_t* prev, uint64_t* next) const {
+    RecordHeader rec;
+    if (!read_header(data_fd_, offset, data_size_, rec)) {
+        return false;
+    }
+
+    std::vector<uint8_t> payload(payload_size(rec));
+    if (!pread_all(data_fd_, payload.data(), payload.size(), offset + sizeof(rec)) ||
+        fnv1a(payload.data(), payload.size()) != rec.checksum) {
+        return false;
+    }
+
+    if (snapshot != nullptr) {
+        snapshot->offset = offset;
+        snapshot->timestamp = rec.timestamp;
+        snapshot->type = rec.type;
+        snapshot->serial = rec.serial;
+        snapshot->site.assign(reinterpret_cast<const char*>(payload.data()), rec.site_length);
+        const uint8_t* bytes = payload.data() + rec.site_length;
+        snapshot->image.assign_raw(bytes, bytes + rec.image_size, rec.image_size);
+    }
+    if (prev != nullptr) {
+        *prev = rec.prev_offset;
+    }
+    if (next != nullptr) {
+        *next = offset + sizeof(rec) + payload.size();
+    }
+    return true;
+}
+
+uint64_t SnapshotStore::append(const RegisterImage& image, const std::string& site, int64_t timestamp) {
+    if (read_only_) {
+        throw std::runtime_error("Snapshot store " + directory_ + " is open read-only");
+    }
+    const uint8_t* sn_data = image.data(DATA_ID[2].addr, DATA_ID[2].length);
+    if (sn_data == nullptr) {
+        throw std::runtime_error("Snapshot has no serial number (register 0x0004)");
+    }
+    const SerialNumber sn = decode_id<2>(sn_data);
+    if (site.size() > UINT16_MAX) {
+        throw std::runtime_error("Snapshot site tag is too long");
+    }
+
+    RecordHeader rec{};
+    rec.magic = RECORD_MAGIC;
+    rec.version = RECORD_VERSION;
+    rec.site_length = static_cast<uint16_t>(site.size());
+    rec.timestamp = timestamp != 0 ? timestamp : static_cast<int64_t>(std::time(nullptr));
+    const IndexSlot* slot = find_slot(sn.serial);
+    rec.prev_offset = slot->key != 0 ? slot->latest : NO_OFFSET;
+    rec.serial = sn.serial;
+    rec.type = sn.type;
+    rec.image_size = static_cast<uint16_t>(RegisterImage::SIZE);
+
+    std::vector<uint8_t> record(sizeof(rec) + payload_size(rec));
+    uint8_t* payload = record.data() + sizeof(rec);
+    std::memcpy(payload, site.data(), site.size());
+    std::memcpy(payload + site.size(), image.raw_bytes(), RegisterImage::SIZE);
+    image.pack_valid(payload + site.size() + RegisterImage::SIZE);
+    rec.checksum = fnv1a(payload, record.size() - sizeof(rec));
+    std::memcpy(record.data(), &rec, sizeof(rec));
+
+    const uint64_t offset = data_size_;
+    size_t written = 0;
+    while (written < record.size()) {
+        ssize_t n = ::pwrite(data_fd_, record.data() + written, record.size() - written,
+                             static_cast<off_t>(offset + written));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw io_error("Cannot append to", directory_ + "/snapshots.dat");
+        }
+        written += static_cast<size_t>(n);
+    }
+    ::fdatasync(data_fd_);
+
+    data_size_ = offset + record.size();
+    index_record(offset, sn.serial, data_size_);
+    return offset;
+}
+
+std::vector<uint64_t> SnapshotStore::offsets(uint32_t serial) const {
+    std::vector<uint64_t> result;
+    const IndexSlot* slot = find_slot(serial);
+    if (slot->key == 0) {
+        return result;
+    }
+
+    result.reserve(slot->count);
+    uint64_t offset = slot->latest;
+    RecordHeader rec;
+    while (offset != NO_OFFSET && read_header(data_fd_, offset, data_size_, rec)) {
+        result.push_back(offset);
+        offset = rec.prev_offset;
+    }
+    return result;
+}
+
+size_t SnapshotStore::count(uint32_t serial) const {
+    const IndexSlot* slot = find_slot(serial);
+    return slot->key != 0 ? slot->count : 0;
+}
+
+Snapshot SnapshotStore::read(uint64_t offset) const {
+    Snapshot snapshot;
+    if (!read_record(offset, &snapshot, nullptr, nullptr)) {
+        throw std::runtime_error("No valid snapshot at offset " + std::to_string(offset));
+    }
+    return snapshot;
+}
+
+std::vector<Snapshot> SnapshotStore::history(uint32_t serial) const {
+    std::vector<Snapshot> result;
+    for (uint64_t offset : offsets(serial)) {
+        Snapshot snapshot;
+        if (read_record(offset, &snapshot, nullptr, nullptr)) {
+            result.push_back(std::move(snapshot));
+        }
+    }
+    return result;
+}
+
+void SnapshotStore::scan(const std::function<void(const Snapshot&)>& visit) const {
+    uint64_t offset = 0;
+    Snapshot snapshot;
+    uint64_t next = 0;
+    while (offset < data_size_) {
+        if (read_record(offset, &snapshot, nullptr, &next)) {
+            visit(snapshot);
+            offset = next;
+        } else if ((offset = find_record(offset + 1)) == NO_OFFSET) {
+            break;
+        }
+    }
+}
+
+void SnapshotStore::rebuild_index() {
+    damaged_ = 0;
+    unmap_index();
+    open_index(true);
+}
+
+size_t SnapshotStore::snapshot_count() const {
+    return header()->records;
+}
+
+size_t SnapshotStore::pack_count() const {
+    return header()->used;
+}
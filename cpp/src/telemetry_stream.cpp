@@ -0,0 +1,112 @@
+#include "telemetry_stream.hpp"
+#include "register_decode.hpp"
+#include <chrono>
+#include <iomanip>
+
+namespace {
+
+void put_le(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+} // namespace
+
+TelemetryWriter::TelemetryWriter(std::ostream& out, StreamFormat format) : out_(out), format_(format) {
+    if (format_ == StreamFormat::Binary) {
+        uint8_t header[8] = {'M', '1', '8', 'T'};
+        put_le(header + 4, BINARY_VERSION, 2);
+        put_le(header + 6, BINARY_RECORD_SIZE, 2);
+        out_.write(reinterpret_cast<const char*>(header), sizeof(header));
+    } else {
+        out_ << "time,sequence,cell1_mv,cell2_mv,cell3_mv,cell4_mv,cell5_mv,temperature_c,forge_temperature_c\n";
+    }
+    thread_ = std::thread(&TelemetryWriter::run, this);
+}
+
+TelemetryWriter::~TelemetryWriter() {
+    finish();
+}
+
+bool TelemetryWriter::push(const TelemetrySample& sample) {
+    if (!ring_.push(sample)) {
+        ++dropped_;
+        return false;
+    }
+    return true;
+}
+
+void TelemetryWriter::finish() {
+    finishing_.store(true, std::memory_order_release);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void TelemetryWriter::run() {
+    TelemetrySample sample;
+    while (true) {
+        // Check the flag before draining so nothing pushed before finish()
+        // is left behind
+        bool finishing = finishing_.load(std::memory_order_acquire);
+        bool any = false;
+        while (ring_.pop(sample)) {
+            write(sample);
+            any = true;
+        }
+        if (any) {
+            // Samples arrive a few times a second at most; flushing each
+            // batch keeps the file usable while a load test is running
+            out_.flush();
+        }
+        if (finishing) {
+            break;
+        }
+        if (!any) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+    out_.flush();
+}
+
+void TelemetryWriter::write(const TelemetrySample& sample) {
+    const bool cells_valid = sample.valid & TelemetrySample::CELLS_VALID;
+    const bool temp_valid = sample.valid & TelemetrySample::TEMP_VALID;
+    const bool forge_valid = sample.valid & TelemetrySample::FORGE_TEMP_VALID;
+    const CellArray cells = RegDecoder<RegType::CellV>::decode(sample.cells, sizeof(sample.cells));
+
+    if (format_ == StreamFormat::Binary) {
+        uint8_t record[BINARY_RECORD_SIZE] = {};
+        put_le(record, sample.sequence, 8);
+        put_le(record + 8, static_cast<uint64_t>(sample.timestamp_ns), 8);
+        for (size_t i = 0; i < cells.size(); ++i) {
+            put_le(record + 16 + 2 * i, cells[i], 2);
+        }
+        put_le(record + 26, read_be(sample.temperature, 2), 2);
+        put_le(record + 28, read_be(sample.forge_temperature, 2), 2);
+        record[30] = sample.valid;
+        out_.write(reinterpret_cast<const char*>(record), sizeof(record));
+    } else {
+        out_ << sample.timestamp_ns / 1000000000 << '.' << std::setw(6) << std::setfill('0')
+             << (sample.timestamp_ns % 1000000000) / 1000 << std::setfill(' ') << ',' << sample.sequence;
+        for (uint16_t mv : cells) {
+            out_ << ',';
+            if (cells_valid) {
+                out_ << mv;
+            }
+        }
+        out_ << ',';
+        if (temp_valid) {
+            out_ << std::fixed << std::setprecision(1)
+                 << RegDecoder<RegType::AdcT>::decode(sample.temperature, sizeof(sample.temperature));
+        }
+        out_ << ',';
+        if (forge_valid) {
+            out_ << std::fixed << std::setprecision(2)
+                 << RegDecoder<RegType::DecT>::decode(sample.forge_temperature, sizeof(sample.forge_temperature));
+        }
+        out_ << '\n';
+    }
+    written_.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,111 @@
+#include "timing_profile.hpp"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+struct Field {
+    const char* key;
+    TimingProfile::usec TimingProfile::*member;
+};
+
+const Field FIELDS[] = {
+    {"break_hold_us", &TimingProfile::break_hold},
+    {"break_recovery_us", &TimingProfile::break_recovery},
+    {"sync_settle_us", &TimingProfile::sync_settle},
+    {"turnaround_us", &TimingProfile::turnaround},
+    {"turnaround_per_byte_us", &TimingProfile::turnaround_per_byte},
+    {"refresh_settle_us", &TimingProfile::refresh_settle},
+    {"response_timeout_us", &TimingProfile::response_timeout},
+};
+
+std::string trim(const std::string& s) {
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+} // namespace
+
+TimingProfile::usec TimingProfile::frame_gap(size_t response_len) const {
+    return turnaround + turnaround_per_byte * static_cast<long>(response_len);
+}
+
+bool TimingProfile::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open timing profile: " << path << std::endl;
+        return false;
+    }
+
+    TimingProfile loaded;
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            std::cerr << path << ":" << line_no << ": expected key = value" << std::endl;
+            return false;
+        }
+        std::string key = trim(line.substr(0, eq));
+        std::string value = trim(line.substr(eq + 1));
+
+        if (key == "adapter") {
+            loaded.adapter = value;
+            continue;
+        }
+
+        bool known = false;
+        for (const auto& field : FIELDS) {
+            if (key == field.key) {
+                // Whole microseconds only: no sign, no unit suffix
+                size_t used = 0;
+                long micros = -1;
+                try {
+                    micros = std::stol(value, &used);
+                } catch (const std::exception&) {
+                }
+                if (micros < 0 || used != value.size()) {
+                    std::cerr << path << ":" << line_no << ": invalid value for " << key << std::endl;
+                    return false;
+                }
+                loaded.*field.member = usec(micros);
+                known = true;
+                break;
+            }
+        }
+        if (!known) {
+            std::cerr << path << ":" << line_no << ": unknown key " << key << std::endl;
+        }
+    }
+
+    *this = loaded;
+    return true;
+}
+
+bool TimingProfile::save(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot write timing profile: " << path << std::endl;
+        return false;
+    }
+
+    out << "# M18 link timing profile (values in microseconds)" << std::endl;
+    if (!adapter.empty()) {
+        out << "adapter = " << adapter << std::endl;
+    }
+    for (const auto& field : FIELDS) {
+        out << field.key << " = " << (this->*field.member).count() << std::endl;
+    }
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,37 @@
+#include "usage_histogram.hpp"
+
+namespace {
+
+// Every bucket of a layout must be a 2 byte DATA_ID row, one after another
+constexpr bool layout_in_data_id(const HistogramLayout& layout) {
+    const int first = layout.first_id();
+    if (first < 0 || first + layout.buckets > DATA_ID.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < layout.buckets; ++i) {
+        const DataIdEntry& row = DATA_ID[first + i];
+        if (row.addr != layout.addr + 2 * i || row.length != 2 || row.type != RegType::Uint) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(layout_in_data_id(DISCHARGE_CURRENT), "DISCHARGE_CURRENT must match DATA_ID");
+static_assert(layout_in_data_id(DISCHARGE_CURRENT_FINE), "DISCHARGE_CURRENT_FINE must match DATA_ID");
+static_assert(layout_in_data_id(CHARGE_START_VOLTAGE), "CHARGE_START_VOLTAGE must match DATA_ID");
+static_assert(layout_in_data_id(CHARGE_END_VOLTAGE), "CHARGE_END_VOLTAGE must match DATA_ID");
+static_assert(CHARGE_START_VOLTAGE.buckets == CHARGE_END_VOLTAGE.buckets,
+              "Charge start and end share ChargeVoltageHistogram");
+
+} // namespace
+
+std::string HistogramLayout::label(size_t bucket) const {
+    if (open_below && bucket == 0) {
+        return "< " + std::to_string(lower_edge(1)) + unit;
+    }
+    if (open_above && bucket + 1 == buckets) {
+        return "> " + std::to_string(lower_edge(bucket)) + unit;
+    }
+    return std::to_string(lower_edge(bucket)) + "-" + std::to_string(lower_edge(bucket + 1)) + unit;
+}
@@ -0,0 +1,99 @@
+#include "usb_adapter.hpp"
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
+namespace {
+
+std::string basename_of(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Driver bound to a sysfs device: the "driver" symlink, or DRIVER= in uevent
+std::string driver_of(const std::string& device) {
+    char target[PATH_MAX];
+    ssize_t length = ::readlink((device + "/driver").c_str(), target, sizeof(target) - 1);
+    if (length > 0) {
+        target[length] = '\0';
+        return basename_of(target);
+    }
+
+    std::ifstream uevent(device + "/uevent");
+    std::string line;
+    while (std::getline(uevent, line)) {
+        if (line.compare(0, 7, "DRIVER=") == 0) {
+            return line.substr(7);
+        }
+    }
+    return "";
+}
+
+AdapterChip chip_of(const std::string& driver) {
+    if (driver == "ftdi_sio") {
+        return AdapterChip::Ftdi;
+    }
+    if (driver == "cp210x") {
+        return AdapterChip::Cp210x;
+    }
+    if (driver == "ch341" || driver == "ch341-uart") {
+        return AdapterChip::Ch340;
+    }
+    if (driver == "pl2303") {
+        return AdapterChip::Pl2303;
+    }
+    return AdapterChip::Unknown;
+}
+
+} // namespace
+
+const char* adapter_chip_name(AdapterChip chip) {
+    switch (chip) {
+        case AdapterChip::Ftdi: return "FTDI";
+        case AdapterChip::Cp210x: return "CP210x";
+        case AdapterChip::Ch340: return "CH340";
+        case AdapterChip::Pl2303: return "PL2303";
+        case AdapterChip::Unknown: break;
+    }
+    return "unknown";
+}
+
+AdapterInfo detect_adapter(const std::string& port, const std::string& sysfs_root) {
+    AdapterInfo info;
+
+    // Follow udev symlinks such as /dev/serial/by-id/... to the tty node
+    char resolved[PATH_MAX];
+    info.tty = basename_of(::realpath(port.c_str(), resolved) ? resolved : port);
+
+    const std::string device = sysfs_root + "/class/tty/" + info.tty + "/device";
+    info.driver = driver_of(device);
+    info.chip = chip_of(info.driver);
+
+    const std::string latency_timer = device + "/latency_timer";
+    if (::access(latency_timer.c_str(), F_OK) == 0) {
+        info.latency_timer_path = latency_timer;
+        info.latency_timer_ms = read_latency_timer(latency_timer);
+        info.original_latency_timer_ms = info.latency_timer_ms;
+    }
+    return info;
+}
+
+int read_latency_timer(const std::string& path) {
+    std::ifstream in(path);
+    int value = -1;
+    if (!(in >> value)) {
+        return -1;
+    }
+    return value;
+}
+
+bool write_latency_timer(const std::string& path, int milliseconds) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    out << milliseconds << "\n";
+    out.close();
+    return static_cast<bool>(out);
+}
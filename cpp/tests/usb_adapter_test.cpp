@@ -0,0 +1,119 @@
+// Adapter detection and low-latency settings against a fake sysfs tree in
+// a temp directory. A pty stands in for the USB serial port, so the FTDI
+// latency_timer is the only setting whose write can be observed.
+#include "serial_port.hpp"
+#include "usb_adapter.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                             \
+            ++g_failures;                                                         \
+        }                                                                         \
+    } while (0)
+
+// class/tty/TTY/device bound to driver, with a latency_timer if latency_ms >= 0.
+// With use_uevent the driver is named in uevent instead of by a symlink.
+fs::path make_device(const fs::path& root, const std::string& tty, const std::string& driver,
+                     int latency_ms, bool use_uevent = false) {
+    fs::path device = root / "class" / "tty" / tty / "device";
+    fs::create_directories(device);
+    if (use_uevent) {
+        std::ofstream(device / "uevent") << "DEVTYPE=usb-serial\nDRIVER=" << driver << "\n";
+    } else {
+        fs::create_directory_symlink("../../../../bus/usb-serial/drivers/" + driver, device / "driver");
+    }
+    if (latency_ms >= 0) {
+        std::ofstream(device / "latency_timer") << latency_ms << "\n";
+    }
+    return device;
+}
+
+void test_detect(const fs::path& root) {
+    fs::path ftdi = make_device(root, "ttyUSB0", "ftdi_sio", 16);
+    AdapterInfo info = detect_adapter("/dev/ttyUSB0", root.string());
+    CHECK(info.chip == AdapterChip::Ftdi);
+    CHECK(info.tty == "ttyUSB0");
+    CHECK(info.driver == "ftdi_sio");
+    CHECK(info.latency_timer_path == (ftdi / "latency_timer").string());
+    CHECK(info.latency_timer_ms == 16);
+    CHECK(info.original_latency_timer_ms == 16);
+
+    make_device(root, "ttyUSB1", "cp210x", -1, true);
+    info = detect_adapter("/dev/ttyUSB1", root.string());
+    CHECK(info.chip == AdapterChip::Cp210x);
+    CHECK(info.driver == "cp210x");
+    CHECK(info.latency_timer_path.empty());
+    CHECK(info.latency_timer_ms == -1);
+
+    info = detect_adapter("/dev/ttyUSB9", root.string());
+    CHECK(info.chip == AdapterChip::Unknown);
+    CHECK(info.driver.empty());
+}
+
+void test_latency_timer(const fs::path& root) {
+    int master = ::posix_openpt(O_RDWR | O_NOCTTY);
+    CHECK(master >= 0);
+    if (master < 0 || ::grantpt(master) != 0 || ::unlockpt(master) != 0) {
+        return;
+    }
+    const std::string slave = ::ptsname(master);
+    const std::string tty = fs::path(slave).filename().string();
+    const std::string latency_timer = (make_device(root, tty, "ftdi_sio", 16) / "latency_timer").string();
+
+    // open() lowers latency_timer to 1ms and close() puts it back
+    SerialPort port(slave, 4800, 0.1);
+    port.set_sysfs_root(root.string());
+    CHECK(port.open());
+    CHECK(port.adapter().chip == AdapterChip::Ftdi);
+    CHECK(port.adapter().latency_timer_ms == 1);
+    CHECK(read_latency_timer(latency_timer) == 1);
+    port.close();
+    CHECK(read_latency_timer(latency_timer) == 16);
+
+    // Without low latency the adapter is left alone
+    port.set_low_latency(false);
+    CHECK(port.open());
+    CHECK(port.adapter().latency_timer_ms == 16);
+    CHECK(read_latency_timer(latency_timer) == 16);
+    port.close();
+    CHECK(read_latency_timer(latency_timer) == 16);
+
+    ::close(master);
+}
+
+} // namespace
+
+int main() {
+    char pattern[] = "/tmp/m18-sysfs-XXXXXX";
+    if (::mkdtemp(pattern) == nullptr) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    const fs::path root = pattern;
+
+    test_detect(root);
+    test_latency_timer(root);
+
+    fs::remove_all(root);
+    if (g_failures > 0) {
+        std::fprintf(stderr, "%d checks failed\n", g_failures);
+        return 1;
+    }
+    std::printf("usb_adapter: all checks passed\n");
+    return 0;
+}